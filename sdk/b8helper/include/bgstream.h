@@ -0,0 +1,111 @@
+/**
+ * @file bgstream.h
+ * @brief Streams a large tile map through a small BG ring.
+ *
+ * A `b8PpuBg` can show at most 64x64 tiles, but a level can be much larger.
+ * CBgStream keeps only the tiles around the view resident, in a BG whose
+ * size is a power of two and which is drawn with `B8_PPU_BG_WRAP_REPEAT`:
+ * world tile (x, y) lives at ring tile (x mod w, y mod h), so drawing the ring
+ * at the world offset modulo its size shows the world.
+ *
+ * When the view moves, only the rows and columns that enter the resident
+ * window are fetched, through a callback, so scrolling by one tile costs one
+ * row or column of tiles.
+ *
+ * Usage:
+ * @code
+ *   static b8PpuBgTile ring[ 64 * 64 ];
+ *   CBgStream stream;
+ *   stream.Reset( ring, 6, 6, 128, 240,
+ *     []( s32 x, s32 y ){ return level_tile( x, y ); } );
+ *
+ *   // each frame
+ *   stream.Scroll( camera_x, camera_y );
+ *   stream.Draw( &cmd, otz );
+ * @endcode
+ */
+#pragma once
+
+#include <functional>
+#include <b8/ppu.h>
+
+/**
+ * @brief Returns the world tile at tile coordinates (x, y).
+ *
+ * Coordinates can be negative or past the end of the level; return an empty tile there.
+ */
+using BgStreamFetch = std::function< b8PpuBgTile( s32 x, s32 y ) >;
+
+class CBgStream {
+public:
+  /**
+   * @brief Sets up the ring and forgets every resident tile.
+   *
+   * The resident window is the view plus an equal margin on each side, as wide
+   * as the ring allows. While the PPU still draws the previous frame, the CPU
+   * only overwrites tiles outside that margin, so scrolling by up to `margin`
+   * tiles per frame is safe with pipelined frames.
+   *
+   * @param ring Tile buffer of (1 << wlog2) * (1 << hlog2) tiles. It must outlive the stream.
+   * @param wlog2 Ring width in tiles, as a power of 2 (at most 6).
+   * @param hlog2 Ring height in tiles, as a power of 2 (at most 6).
+   * @param view_wpix Width of the view in pixels.
+   * @param view_hpix Height of the view in pixels.
+   * @param fetch Callback that returns world tiles.
+   */
+  void  Reset( b8PpuBgTile* ring, u8 wlog2, u8 hlog2, u16 view_wpix, u16 view_hpix, BgStreamFetch fetch );
+
+  /**
+   * @brief Moves the top-left corner of the view to a world position.
+   *
+   * Fetches the tiles that enter the resident window. A jump farther than the
+   * window reloads all of it.
+   *
+   * @param wx World x in pixels.
+   * @param wy World y in pixels.
+   */
+  void  Scroll( s32 wx, s32 wy );
+
+  /**
+   * @brief Fetches the whole resident window again on the next Scroll().
+   *
+   * Call it after the level changes under tiles that are already resident.
+   */
+  void  Invalidate(){ _valid = false; }
+
+  /**
+   * @brief Appends a BG command that shows the view, at the back of the OT.
+   *
+   * @param cmd Command list.
+   * @param otz Z-value of the background.
+   * @return The command, to adjust it further.
+   */
+  b8PpuBg* Draw( b8PpuCmd* cmd, u32 otz ) const;
+
+  /** @brief Horizontal offset of the view in the ring, in pixels. */
+  u16   upix() const { return static_cast< u16 >( _wx & ((8 << _wlog2) - 1) ); }
+
+  /** @brief Vertical offset of the view in the ring, in pixels. */
+  u16   vpix() const { return static_cast< u16 >( _wy & ((8 << _hlog2) - 1) ); }
+
+  /** @brief Number of tiles fetched by the last Scroll(). */
+  u32   fetched() const { return _fetched; }
+
+private:
+  void  Load( s32 x0, s32 x1, s32 y0, s32 y1 );
+
+  b8PpuBgTile*  _ring = nullptr;
+  BgStreamFetch _fetch;
+  u8    _wlog2 = 0;
+  u8    _hlog2 = 0;
+  s32   _win_w = 0;     // resident window, in tiles
+  s32   _win_h = 0;
+  s32   _margin_x = 0;  // tiles kept on each side of the view
+  s32   _margin_y = 0;
+  s32   _x0 = 0;        // resident window origin, in world tiles
+  s32   _y0 = 0;
+  s32   _wx = 0;        // view origin, in world pixels
+  s32   _wy = 0;
+  u32   _fetched = 0;
+  bool  _valid = false;
+};
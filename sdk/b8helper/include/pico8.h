@@ -31,6 +31,8 @@
 #include <stdarg.h>
 #include <memory>
 #include <optional> 
+#include <bgstream.h>
+#include <vram.h>
 
 /*
   TODO: Comparison table with original PICO-8
@@ -394,6 +396,44 @@ namespace pico8 {
    */
   void sprb(u8 bank, int n, fx8 x = fx8(0), fx8 y = fx8(0), u8 w = 1, u8 h = 1, bool flip_x = false, bool flip_y = false, u8 selpal = 0);
 
+  /**
+   * @brief Per-sprite flags for `sprs()`.
+   *
+   * The upper 4 bits select the palette, see `SPR_PAL()`.
+   */
+  enum SprFlag {
+    SPR_FLIP_X = 1<<0,  ///< Drawn inverted left to right.
+    SPR_FLIP_Y = 1<<1,  ///< Drawn inverted top to bottom.
+  };
+  constexpr u8 SPR_PAL(u8 selpal) { return static_cast<u8>(selpal << 4); }
+
+  /**
+   * @brief Draws many sprites of the same size and bank in one call.
+   *
+   * Equivalent to calling `sprb(bank, n[i], x[i], y[i], w, h, ...)` for every `i`, but the camera,
+   * the clip rectangle and the bank are set up once, and consecutive sprites that land on the
+   * same depth are linked into the ordering table as a single run. Use it for bullets,
+   * particles and other scenes with hundreds of sprites.
+   *
+   * The input is a structure of arrays: every non-null array holds `count` entries.
+   *
+   * @param count The number of sprites.
+   * @param x The x coordinates (in pixels).
+   * @param y The y coordinates (in pixels).
+   * @param n The sprite numbers within the bank.
+   * @param flags `SPR_FLIP_X`, `SPR_FLIP_Y` and `SPR_PAL()` combined, or nullptr for none.
+   * @param z The depth of each sprite, clamped to [0, maxz()], or nullptr to use `getz()` for all.
+   * @param bank The bank index (0 to 15). The default is 0.
+   * @param w The width of each sprite, in the number of sprites. The default is 1.
+   * @param h The height of each sprite, in the number of sprites. The default is 1.
+   *
+   * @note Sprites are drawn in array order within the same depth. Sort by depth, or pass
+   *       nullptr for `z`, to get the longest runs.
+   *
+   * @note This function is affected by the camera settings and the clip rectangle.
+   */
+  void sprs(int count, const fx8* x, const fx8* y, const u8* n, const u8* flags = nullptr, const u8* z = nullptr, u8 bank = 0, u8 w = 1, u8 h = 1);
+
   /**
    * @brief Loads a sprite sheet into a specified VRAM bank on the BEEP-8 system.
    *
@@ -430,6 +470,7 @@ namespace pico8 {
    *       freed by the caller.
    * 
    * @warning Attempting to specify a bank that is already in use will trigger an assertion failure.
+   *          So does a bank that overlaps an image acquired with `vacquire()` and not released yet.
    * 
    * @warning The `srcimg` parameter must be an 8KB (8192 bytes) array representing a 4bpp, 128x128 image.
    *          If an array of any other size is specified, the behavior is undefined.
@@ -464,6 +505,67 @@ namespace pico8 {
    */
   void lsp(u8 bank,const uint8_t* srcimg);
 
+  /** @brief Identifies an image loaded with `vacquire()`. */
+  using VramHandle = vram::Handle;
+
+  /**
+   * @brief Loads an image of any size into free VRAM and takes a reference to it.
+   *
+   * Unlike `lsp()`, the caller does not pick where the image goes: it is packed into
+   * VRAM not used by banks loaded with `lsp()`, so small images do not waste a whole bank.
+   * Acquiring an image that is already resident only takes a reference. Released images
+   * stay resident until their space is needed, and are then evicted least recently used first.
+   *
+   * During `_draw()`, the upload is recorded at the start of the current frame.
+   * Otherwise this function blocks until the transfer is complete.
+   *
+   * @param img Pointer to the image data, 4bpp. It must stay valid while the image is acquired.
+   * @param wpix Width of the image in pixels, a multiple of 8 below 512.
+   * @param hpix Height of the image in pixels, a multiple of 8 below 512.
+   * @return Handle to the image, or `vram::INVALID` when it does not fit, or when the
+   *         frame's command list is full. Images drawn earlier in the frame are not
+   *         evicted to make room.
+   *
+   * Example usage:
+   * ```
+   * VramHandle enemy = vacquire( b8_image_enemy, 32, 16 );
+   * ...
+   * sprv( enemy, 2, x, y );   // third 8x8 tile of the image
+   * ...
+   * vrelease( enemy );        // e.g. when the level ends
+   * ```
+   */
+  VramHandle vacquire(const uint8_t* img, u16 wpix, u16 hpix);
+
+  /**
+   * @brief Drops a reference taken by `vacquire()`.
+   *
+   * The handle keeps working until the image is evicted, which only happens in a later
+   * `vacquire()`. Since uploads run at the start of the frame, do not draw a released
+   * image in a frame that acquires another one.
+   *
+   * @param hdl Handle returned by `vacquire()`.
+   */
+  void vrelease(VramHandle hdl);
+
+  /**
+   * @brief Draws a sprite from an image loaded with `vacquire()`.
+   *
+   * Works like `sprb()`, with tiles numbered row by row across the width of the image.
+   * Nothing is drawn if the image has been evicted.
+   *
+   * @param hdl Handle returned by `vacquire()`.
+   * @param n Tile index within the image.
+   * @param x X-coordinate where the sprite will be drawn.
+   * @param y Y-coordinate where the sprite will be drawn.
+   * @param w Width of the sprite in tiles.
+   * @param h Height of the sprite in tiles.
+   * @param flip_x Flip the sprite horizontally.
+   * @param flip_y Flip the sprite vertically.
+   * @param selpal Palette selection (0-15).
+   */
+  void sprv(VramHandle hdl, int n, fx8 x = fx8(0), fx8 y = fx8(0), u8 w = 1, u8 h = 1, bool flip_x = false, bool flip_y = false, u8 selpal = 0);
+
   /**
    * @brief Sets the palette using the specified palette selection index and palette data.
    *
@@ -533,6 +635,10 @@ namespace pico8 {
    *
    * Ensure that the values for c0, c1, and palsel are within valid ranges. If an invalid 
    * parameter is provided, the function will throw an INVALID_PARAM error.
+   *
+   * @note Palette changes are held until the next drawing call, so consecutive pal() and setpal()
+   *       calls at the same depth share one PPU flush, and setting an entry to the value it already
+   *       has at that depth emits nothing.
    */
   void pal( Color c0 , Color c1 , u8 palsel=0 );
 
@@ -592,6 +698,31 @@ namespace pico8 {
    */
   int maxz();
 
+  /**
+   * @brief Turns depth sorting of sprites by their y-coordinate on or off.
+   *
+   * For top-down games: while enabled, `spr()`, `sprb()`, `sprv()` and `sprs()` order the
+   * sprites drawn at the same depth by the bottom edge of their on-screen rectangle, so a
+   * sprite lower on the screen is drawn in front, whatever order they are drawn in.
+   * Sprites are sorted in steps of 4 pixels; ties keep the drawing order.
+   *
+   * Everything else drawn at that depth, including palette and clip changes, stays behind
+   * the sorted sprites, in drawing order. Draw a HUD at a lower depth.
+   *
+   * @param enable true to sort sprites by y, false to draw them in call order (the default).
+   * @return The previous setting.
+   *
+   * Example usage:
+   * ```
+   * setz( 4 );
+   * map( 0, 0 );                // floor, behind every sprite at depth 4
+   * ysort( true );
+   * for( auto& e : entities ) spr( e.n, e.x, e.y );
+   * ysort( false );
+   * ```
+   */
+  bool ysort(bool enable);
+
   /**
    * @brief Draws an unfilled circle on the screen.
    * 
@@ -633,6 +764,53 @@ namespace pico8 {
    */
   void circfill(fx8 x, fx8 y, fx8 r = fx8(4), Color col = CURRENT);
 
+  /**
+   * @brief Draws an unfilled ellipse inside a bounding rectangle.
+   * 
+   * The ellipse touches all four edges of the rectangle (x0, y0)-(x1, y1), both corners included.
+   * If the color is omitted, the current drawing color is used.
+   * 
+   * @param x0 The x coordinate of one corner of the bounding rectangle.
+   * @param y0 The y coordinate of one corner of the bounding rectangle.
+   * @param x1 The x coordinate of the opposite corner.
+   * @param y1 The y coordinate of the opposite corner.
+   * @param col The color of the ellipse (optional, default is the current draw color).
+   * 
+   * @note Like circ(), this function is affected by the camera and uses the depth set by setz().
+   */
+  void oval(fx8 x0, fx8 y0, fx8 x1, fx8 y1, Color col = CURRENT);
+
+  /**
+   * @brief Draws a filled ellipse inside a bounding rectangle.
+   * 
+   * @param x0 The x coordinate of one corner of the bounding rectangle.
+   * @param y0 The y coordinate of one corner of the bounding rectangle.
+   * @param x1 The x coordinate of the opposite corner.
+   * @param y1 The y coordinate of the opposite corner.
+   * @param col The color of the ellipse fill (optional, default is the current draw color).
+   * 
+   * @note Like circfill(), this function is affected by the camera and uses the depth set by setz().
+   */
+  void ovalfill(fx8 x0, fx8 y0, fx8 x1, fx8 y1, Color col = CURRENT);
+
+  /**
+   * @brief Draws the part of a circle outline between two angles.
+   * 
+   * The arc runs from angle a0 to a1 in radians, the same convention as cos() and sin():
+   * 0 points right and the angle grows towards +y, which is clockwise on screen.
+   * A sweep of 2π or more draws the full circle, and nothing is drawn if a1 <= a0.
+   * 
+   * @param x The x coordinate of the center of the circle.
+   * @param y The y coordinate of the center of the circle.
+   * @param r The radius of the circle.
+   * @param a0 The start angle, in radians.
+   * @param a1 The end angle, in radians.
+   * @param col The color of the arc (optional, default is the current draw color).
+   * 
+   * @note Like circ(), this function is affected by the camera and uses the depth set by setz().
+   */
+  void arc(fx8 x, fx8 y, fx8 r, fx8 a0, fx8 a1, Color col = CURRENT);
+
   /**
    * @brief Sets the clipping rectangle and returns the previous clipping rectangle.
    *
@@ -984,6 +1162,48 @@ namespace pico8 {
    */
   void  mapsetup(BgTiles wtile, BgTiles htile, std::optional<BgTilesPtr> tiles = std::nullopt , u8 uwrap = B8_PPU_BG_WRAP_CLAMP, u8 vwrap = B8_PPU_BG_WRAP_CLAMP , BgIndex index = BG_0 );
 
+  /**
+   * @brief Configures a background layer that streams a map larger than a BG can hold.
+   *
+   * The layer is a ring of `wtile` x `htile` tiles drawn with `B8_PPU_BG_WRAP_REPEAT`.
+   * Only the tiles around the view are resident; mapscroll() fetches the rows and columns
+   * that come into range through `fetch`, so the world itself can be any size and stored
+   * in any form.
+   *
+   * The ring must be larger than the screen by at least one tile in each direction.
+   * The extra tiles form a margin around the view, which also lets the PPU finish the
+   * previous frame while new tiles are written: keep the scroll speed per frame below
+   * half the extra tiles.
+   *
+   * @param wtile Width of the ring in tiles, at most `TILES_64`.
+   * @param htile Height of the ring in tiles, at most `TILES_64`.
+   * @param fetch Returns the world tile at tile coordinates (x, y), which can be negative.
+   * @param index The background index to configure (from 0 to BG_MAX-1).
+   *
+   * @note mget()/mset() on this layer address the ring, not the world. After changing
+   *       world tiles that may be resident, call mapinvalidate().
+   */
+  void  mapstream(BgTiles wtile, BgTiles htile, BgStreamFetch fetch, BgIndex index = BG_0 );
+
+  /**
+   * @brief Scrolls a streamed background layer and draws it.
+   *
+   * Fetches the tiles that come into range, then draws the layer like map(), with the
+   * top-left corner of the screen at world pixel (wx, wy).
+   *
+   * @param wx World x in pixels.
+   * @param wy World y in pixels.
+   * @param index The background index configured with mapstream().
+   */
+  void  mapscroll(s32 wx, s32 wy, BgIndex index = BG_0 );
+
+  /**
+   * @brief Makes the next mapscroll() fetch every resident tile of a streamed layer again.
+   *
+   * @param index The background index configured with mapstream().
+   */
+  void  mapinvalidate( BgIndex index = BG_0 );
+
   /**
    * @brief Draws the configured background layer at the specified pixel offset.
    *
@@ -1233,6 +1453,16 @@ namespace pico8 {
    * - `stat(34)`: Returns 1 if the left mouse button is pressed. Use 
    *               `mousestatus()` for full mouse button status in BEEP-8.
    * 
+   * BEEP-8 also reports how much of the PPU command list a frame uses:
+   * 
+   * - `stat(1000)`: Words of the command list used so far in this frame.
+   * - `stat(1001)`: Most words any frame has used so far.
+   * - `stat(1002)`: Commands dropped by the last frame because the list was full.
+   *                 A frame that drops commands gets a larger overflow segment
+   *                 the next time its buffer is used, up to the size of the
+   *                 buffer itself. Past that, commands keep being dropped.
+   * - `stat(1003)`: Words available to this frame, overflow segment included.
+   * 
    * @param index The index of the system information to retrieve. Use 32, 33, or 34 
    *              only for legacy PICO-8 compatibility. BEEP-8 provides clearer 
    *              and more precise alternatives: `mousex()`, `mousey()`, and 
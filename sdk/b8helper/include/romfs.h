@@ -0,0 +1,87 @@
+/**
+ * @file romfs.h
+ * @brief Read-only access to the ROMFS packed into the .b8 image.
+ *
+ * The build packs every file under ./romfs into a "BP8R" image with genb8rom,
+ * and relb8rom appends it to the executable, so it ends up in ROM next to the
+ * code. This library finds it at runtime and makes each file available in two
+ * ways:
+ *
+ * - As a file, registered at "/rom/<name>", for fopen(), fread() and fseek().
+ * - Mapped, as a pointer straight into ROM. Nothing is copied into WRAM.
+ *
+ * Files start on a 4-byte boundary, so mapped data can be read as u32.
+ *
+ * Usage:
+ * @code
+ * #include <romfs.h>
+ *
+ * romfs::Reset();
+ *
+ * // Zero-copy
+ * size_t size;
+ * const u8* level = romfs::Map( "level1.bin", &size );
+ * if( level ) parse_level( level, size );
+ *
+ * // Through stdio
+ * FILE* fp = fopen( "/rom/config.txt", "rb" );
+ * fseek( fp, 16, SEEK_SET );
+ * fread( buff, 1, sizeof(buff), fp );
+ *
+ * // Mapping an open file
+ * romfs::Mapping mm;
+ * ioctl( fileno( fp ), romfs::MAP, &mm );
+ * fclose( fp );
+ * @endcode
+ *
+ * A file can be open several times at once, each with its own position.
+ *
+ * **Note**: The file-system driver table has a fixed number of entries, and a
+ * path must fit in N_MAX_PATH. Files that do not get a path can still be mapped.
+ */
+#pragma once
+#include <b8/type.h>
+#include <stddef.h>
+
+namespace romfs {
+  /** @brief Directory the files are registered under. */
+  constexpr const char* ROOT = "/rom/";
+
+  enum EnCmd {
+    MAP       ///< ioctl(): fills a Mapping for the open file.
+  };
+
+  /** @brief Where a file is in ROM. */
+  struct Mapping {
+    const u8* _ptr = nullptr;   ///< First byte of the file.
+    size_t    _size = 0;        ///< Size of the file in bytes.
+  };
+
+  /**
+   * @brief Finds the ROMFS and registers its files at "/rom/<name>".
+   *
+   * Calling it again does nothing.
+   *
+   * @return Number of files in the ROMFS, 0 when the image has none.
+   */
+  u32   Reset();
+
+  /**
+   * @brief Looks up a file in ROM without opening it.
+   *
+   * @param name Name of the file as given to genb8rom, with or without ROOT.
+   * @param size Receives the size of the file. May be nullptr.
+   * @return Pointer to the data in ROM, or nullptr if there is no such file.
+   */
+  const u8* Map( const char* name, size_t* size );
+
+  /**
+   * @brief Number of files in the ROMFS.
+   */
+  u32   Count();
+
+  /**
+   * @brief Name of the idx-th file in the ROMFS, or nullptr past the end.
+   */
+  const char* Name( u32 idx );
+}
@@ -82,9 +82,15 @@ namespace sprprint {
    * @brief Holds the command context for sprite printing operations.
    * 
    * This structure contains a pointer to a command list used by the BEEP-8 PPU.
+   * When `_pal` is set, color changes go through that palette cache, so repeated
+   * colors emit no command; otherwise each color change emits a SETPAL and a FLUSH.
+   * With `_zshift` set, the Z-value `z` of `\e[<z>z` selects the last of the OT entries
+   * `z << _zshift` to `((z + 1) << _zshift) - 1`, for OTs split into groups of entries.
    */
   struct Context {
     b8PpuCmd* _cmd = nullptr;  ///< Pointer to PPU command list.
+    b8PpuPalCache* _pal = nullptr;  ///< Palette cache shared with the other users of `_cmd`, or nullptr.
+    u8 _zshift = 0;            ///< log2 of the OT entries per Z-value.
   };
 
   /**
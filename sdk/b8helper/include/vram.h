@@ -0,0 +1,123 @@
+/**
+ * @file vram.h
+ * @brief Allocator for the 512x512 4bpp VRAM shared by sprites and backgrounds.
+ *
+ * VRAM is managed in 8x8 tiles, 64x64 of them. Images are placed at the first
+ * free spot from the bottom-right corner, so fixed 128x128 banks loaded from the
+ * top-left (see pico8::lsp()) and packed images meet as late as possible.
+ *
+ * An image is identified by its source pointer. Acquiring an image that is
+ * already resident only takes a reference. Released images stay resident until
+ * their space is needed, and are then evicted least recently used first.
+ *
+ * Handles carry a generation, so a handle to an evicted image is detected
+ * instead of pointing at whatever replaced it.
+ *
+ * Usage:
+ * @code
+ *   vram::Handle hdl = vram::Acquire( &cmd, otz, b8_image_enemy, 32, 16 );
+ *
+ *   vram::Region rc;
+ *   if( vram::Get( hdl, &rc ) ){
+ *     b8PpuSprite* pp = b8PpuSpriteAllocZPB( &cmd, otz );
+ *     pp->srcxtile = rc.xtile;
+ *     pp->srcytile = rc.ytile;
+ *     ...
+ *   }
+ *
+ *   vram::Release( hdl );
+ * @endcode
+ *
+ * **Note**: This module is not thread-safe.
+ */
+#pragma once
+
+#include <b8/ppu.h>
+
+namespace vram {
+  /** @brief Identifies a resident image. 0 is never a valid handle. */
+  using Handle = u32;
+  constexpr Handle INVALID = 0;
+
+  /** @brief Area of VRAM, in tiles. */
+  struct Region {
+    u8  xtile = 0;
+    u8  ytile = 0;
+    u8  wtile = 0;
+    u8  htile = 0;
+  };
+
+  /** @brief Usage of the VRAM. */
+  struct Stat {
+    u32 free_tiles = 0;   ///< Tiles neither allocated nor reserved.
+    u32 resident = 0;     ///< Images in VRAM, referenced or not.
+    u32 referenced = 0;   ///< Images with at least one reference.
+    u32 uploads = 0;      ///< Images uploaded since Reset().
+    u32 evictions = 0;    ///< Images evicted since Reset().
+  };
+
+  /**
+   * @brief Forgets every image and reservation.
+   */
+  void    Reset();
+
+  /**
+   * @brief Starts a new frame.
+   *
+   * Images used since the last call are never evicted, even when released,
+   * because commands already recorded for the frame still draw them. Call it
+   * once per frame before recording; until the first call nothing is evicted.
+   */
+  void    NewFrame();
+
+  /**
+   * @brief Marks an area as used by code that does not go through the allocator.
+   *
+   * @param rc Area to reserve.
+   * @return true on success, false if it overlaps an image in use. Unreferenced
+   *         images in the way are evicted.
+   */
+  bool    Reserve( const Region& rc );
+
+  /**
+   * @brief Makes an image resident and takes a reference to it.
+   *
+   * When the image is not resident yet, space is allocated, evicting unreferenced
+   * images not used in this frame if needed, and a LOADIMG and a FLUSH are pushed
+   * to the front of the OT at `otz`. `img` must stay valid until the PPU has run `cmd`.
+   *
+   * @param cmd Command list the upload is recorded into.
+   * @param otz Z-value of the upload. Use the first one the PPU runs.
+   * @param img 4bpp image, 2 pixels per byte.
+   * @param wpix Width of the image in pixels, a multiple of 8.
+   * @param hpix Height of the image in pixels, a multiple of 8.
+   * @return Handle to the image, or INVALID when it does not fit or `cmd` is full.
+   */
+  Handle  Acquire( b8PpuCmd* cmd, u32 otz, const u8* img, u16 wpix, u16 hpix );
+
+  /**
+   * @brief Drops a reference taken by Acquire().
+   *
+   * The image stays resident, and can be acquired again without uploading it,
+   * until its space is needed.
+   *
+   * @param hdl Handle returned by Acquire().
+   */
+  void    Release( Handle hdl );
+
+  /**
+   * @brief Looks up where an image is, and marks it as recently used.
+   *
+   * @param hdl Handle returned by Acquire().
+   * @param rc Receives the area of the image.
+   * @return false if the handle is no longer valid.
+   */
+  bool    Get( Handle hdl, Region* rc );
+
+  /**
+   * @brief Reports the usage of the VRAM.
+   *
+   * @param st Receives the statistics.
+   */
+  void    GetStat( Stat* st );
+}
@@ -0,0 +1,88 @@
+#include <bgstream.h>
+#include <b8/assert.h>
+#include <utility>
+
+void  CBgStream::Reset( b8PpuBgTile* ring, u8 wlog2, u8 hlog2, u16 view_wpix, u16 view_hpix, BgStreamFetch fetch ){
+  _ASSERT( ring , "ring is null" );
+  _ASSERT( (1<<wlog2) <= B8_PPU_MAX_WTILE && (1<<hlog2) <= B8_PPU_MAX_HTILE , "ring too large" );
+
+  // Tiles a view touches at any sub-tile offset.
+  const s32 view_w = (view_wpix + 14) >> 3;
+  const s32 view_h = (view_hpix + 14) >> 3;
+  _ASSERT( view_w <= (1<<wlog2) && view_h <= (1<<hlog2) , "ring smaller than the view" );
+
+  _ring  = ring;
+  _fetch = std::move( fetch );
+  _wlog2 = wlog2;
+  _hlog2 = hlog2;
+  _margin_x = ((1<<wlog2) - view_w) >> 1;
+  _margin_y = ((1<<hlog2) - view_h) >> 1;
+  _win_w = view_w + 2*_margin_x;
+  _win_h = view_h + 2*_margin_y;
+  _fetched = 0;
+  _valid = false;
+}
+
+void  CBgStream::Load( s32 x0, s32 x1, s32 y0, s32 y1 ){
+  const s32 wmask = (1<<_wlog2) - 1;
+  const s32 hmask = (1<<_hlog2) - 1;
+  for( s32 y=y0 ; y < y1 ; ++y ){
+    b8PpuBgTile* row = _ring + ((y & hmask) << _wlog2);
+    for( s32 x=x0 ; x < x1 ; ++x ){
+      row[ x & wmask ] = _fetch( x, y );
+    }
+  }
+  if( x1 > x0 && y1 > y0 ) _fetched += (x1 - x0) * (y1 - y0);
+}
+
+void  CBgStream::Scroll( s32 wx, s32 wy ){
+  _wx = wx;
+  _wy = wy;
+  _fetched = 0;
+
+  const s32 nx = (wx >> 3) - _margin_x;
+  const s32 ny = (wy >> 3) - _margin_y;
+  const s32 dx = nx - _x0;
+  const s32 dy = ny - _y0;
+
+  if( !_valid || dx >= _win_w || -dx >= _win_w || dy >= _win_h || -dy >= _win_h ){
+    Load( nx, nx + _win_w, ny, ny + _win_h );
+    _x0 = nx;
+    _y0 = ny;
+    _valid = true;
+    return;
+  }
+
+  // Columns that enter the window, over its new height.
+  s32 keep_x0 = nx;
+  s32 keep_x1 = nx + _win_w;
+  if( dx > 0 ){
+    Load( _x0 + _win_w, nx + _win_w, ny, ny + _win_h );
+    keep_x1 = _x0 + _win_w;
+  } else if( dx < 0 ){
+    Load( nx, _x0, ny, ny + _win_h );
+    keep_x0 = _x0;
+  }
+
+  // Rows that enter the window, without the columns loaded above.
+  if( dy > 0 ){
+    Load( keep_x0, keep_x1, _y0 + _win_h, ny + _win_h );
+  } else if( dy < 0 ){
+    Load( keep_x0, keep_x1, ny, _y0 );
+  }
+
+  _x0 = nx;
+  _y0 = ny;
+}
+
+b8PpuBg* CBgStream::Draw( b8PpuCmd* cmd, u32 otz ) const {
+  b8PpuBg* pp = b8PpuBgAllocZPB( cmd, otz );
+  pp->cpuaddr = _ring;
+  pp->upix = upix();
+  pp->vpix = vpix();
+  pp->wtile = _wlog2;
+  pp->htile = _hlog2;
+  pp->uwrap = B8_PPU_BG_WRAP_REPEAT;
+  pp->vwrap = B8_PPU_BG_WRAP_REPEAT;
+  return pp;
+}
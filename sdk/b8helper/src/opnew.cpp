@@ -0,0 +1,21 @@
+#include <new>
+#include <bits/functexcept.h>
+#include <stdlib.h>
+#include <b8/heap.h>
+
+// Replaces libstdc++'s operator new so heap tracking reports the code that
+// called new, rather than operator new itself (see b8/heap.h).
+
+void* operator new( size_t size ){
+  void* ptr = malloc( size ? size : 1 );
+  if( !ptr ) std::__throw_bad_alloc();
+  b8HeapSetSite( ptr , __builtin_return_address( 0 ) );
+  return  ptr;
+}
+
+void* operator new[]( size_t size ){
+  void* ptr = malloc( size ? size : 1 );
+  if( !ptr ) std::__throw_bad_alloc();
+  b8HeapSetSite( ptr , __builtin_return_address( 0 ) );
+  return  ptr;
+}
@@ -9,6 +9,7 @@
 #include <exception>
 #include <vector>
 #include <cstring>
+#include <cstdlib>
 #include <esc_decoder.h>
 #include <assert.h>
 #include <bit>
@@ -154,6 +155,7 @@ struct BgConfig {
   BgTilesPtr tiles;
   u8      uwrap;
   u8      vwrap;
+  std::shared_ptr< CBgStream > stream;
 };
 
 enum Status {
@@ -164,22 +166,60 @@ enum Status {
 
 #define MAX_OTZ     (16)
 #define OTZ_BG_TEXT (1)
-static  u32  _ot        [ MAX_OTZ ];
-static  u32  _ot_prev   [ MAX_OTZ ];
-static  u32* _jmp_prev  [ MAX_OTZ ];
-
-static  void  clear_jmp_prev( b8PpuCmd* ppu_cmd ){
-  _jmp_prev [ 0 ] = ppu_cmd->addr_halt;
-  for( size_t nn=1 ; nn < MAX_OTZ ; ++nn ){
-    _jmp_prev [ nn ] = ppu_cmd->ot + (nn-1);
-  }
+
+/*
+  Each setz() level spans OTZ_SUB entries of the OT. Everything drawn at a
+  level goes to its last entry, except the sprites ysort() sorts into the
+  entries below it. The OT is cleared sparsely, so its size costs nothing
+  per frame.
+*/
+#define OTZ_SUB_LOG2  (6)
+#define OTZ_SUB       (1<<OTZ_SUB_LOG2)
+#define OT_NUM        (MAX_OTZ<<OTZ_SUB_LOG2)
+#define YSORT_SHIFT   (2)   // pixels per sorting key, as a power of 2
+
+static  inline  s16 otz_of( int level ){
+  return  static_cast< s16 >( (level << OTZ_SUB_LOG2) | (OTZ_SUB-1) );
 }
 
 #define PLAYER_MAX  (2)
-#define PPU_CMD_BUFF_WORDS (16*1024)
+// Two frames are in flight, so each gets half of what a single list had;
+// a frame that needs more spills into its overflow segment.
+#define PPU_CMD_BUFF_WORDS (8*1024)
+#define PPU_FRAME_NUM      (2)
+// Largest overflow segment per frame. A frame that still drops commands at
+// this size keeps dropping them, rather than eating the game's heap.
+#define PPU_OVL_MAX_BYTES  (PPU_CMD_BUFF_WORDS * sizeof(u32))
+
+/*
+  A frame is recorded into one slot while the PPU runs the previous one.
+  The OT is part of the list the PPU walks, so it lives in the slot too.
+  A slot whose frame had to drop commands gets a bigger overflow segment
+  from the heap the next time it is used, up to PPU_OVL_MAX_BYTES.
+*/
+struct PpuFrame {
+  u32 buff    [ PPU_CMD_BUFF_WORDS ];
+  u32 ot      [ OT_NUM ];
+  u32 ot_prev [ OT_NUM ];
+  u32 ot_used [ B8_PPU_OT_USED_WORDS( OT_NUM ) ];
+  u32 fence;
+  u32*  ovl;
+  u32   ovl_bytesize;
+  bool  grow;
+};
+
+// Command list usage, reported by stat(1000) to stat(1003).
+struct PpuCmdStat {
+  u32 high_water;   // most words used by a frame
+  u32 dropped;      // commands dropped by the last frame
+};
+
 static  u32       _cnt_update;
-static  u32       _ppu_cmd_buff[ PPU_CMD_BUFF_WORDS ];
+static  PpuFrame  _ppu_frame[ PPU_FRAME_NUM ];
+static  u32       _ppu_frame_next;
+static  PpuCmdStat _ppu_cmd_stat;
 static  b8PpuCmd  _ppu_cmd;
+static  b8PpuPalCache _pal_cache;
 static  s32       _reso_w     = 0;
 static  s32       _reso_h     = 0;
 static  Color     _color        = BLACK;
@@ -188,7 +228,8 @@ static  Error     _error        = NO_ERROR;
 static  Status    _status       = IDLE;
 static  Vec       _camera_cur;
 static  Vec       _camera_prev;
-static  s16       _otz = MAX_OTZ>>1;  
+static  s16       _otz = otz_of( MAX_OTZ>>1 );
+static  bool      _ysort        = false;
 static  Rect      _clip_cur;
 static  Rect      _clip_prev;
 static  SprCursor _spr_cursor_prev;
@@ -205,7 +246,7 @@ static  u8        _sprite_flags[ SPRITE_PATTERN_BANK_NUM ][256];
 static  const uint8_t* sprite_sheets[ MAX_SPR_BANK ] = {0};
 
 enum EnOtz {
-  OTZ_CLEAR     = MAX_OTZ - 1,
+  OTZ_CLEAR     = OT_NUM - 1,
 };
 
 struct CameraStack{
@@ -225,6 +266,31 @@ static  void  set_seed_from_time(){
   pico8::srand( seed );
 }
 
+// Returns the next slot once the PPU is done with it.
+static  PpuFrame& acquire_ppu_frame(){
+  PpuFrame& frame = _ppu_frame[ _ppu_frame_next ];
+  _ppu_frame_next = (_ppu_frame_next + 1) % PPU_FRAME_NUM;
+  b8PpuFenceWait( frame.fence );
+
+  if( frame.grow ){
+    frame.grow = false;
+    const u32 bytesize = std::min< u32 >( frame.ovl_bytesize + sizeof( frame.buff ) / 2, PPU_OVL_MAX_BYTES );
+    u32* ovl = (u32*)malloc( bytesize );
+    if( ovl ){
+      free( frame.ovl );
+      frame.ovl = ovl;
+      frame.ovl_bytesize = bytesize;
+    }
+  }
+  return frame;
+}
+
+static  void  update_ppu_cmd_stat( PpuFrame& frame ){
+  _ppu_cmd_stat.high_water = std::max( _ppu_cmd_stat.high_water, b8PpuCmdUsedWords( &_ppu_cmd ) );
+  _ppu_cmd_stat.dropped = _ppu_cmd.dropped;
+  if( _ppu_cmd.dropped && frame.ovl_bytesize < PPU_OVL_MAX_BYTES ) frame.grow = true;
+}
+
 static  void  _reset(){
   _cnt_update = 0;
   _status = IDLE;
@@ -233,7 +299,8 @@ static  void  _reset(){
   _error  = NO_ERROR;
   _camera_cur.set();
   _camera_prev = _camera_cur;
-  _otz = MAX_OTZ>>1;  
+  _otz = otz_of( MAX_OTZ>>1 );
+  _ysort = false;
   set_seed_from_time();
 
   b8PpuGetResolution((u32*)&_reso_w ,(u32*)&_reso_h );
@@ -243,6 +310,17 @@ static  void  _reset(){
   _bg_cursor_prev.Reset();
   memset(_sprite_flags, 0, sizeof(_sprite_flags));
 
+  {
+    // Banks 14 and 15 hold the font and other system images.
+    vram::Reset();
+    vram::Region rc;
+    rc.xtile = (MAX_SPR_BANK&3)<<4;
+    rc.ytile = (MAX_SPR_BANK>>2)<<4;
+    rc.wtile = 256 >>3;
+    rc.htile = 128 >>3;
+    vram::Reserve( rc );
+  }
+
   for( size_t nn=0 ; nn < numof( _button_status ) ; ++nn ){
     _button_status[ nn ] = ButtonStatus();
   }
@@ -253,6 +331,8 @@ static  void  _reset(){
     sprprint::Reset();
     sprprint::Context ctx;
     ctx._cmd = &_ppu_cmd;
+    ctx._pal = &_pal_cache;
+    ctx._zshift = OTZ_SUB_LOG2;
     _fp_sprprint = sprprint::Open( sprprint::CH1, ctx );
     _ASSERT(_fp_sprprint,"sprprint::Open");
   }
@@ -333,21 +413,25 @@ void  Pico8::run(){
   _status = RUNNING;
 
   while(1){
+    vram::NewFrame();
     hif_update();
     _update();
     ++_cnt_update;
+    b8HeapFrame();
     if( has_error() ) break;
 
-    b8PpuCmdSetBuff( &_ppu_cmd , _ppu_cmd_buff , sizeof( _ppu_cmd_buff ) );
-    b8PpuClearOT( &_ppu_cmd , &_ot[0], &_ot_prev[0], MAX_OTZ );
-    clear_jmp_prev( &_ppu_cmd );
+    PpuFrame& frame = acquire_ppu_frame();
+    b8PpuCmdSetBuff( &_ppu_cmd , frame.buff , sizeof( frame.buff ) );
+    b8PpuCmdSetOverflow( &_ppu_cmd , frame.ovl , frame.ovl_bytesize );
+    b8PpuClearOTSparse( &_ppu_cmd , &frame.ot[0], &frame.ot_prev[0], &frame.ot_used[0], OT_NUM );
+    b8PpuPalCacheReset( &_pal_cache , &_ppu_cmd );
     _during_draw = true;
     _draw();
 
     {
       bgprint::ExportPpuCmd epc;
       epc._cmd = &_ppu_cmd;
-      epc._otz = OTZ_BG_TEXT;
+      epc._otz = otz_of( OTZ_BG_TEXT );
       bgprint::Export(_fp_bgprint, epc);
     }
 
@@ -356,9 +440,14 @@ void  Pico8::run(){
     _during_draw = false;
     if( has_error() ) break;
     fflush(_fp_sprprint);
+    b8PpuPalCacheCommit( &_pal_cache );
+    b8PpuLinkOT( &_ppu_cmd );
     b8PpuHaltAlloc( &_ppu_cmd );
-    b8PpuExec( &_ppu_cmd );
-    b8PpuVsyncWait();
+    update_ppu_cmd_stat( frame );
+
+    // Starts once the previous frame is on screen, and runs while the
+    // next frame is updated and recorded.
+    frame.fence = b8PpuExecFence( &_ppu_cmd );
   }
 
   _status = ERROR; 
@@ -372,14 +461,47 @@ void  Pico8::run(){
   }
 }
 
+// OT entry of a sprite whose bottom edge is at screen y `bottom`, drawn at `otz`.
+// With ysort() on, a sprite lower on screen is drawn in front.
+static  s16 sprite_otz( s16 otz, fx8 bottom ){
+  if( !_ysort ) return otz;
+  int key = static_cast< int >( bottom ) >> YSORT_SHIFT;
+  key = key < 0 ? 0 : (key > OTZ_SUB-2 ? OTZ_SUB-2 : key);
+  return  static_cast< s16 >( otz - 1 - key );
+}
+
+// Records commands outside of draw, and waits until the PPU has run them.
+template< typename Record >
+static  void  exec_now( Record record ){
+  PpuFrame& frame = acquire_ppu_frame();
+  b8PpuCmd  cmd;
+  b8PpuCmdSetBuff( &cmd , frame.buff , sizeof( frame.buff ) );
+  u32 ot[ 1 ], ot_prev[ 1 ];
+  b8PpuClearOT( &cmd , ot , ot_prev , 1 );
+
+  record( &cmd );
+
+  frame.fence = b8PpuExecFence( &cmd );
+  b8PpuFenceWait( frame.fence );
+}
+
 void lsp(u8 bank,const uint8_t* srcimg){
   _ASSERT( bank < MAX_SPR_BANK , "invalid bank" );
   _ASSERT( sprite_sheets[ bank ] == 0 , "sprite_sheets is already used" );
 
-  b8PpuCmdSetBuff( &_ppu_cmd , _ppu_cmd_buff , sizeof( _ppu_cmd_buff ) );
+  vram::Region rc;
+  rc.xtile = (bank&3)<<4;
+  rc.ytile = (bank>>2)<<4;
+  rc.wtile = 128 >>3;
+  rc.htile = 128 >>3;
+  const bool ok = vram::Reserve( rc );
+  _ASSERT( ok , "bank is used by vacquire()" );
 
-  {
-    b8PpuLoadimg* pp = b8PpuLoadimgAlloc( &_ppu_cmd );
+  exec_now( [&]( b8PpuCmd* cmd ){
+    b8PpuFlush* pf = b8PpuFlushAllocZ( cmd , 0 );
+    pf->img = 1;
+
+    b8PpuLoadimg* pp = b8PpuLoadimgAllocZ( cmd , 0 );
     pp->cpuaddr = srcimg;
 
     // src
@@ -388,28 +510,64 @@ void lsp(u8 bank,const uint8_t* srcimg){
     pp->srcwtile = 128 >>3;
 
     // dst
-    pp->dstxtile = (bank&3)<<4;
-    pp->dstytile = bank>>2;
-    pp->trnwtile = 128 >>3;
-    pp->trnhtile = 128 >>3;
-  }
+    pp->dstxtile = rc.xtile;
+    pp->dstytile = rc.ytile;
+    pp->trnwtile = rc.wtile;
+    pp->trnhtile = rc.htile;
+  });
 
-  {
-    b8PpuFlush* pp = b8PpuFlushAlloc( &_ppu_cmd );
-    pp->img = 1;
+  sprite_sheets[ bank ] = srcimg;
+}
+
+VramHandle  vacquire( const uint8_t* img, u16 wpix, u16 hpix ){
+  MUST_RETURN( img && (wpix & 7) == 0 && (hpix & 7) == 0 , INVALID_PARAM , vram::INVALID );
+
+  // During draw the upload runs first in the frame being recorded.
+  if( _during_draw ){
+    return  vram::Acquire( &_ppu_cmd , OTZ_CLEAR , img , wpix , hpix );
   }
 
-  sprite_sheets[ bank ] = srcimg;
+  VramHandle hdl = vram::INVALID;
+  exec_now( [&]( b8PpuCmd* cmd ){
+    hdl = vram::Acquire( cmd , 0 , img , wpix , hpix );
+  });
+  return  hdl;
+}
 
-  b8PpuHaltAlloc( &_ppu_cmd );
-  b8PpuExec( &_ppu_cmd );
-  b8PpuVsyncWait();
+void  vrelease( VramHandle hdl ){
+  vram::Release( hdl );
+}
+
+void  sprv( VramHandle hdl, int n, fx8 x, fx8 y, u8 w, u8 h, bool flip_x, bool flip_y, u8 selpal ){
+  MUST( _during_draw, NOT_DURING_DRAWING );
+  MUST( selpal < 16 , INVALID_PARAM );
+  if( 0 == w || 0 == h )  return;
+
+  vram::Region reg;
+  if( false == vram::Get( hdl , &reg ) )  return;
+  MUST( n >= 0 && n < reg.wtile * reg.htile , INVALID_PARAM );
+
+  const Rect rc(x - _camera_cur.x, y - _camera_cur.y, w<<3,h<<3);
+  if( false == _is_colliding(rc, _clip_cur ) )  return;
+
+  b8PpuPalCacheCommit( &_pal_cache );
+  b8PpuSprite* pp = b8PpuSpriteAllocZPB( &_ppu_cmd , sprite_otz( _otz, rc.y + rc.h ) );
+  pp->pal = selpal;
+  pp->x = rc.x;
+  pp->y = rc.y;
+  pp->srcwtile = w;
+  pp->srchtile = h;
+  pp->vfp = flip_y ? 1:0;
+  pp->hfp = flip_x ? 1:0;
+  pp->srcxtile = reg.xtile + n % reg.wtile;
+  pp->srcytile = reg.ytile + n / reg.wtile;
 }
 
 void  cls( Color color ){
   MUST( _during_draw , NOT_DURING_DRAWING );
 
   scursor();
+  b8PpuPalCacheCommit( &_pal_cache );
 
   {
     b8PpuScissor* pp = b8PpuScissorAllocZPB( &_ppu_cmd, OTZ_CLEAR );
@@ -450,6 +608,7 @@ void rectfill(fx8 x0, fx8 y0, fx8 x1, fx8 y1, Color color) {
   const Rect rc(x0, y0, x1 - x0, y1 - y0);
   if (false == _is_colliding(rc, _clip_cur)) return;
 
+  b8PpuPalCacheCommit( &_pal_cache );
   b8PpuRect* pp = b8PpuRectAllocZPB(&_ppu_cmd, _otz);
   pp->pal = (color == CURRENT) ? _color : color;
   pp->x = x0;
@@ -482,6 +641,7 @@ void  line(const Line& ln, Color color ){
 
   if( false == _is_colliding( lln, _clip_cur ) ) return;
 
+  b8PpuPalCacheCommit( &_pal_cache );
   b8PpuLine* pp = b8PpuLineAllocZPB( &_ppu_cmd , _otz );
   pp->pal = (color == CURRENT) ? _color : color;
   pp->width = 2;
@@ -501,6 +661,7 @@ void  poly(const Poly& pol , Color color ){
 
   if( false == _is_colliding( lpol , _clip_cur ) ) return;
 
+  b8PpuPalCacheCommit( &_pal_cache );
   b8PpuPoly* pp = b8PpuPolyAllocZPB( &_ppu_cmd, _otz);
   pp->pal = (color == CURRENT) ? _color : color;
   pp->x0 = lpol.pos0.x;
@@ -524,7 +685,8 @@ void  spr(int n, fx8 x, fx8 y, u8 w, u8 h, bool flip_x, bool flip_y,u8 selpal){
   const Rect rc(x - _camera_cur.x, y - _camera_cur.y, w<<3,h<<3);
   if( false == _is_colliding(rc, _clip_cur ) )  return;
 
-  b8PpuSprite* pp = b8PpuSpriteAllocZPB( &_ppu_cmd , _otz );
+  b8PpuPalCacheCommit( &_pal_cache );
+  b8PpuSprite* pp = b8PpuSpriteAllocZPB( &_ppu_cmd , sprite_otz( _otz, rc.y + rc.h ) );
   pp->pal = selpal;
   pp->x = rc.x;
   pp->y = rc.y;
@@ -546,7 +708,8 @@ void sprb(u8 bank , int n, fx8 x , fx8 y , u8 w , u8 h , bool flip_x , bool flip
   const Rect rc(x - _camera_cur.x, y - _camera_cur.y, w<<3,h<<3);
   if( false == _is_colliding(rc, _clip_cur ) )  return;
 
-  b8PpuSprite* pp = b8PpuSpriteAllocZPB( &_ppu_cmd , _otz );
+  b8PpuPalCacheCommit( &_pal_cache );
+  b8PpuSprite* pp = b8PpuSpriteAllocZPB( &_ppu_cmd , sprite_otz( _otz, rc.y + rc.h ) );
   pp->pal = selpal;
   pp->x = rc.x;
   pp->y = rc.y;
@@ -565,58 +728,70 @@ void sprb(u8 bank , int n, fx8 x , fx8 y , u8 w , u8 h , bool flip_x , bool flip
   pp->srcytile = by + ly;
 }
 
-void setpal(int palsel, const std::array<unsigned char, 16>& pidx ){
-  MUST( _during_draw , NOT_DURING_DRAWING );
+void  sprs(int count, const fx8* x, const fx8* y, const u8* n, const u8* flags, const u8* z, u8 bank, u8 w, u8 h ){
+  MUST( _during_draw, NOT_DURING_DRAWING );
+  MUST( bank < 16, INVALID_PARAM );
+  if( count <= 0 || 0 == w || 0 == h )  return;
+  MUST( x && y && n , INVALID_PARAM );
 
-  b8PpuSetpal* pp = b8PpuSetpalAllocZPB( &_ppu_cmd, _otz, 1 );
-  pp->palsel = palsel;
+  // The clip test of spr(), moved into world space once for the whole batch.
+  const fx8 left   = _clip_cur.x + _camera_cur.x - fx8(w<<3);
+  const fx8 right  = _clip_cur.x + _clip_cur.w + _camera_cur.x;
+  const fx8 top    = _clip_cur.y + _camera_cur.y - fx8(h<<3);
+  const fx8 bottom = _clip_cur.y + _clip_cur.h + _camera_cur.y;
 
-  pp->pidx0 = pidx[0];
-  pp->pidx1 = pidx[1];
-  pp->pidx2 = pidx[2];
-  pp->pidx3 = pidx[3];
-  pp->pidx4 = pidx[4];
-  pp->pidx5 = pidx[5];
-  pp->pidx6 = pidx[6];
-  pp->pidx7 = pidx[7];
+  const u8 bx = ((bank&3)<<4);
+  const u8 by = ((bank>>2)<<4);
+  const int zmax = maxz();
+  b8PpuPalCacheCommit( &_pal_cache );
+
+  // Sprites are allocated back to back; a run of the same depth takes one OT link.
+  u32* run = nullptr;
+  int  run_z = 0;
+  for( int ii=0 ; ii < count ; ++ii ){
+    if( x[ii] < left || x[ii] > right || y[ii] < top || y[ii] > bottom ) continue;
+
+    const s16 base = z ? otz_of( z[ii] > zmax ? zmax : z[ii] ) : _otz;
+    const int zz = sprite_otz( base, y[ii] - _camera_cur.y + fx8(h<<3) );
+    if( run && zz != run_z ){
+      b8PpuPushBackOT( &_ppu_cmd , run_z , run );
+      run = nullptr;
+    }
+
+    b8PpuSprite* pp = b8PpuSpriteAlloc( &_ppu_cmd );
+    if( nullptr == run ){
+      run = (u32*)pp;
+      run_z = zz;
+    }
 
-  pp->pidx8 = pidx[8];
-  pp->pidx9 = pidx[9];
-  pp->pidx10= pidx[10];
-  pp->pidx11= pidx[11];
-  pp->pidx12= pidx[12];
-  pp->pidx13= pidx[13];
-  pp->pidx14= pidx[14];
-  pp->pidx15= pidx[15];
+    const u8 ff = flags ? flags[ii] : 0;
+    pp->pal = ff >> 4;
+    pp->x = x[ii] - _camera_cur.x;
+    pp->y = y[ii] - _camera_cur.y;
+    pp->srcwtile = w;
+    pp->srchtile = h;
+    pp->vfp = (ff & SPR_FLIP_Y) ? 1:0;
+    pp->hfp = (ff & SPR_FLIP_X) ? 1:0;
+    pp->srcxtile = bx + (n[ii]&0xf);
+    pp->srcytile = by + (n[ii]>>4);
+  }
+  if( run ) b8PpuPushBackOT( &_ppu_cmd , run_z , run );
+}
+
+void setpal(int palsel, const std::array<unsigned char, 16>& pidx ){
+  MUST( _during_draw , NOT_DURING_DRAWING );
+  MUST( palsel >= 0 && palsel < 16, INVALID_PARAM );
+
+  b8PpuPalCacheSet( &_pal_cache, _otz, palsel, 0xffff, pidx.data() );
 }
 
 void pal( Color c0 , Color c1 , u8 palsel ){
   MUST( _during_draw , NOT_DURING_DRAWING );
   MUST( c0 < 16 && c1 < 16 && palsel < 16, INVALID_PARAM ); 
 
-  b8PpuSetpal* pp = b8PpuSetpalAllocZPB( &_ppu_cmd, _otz, 1 );
-  pp->palsel = palsel;
-  pp->wmask = 1<<c0;
-
-  switch( c0 ){
-    case  0: pp->pidx0 = c1; break;
-    case  1: pp->pidx1 = c1; break;
-    case  2: pp->pidx2 = c1; break;
-    case  3: pp->pidx3 = c1; break;
-    case  4: pp->pidx4 = c1; break;
-    case  5: pp->pidx5 = c1; break;
-    case  6: pp->pidx6 = c1; break;
-    case  7: pp->pidx7 = c1; break;
-    case  8: pp->pidx8 = c1; break;
-    case  9: pp->pidx9 = c1; break;
-    case 10: pp->pidx10= c1; break;
-    case 11: pp->pidx11= c1; break;
-    case 12: pp->pidx12= c1; break;
-    case 13: pp->pidx13= c1; break;
-    case 14: pp->pidx14= c1; break;
-    case 15: pp->pidx15= c1; break;
-    default:  break;
-  }
+  u8 pidx[ 16 ];
+  pidx[ c0 ] = c1;
+  b8PpuPalCacheSet( &_pal_cache, _otz, palsel, 1<<c0, pidx );
 }
 
 Color color(Color color ){
@@ -633,13 +808,19 @@ const Vec& camera( fx8 camera_x , fx8 camera_y ){
 }
 
 int   setz(int otz ){
-  int save_otz = otz;
-  _otz = (otz < 0) ? 0 : (otz > maxz() ? maxz() : otz);
+  const int save_otz = getz();
+  _otz = otz_of( (otz < 0) ? 0 : (otz > maxz() ? maxz() : otz) );
   return save_otz;
 }
 
 int   getz(){
-  return _otz;
+  return _otz >> OTZ_SUB_LOG2;
+}
+
+bool  ysort( bool enable ){
+  const bool prev = _ysort;
+  _ysort = enable;
+  return prev;
 }
 
 const Rect& clip(const Rect& rc ){
@@ -668,20 +849,6 @@ int maxz(){
   return  MAX_OTZ-1;
 }
 
-#define AFR (4096<<18)
-
-static const u32 vangle_table[] = {
-  AFR / 16, AFR / 17, AFR / 18, AFR / 19, 
-  AFR / 20, AFR / 21, AFR / 22, AFR / 23, 
-  AFR / 24, AFR / 25, AFR / 26, AFR / 27, 
-  AFR / 28, AFR / 29, AFR / 30, AFR / 31, 
-  AFR / 32, AFR / 33, AFR / 34, AFR / 35, 
-  AFR / 36, AFR / 37, AFR / 38, AFR / 39, 
-  AFR / 40, AFR / 41, AFR / 42, AFR / 43, 
-  AFR / 44, AFR / 45, AFR / 46, AFR / 47, 
-  AFR / 48, AFR / 49, AFR / 50
-};
-
 static  void  _circ_r1(fx8 x,fx8 y,Color col){
   x -= 1;
   y -= 1;
@@ -692,10 +859,162 @@ static  void  _circ_r1(fx8 x,fx8 y,Color col){
   pset(x,     y+one ,col);
 }
 
-static  void  _calc_segments_vangle( fx8 r , int* segments, u32* vangle ){
-  const fx8 circumference = fx8(6) * r + (r >> 2);  // 6*r + r/4 ≈ 6.28*r
-  *segments = std::min(50, std::max(16, circumference>>3 ) );
-  *vangle = vangle_table[ *segments - 16 ];
+// Emits RECT commands at the current depth, skipping the ones outside the clip rectangle.
+struct SpanSink {
+  int   _left , _top , _right , _bottom;
+  Color _col;
+
+  explicit SpanSink( Color col ){
+    _left   = _clip_cur.x;
+    _top    = _clip_cur.y;
+    _right  = _clip_cur.x + _clip_cur.w;
+    _bottom = _clip_cur.y + _clip_cur.h;
+    _col    = (col == CURRENT) ? _color : col;
+    b8PpuPalCacheCommit( &_pal_cache );
+  }
+
+  void  rect( int x , int y , int w , int h ) const {
+    if( x + w < _left || x > _right || y + h < _top || y > _bottom ) return;
+    b8PpuRect* pp = b8PpuRectAllocZPB( &_ppu_cmd , _otz );
+    pp->pal = _col;
+    pp->x = x;
+    pp->y = y;
+    pp->w = w;
+    pp->h = h;
+  }
+};
+
+// Horizontal span that grows by one row at a time while the rows above or below repeat it.
+struct SpanRun {
+  int _x = 0 , _y = 0 , _w = 0 , _h = 0;
+
+  void  push( int x , int y , int w , const SpanSink& sink ){
+    if( _h && x == _x && w == _w ){
+      if( y == _y - 1 ){ --_y; ++_h; return; }
+      if( y == _y + _h ){ ++_h; return; }
+    }
+    flush( sink );
+    _x = x; _y = y; _w = w; _h = 1;
+  }
+
+  void  flush( const SpanSink& sink ){
+    if( _h ) sink.rect( _x , _y , _w , _h );
+    _h = 0;
+  }
+};
+
+// Walks the rows of an ellipse from its middle row outwards. A pixel (dx,dy) is inside when
+// (dx/(rx+1/2))^2 + (dy/(ry+1/2))^2 <= 1, which for a circle is dx^2 + dy^2 <= r^2 + r.
+struct OvalRows {
+  s64 _a2 , _b2 , _lim;
+  int _dy , _hw;
+
+  OvalRows( int rx , int ry ){
+    _a2  = static_cast< s64 >( 2*rx+1 ) * ( 2*rx+1 );
+    _b2  = static_cast< s64 >( 2*ry+1 ) * ( 2*ry+1 );
+    _lim = _a2 * _b2;
+    _dy  = 0;
+    _hw  = rx;
+    fit();
+  }
+
+  // Half width of the current row: the row covers -hw..+hw around the centre.
+  int   hw() const { return _hw; }
+  void  next(){ ++_dy; fit(); }
+
+private:
+  void  fit(){
+    const s64 ydist = static_cast< s64 >( _dy ) * _dy * _a2;
+    while( _hw > 0 && 4 * ( static_cast< s64 >( _hw ) * _hw * _b2 + ydist ) > _lim ) --_hw;
+  }
+};
+
+// Sector of an arc, as the unit vectors of its start and end angles (raw fx8).
+struct ArcSector {
+  int   _sx , _sy , _ex , _ey;
+  bool  _wide;    // the sector is more than half a turn
+
+  // (px,py) is relative to the centre, in any scale.
+  bool  contains( int px , int py ) const {
+    const bool  after_start = _sx * py - _sy * px >= 0;
+    const bool  before_end  = px * _ey - py * _ex >= 0;
+    return _wide ? ( after_start || before_end ) : ( after_start && before_end );
+  }
+};
+
+// Rasterizes an ellipse into horizontal RECT spans. The left and top halves are centred on
+// (cx,cy) and the right and bottom halves on (cx+ex,cy+ey), so ex/ey = 1 gives an even size.
+// Rows of identical spans are merged into one rectangle. Coordinates are in screen space.
+static  void  _oval_spans(
+  int cx , int cy , int rx , int ry , int ex , int ey ,
+  bool fill , const SpanSink& sink , const ArcSector* arc
+){
+  if( sink._right < cx - rx || sink._left > cx + ex + rx ) return;
+  if( sink._bottom < cy - ry || sink._top > cy + ey + ry ) return;
+
+  SpanRun   runs[4];    // top-left, top-right, bottom-left, bottom-right
+  OvalRows  rows( rx , ry );
+
+  // Emits [x0,x1] on row y, split by the arc sector if there is one.
+  auto span = [&]( SpanRun& run , int x0 , int x1 , int y ){
+    if( y + 1 < sink._top || y > sink._bottom ) return;
+    if( arc == nullptr ){
+      run.push( x0 , y , x1 - x0 + 1 , sink );
+      return;
+    }
+    const int py = 2*y - ( 2*cy + ey );
+    int start = -1;
+    for( int x = x0 ; x <= x1 + 1 ; ++x ){
+      const bool in = x <= x1 && arc->contains( 2*x - ( 2*cx + ex ) , py );
+      if( in && start < 0 ){
+        start = x;
+      } else if( !in && start >= 0 ){
+        run.push( start , y , x - start , sink );
+        start = -1;
+      }
+    }
+  };
+
+  // A filled shape starts with one rectangle over the middle rows that share the widest span.
+  int dy = 0;
+  if( fill ){
+    const int hw = rows.hw();
+    while( dy <= ry && rows.hw() == hw ){
+      rows.next();
+      ++dy;
+    }
+    sink.rect( cx - hw , cy - dy + 1 , 2*hw + ex + 1 , 2*dy - 1 + ey );
+  }
+
+  for( ; dy <= ry ; ++dy ){
+    const int hw = rows.hw();
+    rows.next();
+    const int yt = cy - dy;
+    const int yb = cy + ey + dy;
+    if( yt + 1 < sink._top && yb > sink._bottom ) break;
+
+    if( fill ){
+      span( runs[0] , cx - hw , cx + ex + hw , yt );
+      span( runs[2] , cx - hw , cx + ex + hw , yb );
+      continue;
+    }
+
+    // Outline: the pixels of this row not covered by the row one step further out.
+    const int in = ( dy < ry ) ? std::min( hw , rows.hw() + 1 ) : 0;
+    const bool bottom = dy > 0 || ey;
+    if( in == 0 ){
+      span( runs[0] , cx - hw , cx + ex + hw , yt );
+      if( bottom ) span( runs[2] , cx - hw , cx + ex + hw , yb );
+    } else {
+      span( runs[0] , cx - hw , cx - in , yt );
+      span( runs[1] , cx + ex + in , cx + ex + hw , yt );
+      if( bottom ){
+        span( runs[2] , cx - hw , cx - in , yb );
+        span( runs[3] , cx + ex + in , cx + ex + hw , yb );
+      }
+    }
+  }
+  for( SpanRun& run : runs ) run.flush( sink );
 }
 
 static bool _is_colliding(const Line& line, const Rect& rc) {
@@ -754,32 +1073,11 @@ void circ(fx8 x, fx8 y, fx8 r, Color col) {
     return;
   }
 
-  const Vec   center(x - _camera_cur.x, y - _camera_cur.y);
-  const Rect  rc( center.x - r, center.y - r, r * 2, r * 2 );
-  if( false == _is_colliding(rc,_clip_cur) )  return;
-
-  CameraStack cstk;
-  int segments;
-  u32 vangle;
-  _calc_segments_vangle( r , &segments, &vangle );
-
-  _camera_cur.set();
-  Line ln;
-  ln.pos0.set( center.x + r , center.y );
-  const Vec start( ln.pos0 );
-  u32 angle = vangle;
-
-  const Color color = (col == CURRENT) ? _color : col;
-  for (int ii = 0; ii < segments; ++ii, angle += vangle , ln.pos0 = ln.pos1 ) {
-    if( ii < segments-1 ){
-      ln.pos1.x = center.x + rad_cos_12(r, angle>>18);
-      ln.pos1.y = center.y + rad_sin_12(r, angle>>18);
-    } else {
-      ln.pos1 = start;
-    }
-    if( ! _is_colliding( ln , _clip_cur ) )  continue;
-    line(ln, color );
-  }
+  const int ir = static_cast< int >( r );
+  _oval_spans(
+    static_cast< int >( x - _camera_cur.x ), static_cast< int >( y - _camera_cur.y ),
+    ir, ir, 0, 0, false, SpanSink( col ), nullptr
+  );
 }
 
 void circfill(fx8 x, fx8 y, fx8 r , Color col ){
@@ -793,38 +1091,58 @@ void circfill(fx8 x, fx8 y, fx8 r , Color col ){
     return;
   }
 
-  const Vec   center(x - _camera_cur.x, y - _camera_cur.y);
-  const Rect  rc( center.x - r, center.y - r, r * 2, r * 2 );
-  if( false == _is_colliding(rc,_clip_cur) )  return;
+  const int ir = static_cast< int >( r );
+  _oval_spans(
+    static_cast< int >( x - _camera_cur.x ), static_cast< int >( y - _camera_cur.y ),
+    ir, ir, 0, 0, true, SpanSink( col ), nullptr
+  );
+}
+
+static  void  _oval( fx8 x0, fx8 y0, fx8 x1, fx8 y1, Color col, bool fill ){
+  int l = static_cast< int >( x0 - _camera_cur.x );
+  int r = static_cast< int >( x1 - _camera_cur.x );
+  int t = static_cast< int >( y0 - _camera_cur.y );
+  int b = static_cast< int >( y1 - _camera_cur.y );
+  if( l > r ) std::swap( l, r );
+  if( t > b ) std::swap( t, b );
 
-  CameraStack cstk;
-  int segments;
-  u32 vangle;
-  _calc_segments_vangle( r , &segments, &vangle );
+  const int w = r - l;
+  const int h = b - t;
+  _oval_spans( l + w/2, t + h/2, w/2, h/2, w & 1, h & 1, fill, SpanSink( col ), nullptr );
+}
 
-  _camera_cur.set();
-  Line ln;
-  ln.pos0.set( center.x + r , center.y );
-  const Vec start( ln.pos0 );
-  u32 angle = vangle;
-
-  col = (col == CURRENT) ? _color : col;
-  Poly pol;
-  for (int ii = 0; ii < segments; ++ii, angle += vangle , ln.pos0 = ln.pos1 ) {
-    if( ii < segments-1 ){
-      ln.pos1.x = center.x + rad_cos_12(r, angle>>18);
-      ln.pos1.y = center.y + rad_sin_12(r, angle>>18);
-    } else {
-      ln.pos1 = start;
-    }
+void oval(fx8 x0, fx8 y0, fx8 x1, fx8 y1, Color col) {
+  MUST(_during_draw, NOT_DURING_DRAWING);
+  _oval( x0, y0, x1, y1, col, false );
+}
 
-    pol.pos0 = ln.pos0;
-    pol.pos1 = ln.pos1;
-    pol.pos2 = center;
+void ovalfill(fx8 x0, fx8 y0, fx8 x1, fx8 y1, Color col) {
+  MUST(_during_draw, NOT_DURING_DRAWING);
+  _oval( x0, y0, x1, y1, col, true );
+}
 
-    if( !_is_colliding( pol , _clip_cur ) ) continue;
-    poly(pol,col);
+void arc(fx8 x, fx8 y, fx8 r, fx8 a0, fx8 a1, Color col) {
+  MUST(_during_draw, NOT_DURING_DRAWING);
+  if( r < 0 || a1 <= a0 ) return;
+
+  const fx8 sweep = a1 - a0;
+  if( sweep >= fx8::two_pi() ){
+    circ( x, y, r, col );
+    return;
   }
+
+  ArcSector sector;
+  sector._sx = pico8::cos( a0 ).raw_value();
+  sector._sy = pico8::sin( a0 ).raw_value();
+  sector._ex = pico8::cos( a1 ).raw_value();
+  sector._ey = pico8::sin( a1 ).raw_value();
+  sector._wide = sweep > fx8::pi();
+
+  const int ir = static_cast< int >( r );
+  _oval_spans(
+    static_cast< int >( x - _camera_cur.x ), static_cast< int >( y - _camera_cur.y ),
+    ir, ir, 0, 0, false, SpanSink( col ), &sector
+  );
 }
 
 static  void  get_scursor_info( SprCursor& dest ){
@@ -937,14 +1255,44 @@ void  mapsetup(BgTiles wtile, BgTiles htile, std::optional<BgTilesPtr> tiles , u
   cfg.ppu_htile = std::countr_zero( static_cast< uint32_t >( htile ) );
   cfg.uwrap = uwrap;
   cfg.vwrap = vwrap;
+  cfg.stream.reset();
   cfg.ready = true;
 }
 
+void  mapstream(BgTiles wtile, BgTiles htile, BgStreamFetch fetch, BgIndex index ){
+  MUST( index < BG_MAX, INVALID_PARAM );
+  MUST( wtile <= B8_PPU_MAX_WTILE && htile <= B8_PPU_MAX_HTILE, INVALID_PARAM );
+  MUST( wtile * 8 >= _reso_w + 8 && htile * 8 >= _reso_h + 8, INVALID_PARAM );
+
+  mapsetup( wtile, htile, std::nullopt, B8_PPU_BG_WRAP_REPEAT, B8_PPU_BG_WRAP_REPEAT, index );
+  BgConfig& cfg = _bg_config[ index ];
+  cfg.stream = std::make_shared< CBgStream >();
+  cfg.stream->Reset( cfg.tiles->data(), cfg.ppu_wtile, cfg.ppu_htile, _reso_w, _reso_h, std::move( fetch ) );
+}
+
+void  mapscroll(s32 wx, s32 wy, BgIndex index ){
+  MUST( _during_draw , NOT_DURING_DRAWING );
+  MUST( index < BG_MAX, INVALID_PARAM );
+  const BgConfig& cfg = _bg_config[ index ];
+  MUST( cfg.ready && cfg.stream , NOT_INITIALIZED );
+
+  cfg.stream->Scroll( wx, wy );
+  b8PpuPalCacheCommit( &_pal_cache );
+  cfg.stream->Draw( &_ppu_cmd, _otz );
+}
+
+void  mapinvalidate( BgIndex index ){
+  MUST( index < BG_MAX, INVALID_PARAM );
+  const BgConfig& cfg = _bg_config[ index ];
+  if( cfg.stream ) cfg.stream->Invalidate();
+}
+
 void  map(s16 upix,s16 vpix, BgIndex index ){
   MUST( _during_draw , NOT_DURING_DRAWING );
   const BgConfig& cfg = _bg_config[ index ];
   MUST( cfg.ready , NOT_INITIALIZED );
 
+  b8PpuPalCacheCommit( &_pal_cache );
   b8PpuBg* pp = b8PpuBgAllocZPB( &_ppu_cmd, _otz );
   pp->cpuaddr = cfg.tiles->data();
   pp->upix = upix;
@@ -1065,9 +1413,10 @@ s32 stat( int index ){
     case  33: return mousey();
     case  34: return mousestatus();
 
-    case 1000:{
-      return  _ppu_cmd.sp - _ppu_cmd.buff;
-    }break;
+    case 1000:  return b8PpuCmdUsedWords( &_ppu_cmd );
+    case 1001:  return _ppu_cmd_stat.high_water;
+    case 1002:  return _ppu_cmd_stat.dropped;
+    case 1003:  return PPU_CMD_BUFF_WORDS + _ppu_cmd.ovl_bytesize / sizeof(u32);
   }
   return 0;
 }
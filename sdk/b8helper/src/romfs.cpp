@@ -0,0 +1,174 @@
+#include <romfs.h>
+#include <b8/assert.h>
+#include <b8/errno.h>
+#include <sys/errno.h>
+#include <crt/crt.h>
+#include <stdio.h>
+#include <string.h>
+
+// relb8rom replaces the nop at __beep8_signature with the ROMFS offset.
+#define ADDR_SIGNATURE  (0x20)
+#define NOP_SIGNATURE   (0xe1a00000)
+#define ROM_SIZE        (0x00100000)
+
+// Layout written by genb8rom
+#define HEADER_SIZE     (16)
+#define ENTRY_SIZE      (48)
+#define NAME_SIZE       (40)
+
+struct FatEntry {
+  u32   offset;         // from the end of the FAT
+  u32   len;
+  char  name[ NAME_SIZE ];
+};
+static_assert( sizeof(FatEntry) == ENTRY_SIZE, "FatEntry must match genb8rom" );
+
+static  const FatEntry* _fat;
+static  const u8*       _data;
+static  u32             _num;
+
+static  const u8* _find_image(){
+  const u32 base = *(const volatile u32*)ADDR_SIGNATURE;
+  if( base == NOP_SIGNATURE ) return nullptr;   // not released by relb8rom
+  if( base & 3 ) return nullptr;
+  if( base < ADDR_SIGNATURE || base > ROM_SIZE - HEADER_SIZE ) return nullptr;
+
+  const u8* img = (const u8*)base;
+  if( memcmp( img, "BP8R", 4 ) != 0 ) return nullptr;
+  return  img;
+}
+
+static  bool  _parse( const u8* img ){
+  const u32 num       = img[4] | (img[5] << 8);
+  const u32 fat_start = img[6] | (img[7] << 8);
+  const u32 ent_size  = img[8];
+  if( ent_size != ENTRY_SIZE || (fat_start & 3) ) return false;
+
+  const u32 data_start = (u32)img + fat_start + num * ENTRY_SIZE;
+  if( data_start > ROM_SIZE ) return false;
+
+  const FatEntry* fat = (const FatEntry*)(img + fat_start);
+  for( u32 nn=0 ; nn<num ; ++nn ){
+    const FatEntry& fe = fat[ nn ];
+    if( fe.offset > ROM_SIZE - data_start || fe.len > ROM_SIZE - data_start - fe.offset ) return false;
+    if( fe.name[ NAME_SIZE-1 ] != 0 ) return false;
+  }
+
+  _fat  = fat;
+  _data = (const u8*)data_start;
+  _num  = num;
+  return  true;
+}
+
+static  const FatEntry* _lookup( const char* name ){
+  const size_t len_root = strlen( romfs::ROOT );
+  if( 0 == strncmp( name, romfs::ROOT, len_root ) ) name += len_root;
+  for( u32 nn=0 ; nn<_num ; ++nn ){
+    if( 0 == strncmp( _fat[ nn ].name, name, NAME_SIZE ) ) return &_fat[ nn ];
+  }
+  return  nullptr;
+}
+
+static  ssize_t romfs_read( File* filep, char *buffer, size_t buflen ){
+  const FatEntry* fe = (const FatEntry*)filep->d_priv;
+  const u32 pos = (u32)filep->offset;
+
+  if( pos >= fe->len ) return 0;
+  const size_t rest = fe->len - pos;
+  if( buflen > rest ) buflen = rest;
+  memcpy( buffer, _data + fe->offset + pos, buflen );
+  filep->offset += buflen;
+  return  buflen;
+}
+
+static  off_t   romfs_seek( File* filep, int ptr, int dir ){
+  const FatEntry* fe = (const FatEntry*)filep->d_priv;
+
+  s32 pos;
+  switch( dir ){
+    case SEEK_SET:  pos = ptr;                      break;
+    case SEEK_CUR:  pos = (s32)filep->offset + ptr; break;
+    case SEEK_END:  pos = (s32)fe->len + ptr;       break;
+    default:
+      set_errno( EINVAL );
+      return -1;
+  }
+  if( pos < 0 ){
+    set_errno( EINVAL );
+    return -1;
+  }
+  // Seeking past the end is allowed; reads there return 0.
+  filep->offset = pos;
+  return  pos;
+}
+
+static  int     romfs_ioctl( File* filep, unsigned int cmd, void* arg ){
+  const FatEntry* fe = (const FatEntry*)filep->d_priv;
+  switch( cmd ){
+    case romfs::MAP:{
+      romfs::Mapping* mm = (romfs::Mapping*)arg;
+      if( !mm ){
+        set_errno( EINVAL );
+        return -1;
+      }
+      mm->_ptr  = _data + fe->offset;
+      mm->_size = fe->len;
+    }break;
+    default:{
+      set_errno( ENOTTY );
+      return -1;
+    }
+  }
+  return  0;
+}
+
+static const file_operations romfs_fops =
+{
+  NULL,         /* open  */
+  NULL,         /* close */
+  romfs_read,   /* read  */
+  NULL,         /* write */
+  romfs_seek,   /* seek  */
+  romfs_ioctl   /* ioctl */
+};
+
+namespace romfs {
+
+u32   Reset(){
+  static bool _is_reset = false;
+  if( false == _is_reset ){
+    _is_reset = true;
+
+    const u8* img = _find_image();
+    if( !img || !_parse( img ) ) return 0;
+
+    char name[ N_MAX_PATH ];
+    for( u32 nn=0 ; nn<_num ; ++nn ){
+      const int len = snprintf( name, sizeof(name), "%s%s", ROOT, _fat[ nn ].name );
+      if( len < 0 || len >= N_MAX_PATH - 1 ) continue;    // Map() only
+      if( fs_register_driver( name, &romfs_fops, 0444, (void*)&_fat[ nn ] ) < 0 ){
+        break;    // driver table is full, the rest are Map() only
+      }
+    }
+  }
+  return  _num;
+}
+
+const u8* Map( const char* name, size_t* size ){
+  _ASSERT( name, "name is null" );
+  const FatEntry* fe = _lookup( name );
+  if( !fe ) return nullptr;
+  if( size ) *size = fe->len;
+  return  _data + fe->offset;
+}
+
+u32   Count(){
+  return  _num;
+}
+
+const char* Name( u32 idx ){
+  if( idx >= _num ) return nullptr;
+  return  _fat[ idx ].name;
+}
+
+}
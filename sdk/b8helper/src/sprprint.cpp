@@ -141,6 +141,7 @@ static ssize_t sprprint_write(File* filep,const char *buffer, size_t len) {
           dp->_ypix_locate > -8     &&
           dp->_ypix_locate < dp->yreso
         ){
+          if( dp->_ctx._pal ) b8PpuPalCacheCommit( dp->_ctx._pal );
           if( dp->_bg != B8_TRANSPARENT ){
             b8PpuRect* pr = b8PpuRectAllocZPB( 
               dp->_ctx._cmd,
@@ -171,7 +172,7 @@ static ssize_t sprprint_write(File* filep,const char *buffer, size_t len) {
         dp->_ypix_locate = eout._y;
       }break;
       case  ESO_SET_Z:{
-        dp->_otz = eout._otz;
+        dp->_otz = ((eout._otz + 1) << dp->_ctx._zshift) - 1;
       }break;
       case  ESO_SET_COLOR:{
         dp->_attr = eout._attr;
@@ -179,10 +180,17 @@ static ssize_t sprprint_write(File* filep,const char *buffer, size_t len) {
         if( dp->_fg == B8_TRANSPARENT ) dp->_fg = B8_WHITE;
         dp->_bg = ansiToB8PpuColor(static_cast<AnsiColor>(eout._bg));
 
-        b8PpuSetpal* pal = b8PpuSetpalAllocZPB(dp->_ctx._cmd, dp->_otz, 1);
-        pal->palsel = PALSEL;
-        pal->pidx7 = dp->_fg;
-        pal->pidx1 = dp->_shadow ? 1:0;
+        if( dp->_ctx._pal ){
+          u8 pidx[16] = { 0,1,2,3,4,5,6,7,8,9,10,11,12,13,14,15 };
+          pidx[7] = dp->_fg;
+          pidx[1] = dp->_shadow ? 1:0;
+          b8PpuPalCacheSet( dp->_ctx._pal, dp->_otz, PALSEL, 0xffff, pidx );
+        } else {
+          b8PpuSetpal* pal = b8PpuSetpalAllocZPB(dp->_ctx._cmd, dp->_otz, 1);
+          pal->palsel = PALSEL;
+          pal->pidx7 = dp->_fg;
+          pal->pidx1 = dp->_shadow ? 1:0;
+        }
       }break;
       case  ESO_UP:   dp->_ypix_locate -= dp->_hpix; break;
       case  ESO_DOWN: dp->_ypix_locate += dp->_hpix; break;
@@ -239,7 +247,7 @@ int sprprint_ioctl( File* filep, unsigned int cmd, void* arg) {
       info->_ypix_locate = dp->_ypix_locate;
       info->_fg = dp->_fg;
       info->_bg = dp->_bg;
-      info->_otz = dp->_otz;
+      info->_otz = dp->_otz >> dp->_ctx._zshift;
     }break;
     default:{
       set_errno(ENOTTY);  // 無効なIOCTLコマンド
@@ -0,0 +1,227 @@
+#include <vram.h>
+#include <b8/assert.h>
+#include <string.h>
+
+#define VRAM_TILES    (64)
+#define MAX_ENTRIES   (128)
+
+namespace vram {
+
+struct Entry {
+  const u8* img;      // nullptr when the slot is free
+  Region    rc;
+  u16       refcnt;
+  u16       gen;
+  u32       last_use;
+};
+
+static  u64     _used[ VRAM_TILES ];    // one bit per tile, allocated or reserved
+static  Entry   _entries[ MAX_ENTRIES ];
+static  u32     _tick;
+static  u32     _frame_tick;              // first tick of the current frame
+static  Stat    _stat;
+
+static  u64   _row_mask( const Region& rc ){
+  const u64 bits = (rc.wtile >= 64) ? ~0ull : ((1ull << rc.wtile) - 1);
+  return  bits << rc.xtile;
+}
+
+static  void  _mark( const Region& rc, bool used ){
+  const u64 mask = _row_mask( rc );
+  for( u32 yy=rc.ytile ; yy < (u32)rc.ytile + rc.htile ; ++yy ){
+    if( used )  _used[ yy ] |= mask;
+    else        _used[ yy ] &= ~mask;
+  }
+}
+
+static  bool  _overlaps( const Region& aa, const Region& bb ){
+  return  aa.xtile < bb.xtile + bb.wtile && bb.xtile < aa.xtile + aa.wtile &&
+          aa.ytile < bb.ytile + bb.htile && bb.ytile < aa.ytile + aa.htile;
+}
+
+// Bit x is set when columns x..x+wtile-1 are all clear in 'used'.
+static  u64   _runs( u64 used, u32 wtile ){
+  u64 run = ~used;
+  u32 len = 1;
+  for( ; len * 2 <= wtile ; len *= 2 ) run &= run >> len;
+  if( len < wtile ) run &= run >> (wtile - len);
+  return  run;
+}
+
+// First free spot from the bottom-right corner, with its top row in
+// [ylo,yhi] and its left column in [xlo,xhi].
+static  bool  _find( u32 wtile, u32 htile, int ylo, int yhi, int xlo, int xhi, Region* rc ){
+  if( ylo < 0 ) ylo = 0;
+  if( xlo < 0 ) xlo = 0;
+  if( yhi > VRAM_TILES - (int)htile ) yhi = VRAM_TILES - htile;
+  if( xhi > VRAM_TILES - (int)wtile ) xhi = VRAM_TILES - wtile;
+  if( ylo > yhi || xlo > xhi ) return false;
+  const u64 cols = (~0ull >> (63 - xhi)) & (~0ull << xlo);
+
+  for( int yy = yhi ; yy >= ylo ; --yy ){
+    u64 used = 0;
+    for( u32 hh=0 ; hh < htile ; ++hh ) used |= _used[ yy + hh ];
+    const u64 run = _runs( used, wtile ) & cols;
+    if( !run ) continue;
+    rc->xtile = 63 - __builtin_clzll( run );
+    rc->ytile = yy;
+    rc->wtile = wtile;
+    rc->htile = htile;
+    return  true;
+  }
+  return  false;
+}
+
+static  void  _evict( Entry& ent ){
+  _mark( ent.rc, false );
+  ent.img = nullptr;
+  ++ent.gen;
+  ++_stat.evictions;
+}
+
+// Images used in the current frame are drawn by commands that are already
+// recorded, so they stay even when released: a new upload to their space
+// would run before those commands.
+static  Entry*  _lru(){
+  Entry* found = nullptr;
+  for( Entry& ent : _entries ){
+    if( !ent.img || ent.refcnt ) continue;
+    if( (s32)(ent.last_use - _frame_tick) >= 0 ) continue;
+    if( !found || (s32)(ent.last_use - found->last_use) < 0 ) found = &ent;
+  }
+  return  found;
+}
+
+static  Handle  _handle( const Entry& ent ){
+  return  ((u32)ent.gen << 8) | (u32)(&ent - _entries + 1);
+}
+
+static  Entry*  _entry( Handle hdl ){
+  const u32 idx = (hdl & 0xff) - 1;
+  if( idx >= MAX_ENTRIES ) return nullptr;
+  Entry& ent = _entries[ idx ];
+  if( !ent.img || ent.gen != (u16)(hdl >> 8) ) return nullptr;
+  return  &ent;
+}
+
+void  Reset(){
+  memset( _used, 0, sizeof(_used) );
+  for( Entry& ent : _entries ){
+    const u16 gen = ent.gen;
+    ent = Entry{};
+    ent.gen = gen + 1;
+  }
+  _tick = 0;
+  _frame_tick = 0;
+  _stat = Stat{};
+}
+
+void  NewFrame(){
+  _frame_tick = _tick + 1;
+}
+
+bool  Reserve( const Region& rc ){
+  _ASSERT( rc.xtile + rc.wtile <= VRAM_TILES && rc.ytile + rc.htile <= VRAM_TILES, "invalid region" );
+  for( Entry& ent : _entries ){
+    if( ent.img && ent.refcnt && _overlaps( ent.rc, rc ) ) return false;
+  }
+  for( Entry& ent : _entries ){
+    if( ent.img && _overlaps( ent.rc, rc ) ) _evict( ent );
+  }
+  _mark( rc, true );
+  return  true;
+}
+
+Handle  Acquire( b8PpuCmd* cmd, u32 otz, const u8* img, u16 wpix, u16 hpix ){
+  _ASSERT( img, "img is null" );
+  _ASSERT( (wpix & 7) == 0 && (hpix & 7) == 0, "size must be a multiple of 8" );
+
+  for( Entry& ent : _entries ){
+    if( ent.img != img ) continue;
+    ++ent.refcnt;
+    ent.last_use = ++_tick;
+    return  _handle( ent );
+  }
+
+  const u32 wtile = wpix >> 3;
+  const u32 htile = hpix >> 3;
+  // LOADIMG sizes are 6-bit fields, so 64 tiles would wrap to 0.
+  if( 0 == wtile || 0 == htile || wtile >= VRAM_TILES || htile >= VRAM_TILES ) return INVALID;
+  // A full list would drop the upload, and the image would never reach VRAM.
+  if( cmd->dropped ) return INVALID;
+
+  Entry* slot = nullptr;
+  for( Entry& ent : _entries ){
+    if( !ent.img ){ slot = &ent; break; }
+  }
+  if( !slot ) slot = _lru();
+  if( !slot ) return INVALID;
+  if( slot->img ) _evict( *slot );
+
+  // Once the full search fails, a spot can only open up over the region just
+  // evicted, so only placements overlapping it are tried again.
+  Region rc;
+  bool found = _find( wtile, htile, 0, VRAM_TILES, 0, VRAM_TILES, &rc );
+  while( !found ){
+    Entry* victim = _lru();
+    if( !victim ) return INVALID;
+    const Region freed = victim->rc;
+    _evict( *victim );
+    found = _find( wtile, htile,
+                   freed.ytile - (int)htile + 1, freed.ytile + freed.htile - 1,
+                   freed.xtile - (int)wtile + 1, freed.xtile + freed.wtile - 1, &rc );
+  }
+
+  // Pushed to the front: the LOADIMG runs first, then the FLUSH.
+  const u32 dropped = cmd->dropped;
+  b8PpuFlush* pf = b8PpuFlushAllocZ( cmd, otz );
+  b8PpuLoadimg* pp = b8PpuLoadimgAllocZ( cmd, otz );
+  if( cmd->dropped != dropped ) return INVALID;   // the slot stays free
+
+  slot->img = img;
+  slot->rc = rc;
+  slot->refcnt = 1;
+  slot->last_use = ++_tick;
+  _mark( rc, true );
+  ++_stat.uploads;
+
+  pf->img = 1;
+  pp->cpuaddr = img;
+  pp->srcxtile = 0;
+  pp->srcytile = 0;
+  pp->srcwtile = wtile;
+  pp->dstxtile = rc.xtile;
+  pp->dstytile = rc.ytile;
+  pp->trnwtile = wtile;
+  pp->trnhtile = htile;
+
+  return  _handle( *slot );
+}
+
+void  Release( Handle hdl ){
+  Entry* ent = _entry( hdl );
+  if( ent && ent->refcnt ) --ent->refcnt;
+}
+
+bool  Get( Handle hdl, Region* rc ){
+  Entry* ent = _entry( hdl );
+  if( !ent ) return false;
+  ent->last_use = ++_tick;
+  *rc = ent->rc;
+  return  true;
+}
+
+void  GetStat( Stat* st ){
+  Stat result = _stat;
+  for( u32 yy=0 ; yy < VRAM_TILES ; ++yy ){
+    result.free_tiles += VRAM_TILES - __builtin_popcountll( _used[ yy ] );
+  }
+  for( const Entry& ent : _entries ){
+    if( !ent.img ) continue;
+    ++result.resident;
+    if( ent.refcnt ) ++result.referenced;
+  }
+  *st = result;
+}
+
+}
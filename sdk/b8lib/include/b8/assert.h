@@ -24,6 +24,7 @@
 #define _ASSERT(expr_, comment_) \
   do { \
     if (!(expr_)) { \
+      b8ConPanic(); \
       b8SysPuts("\n=== Assertion failed === "); \
       b8SysPuts(__FILE__); \
       b8SysPuts("("); \
@@ -61,6 +62,7 @@
  */
 #define _NOTIMPL() \
   do { \
+    b8ConPanic(); \
     printf( "Assertion NOTIMPL %s(%d) %s()\n",__FILE__,__LINE__, __func__ ); \
     asm("hlt"); \
   } while(0)
@@ -0,0 +1,100 @@
+/**
+ * @file con.h
+ * @brief Buffered console output on SCI channel 0.
+ *
+ * stdout, stderr and b8SysPuts() write into a ring buffer instead of the SCI
+ * FIFO. A low-priority thread copies the buffer to the FIFO whenever no other
+ * thread needs the CPU, so a log line from the frame loop costs a memcpy.
+ *
+ * When the buffer is full, the policy decides:
+ * - `B8_CON_BLOCK` (default): the writer copies the buffer to the FIFO itself,
+ *   instead of waiting for the drain thread. Nothing is lost.
+ * - `B8_CON_DROP`: the write is discarded and counted. A line reporting how many
+ *   bytes were dropped is printed once there is room again.
+ *
+ * Output from the kernel, from exception handlers, or before b8ConReset() is
+ * written straight to the FIFO, after whatever is still buffered.
+ *
+ * Functions provided:
+ * - `b8ConReset`: Start the drain thread
+ * - `b8ConWrite`: Queue bytes for output
+ * - `b8ConFlush`: Wait until everything queued has reached the FIFO
+ * - `b8ConPanic`: Write out the buffer and stop buffering, before halting
+ * - `b8ConSetPolicy`: Choose what happens when the buffer is full
+ * - `b8ConGetDropped`: Count the bytes dropped so far
+ *
+ * Example usage (logging from the frame loop must never wait):
+ * @code
+ * b8ConSetPolicy( B8_CON_DROP );
+ * while( 1 ){
+ *   printf( "frame %d\n", frame++ );
+ *   ...
+ * }
+ * @endcode
+ */
+#pragma once
+
+#ifdef  __cplusplus
+extern  "C" {
+#endif
+
+#include <b8/type.h>
+#include <stddef.h>
+
+#define B8_CON_RING_SIZE  (4096)    // bytes, a power of 2
+
+#define B8_CON_BLOCK      (0)
+#define B8_CON_DROP       (1)
+
+/**
+ * @brief Start the drain thread.
+ *
+ * This is a system function called from crt0.c.
+ *
+ * @return 0 on success; an error code on failure. Output stays unbuffered on failure.
+ */
+extern int b8ConReset(void);
+
+/**
+ * @brief Queue bytes for output.
+ *
+ * @param buf Bytes to write.
+ * @param len Number of bytes.
+ * @return Number of bytes accepted. Under `B8_CON_DROP` this is 0 when the whole
+ *         write did not fit, so a line is never cut in half.
+ */
+extern size_t b8ConWrite(const char* buf, size_t len);
+
+/**
+ * @brief Wait until everything queued has been written to the SCI FIFO.
+ *
+ * Outside a thread, for instance in an exception handler, the buffer is
+ * written out by the caller instead.
+ */
+extern void b8ConFlush(void);
+
+/**
+ * @brief Write out the buffer and send all later output straight to the FIFO.
+ *
+ * For fatal paths that halt afterwards, such as _ASSERT(). Takes no lock and
+ * never waits, so it is safe while another thread, or the caller, is in the
+ * middle of a write.
+ */
+extern void b8ConPanic(void);
+
+/**
+ * @brief Choose what happens when the buffer is full.
+ *
+ * @param policy `B8_CON_BLOCK` or `B8_CON_DROP`.
+ * @return The previous policy, or an error code if `policy` is invalid.
+ */
+extern int b8ConSetPolicy(int policy);
+
+/**
+ * @brief Count the bytes dropped under `B8_CON_DROP` since boot.
+ */
+extern u32 b8ConGetDropped(void);
+
+#ifdef  __cplusplus
+}
+#endif
@@ -0,0 +1,107 @@
+/**
+ * @file heap.h
+ * @brief Heap usage, fragmentation and leak diagnostics.
+ *
+ * The heap grows from the end of .bss toward __stack_top. This module reports
+ * how much of it is free, and how large the largest free block is, which is
+ * what decides whether a big allocation can still succeed.
+ *
+ * Tracking is optional. Once b8HeapTrackEnable() is called, every allocation
+ * made through malloc(), operator new or newlib is recorded with its size and
+ * call site, which gives the current and peak bytes, the allocations per frame,
+ * and the sites that hold the most memory. Allocations made before tracking
+ * started are not counted, even when they are freed later.
+ *
+ * Functions provided:
+ * - `b8HeapTrackEnable`: Start or stop recording allocations
+ * - `b8HeapFrame`: Mark the end of a frame
+ * - `b8HeapGetStat`: Read the counters
+ * - `b8HeapDump`: Print the counters and the largest call sites to the console
+ *
+ * Example usage (finding what a level leaves behind):
+ * @code
+ * b8HeapTrackEnable( 2048 );
+ * load_level( 1 );
+ * unload_level();
+ * b8HeapDump( 16 );    // sites still holding memory
+ * @endcode
+ *
+ * Call sites are return addresses; look them up in the .map or .lst file.
+ */
+#pragma once
+
+#ifdef  __cplusplus
+extern  "C" {
+#endif
+
+#include <b8/type.h>
+#include <stddef.h>
+
+/**
+ * @brief Heap counters.
+ *
+ * The `track_` fields stay 0 while tracking is off.
+ */
+typedef struct {
+  u32 free_bytes;         ///< Free chunks, the top chunk and the room left before __stack_top.
+  u32 largest_free;       ///< Largest block malloc() can return without failing.
+  u32 heap_bytes;         ///< Bytes between the start of the heap and its current end.
+
+  u32 track_cur_bytes;    ///< Bytes requested by live tracked allocations.
+  u32 track_peak_bytes;   ///< Highest track_cur_bytes since tracking started.
+  u32 track_live;         ///< Live tracked allocations.
+  u32 track_allocs;       ///< Allocations since tracking started.
+  u32 track_frame_allocs; ///< Allocations during the last complete frame.
+  u32 track_max_frame_allocs; ///< Most allocations seen in one frame.
+  u32 track_dropped;      ///< Allocations not recorded because the table was full.
+} b8HeapStat;
+
+/**
+ * @brief Start or stop recording allocations.
+ *
+ * The record table is taken from the heap and is not counted.
+ *
+ * @param max_allocs Live allocations the table can hold, 0 to stop tracking.
+ * @return 0 on success; an error code if the table cannot be allocated.
+ */
+extern int b8HeapTrackEnable(u32 max_allocs);
+
+/**
+ * @brief Mark the end of a frame, for the per-frame allocation count.
+ *
+ * pico8::Pico8 calls it once per frame.
+ */
+extern void b8HeapFrame(void);
+
+/**
+ * @brief Read the counters.
+ *
+ * Walks the heap to find the free blocks, so it is not free of cost.
+ *
+ * @param st Receives the counters.
+ */
+extern void b8HeapGetStat(b8HeapStat* st);
+
+/**
+ * @brief Print the counters, and the call sites holding the most bytes, to SCI.
+ *
+ * Lines start with "B8HEAP".
+ *
+ * @param max_sites Number of call sites to print.
+ */
+extern void b8HeapDump(u32 max_sites);
+
+/**
+ * @brief Attribute a live allocation to a call site.
+ *
+ * For allocation wrappers, such as operator new, so the allocation is
+ * reported where the wrapper was called. Does nothing while tracking is off.
+ *
+ * @param ptr Block returned by the allocator.
+ * @param site Return address of the wrapper.
+ */
+extern void b8HeapSetSite(const void* ptr, const void* site);
+
+#ifdef  __cplusplus
+}
+#endif
@@ -35,6 +35,14 @@ typedef u64 b8OsCpuCycles;
 #define B8_OS_SCHED_IRQ                 4  // Irq handler scheduling policy
 #define B8_OS_SCHED_OTHER               5  // Not supported
 
+// thread priorities (a larger value is a higher priority)
+#define B8_OS_PRIORITY_NUM              32
+#define B8_OS_PRIORITY_IDLE             0   // reserved for the idle thread
+#define B8_OS_PRIORITY_MIN              1
+#define B8_OS_PRIORITY_DEFAULT          16
+#define B8_OS_PRIORITY_IRQ              30  // default of B8_OS_SCHED_IRQ threads
+#define B8_OS_PRIORITY_MAX              31
+
 #define B8_OS_NOT_USING_IRQ (0xffff)
 
 #define B8_OS_SEM_WAIT       (0)
@@ -43,11 +51,34 @@ typedef u64 b8OsCpuCycles;
 
 #define B8_OS_CLOCKID_REALTIME              (0x10)
 #define B8_OS_CLOCKID_MONOTONIC             (0x11)
-#define B8_OS_CLOCKID_PROCESS_CPUTIME_ID    (0x12)  // Not supported
-#define B8_OS_CLOCKID_THREAD_CPUTIME_ID     (0x13)  // Not supported
+#define B8_OS_CLOCKID_PROCESS_CPUTIME_ID    (0x12)  // CPU time of every thread but the idle thread
+#define B8_OS_CLOCKID_THREAD_CPUTIME_ID     (0x13)  // CPU time of the calling thread
 
 // Maximum value the semaphore can have.
 #define SEM_VALUE_MAX (32767)
+
+// Lock word of a pthread mutex, shared between user mode and the kernel.
+#define B8_OS_MUTEX_UNLOCKED   (0)
+#define B8_OS_MUTEX_LOCKED     (1)
+#define B8_OS_MUTEX_CONTENDED  (2)   // locked, and some thread may be sleeping on it
+typedef struct _b8OsMutex {
+  volatile u32      state;  // B8_OS_MUTEX_*
+  volatile b8OsPid  owner;  // holder; meaningless while state is B8_OS_MUTEX_UNLOCKED
+} b8OsMutex;
+
+// Condition variable word, shared between user mode and the kernel.
+typedef struct _b8OsCond {
+  volatile u32      seq;      // bumped by every signal
+  volatile u32      waiters;  // threads sleeping in the kernel, kept by the kernel
+} b8OsCond;
+
+// Pid of the running thread, kept up to date by the kernel on every switch.
+extern  volatile b8OsPid b8OsCurrentPid;
+/*
+  NULL, GET_BRIDGE and GET_ERRNO only return the caller's bridge. The SVC
+  handler answers them without saving the context; their values are
+  repeated in bootloader.S.
+*/
 typedef enum {
   B8_OS_SYSCALL_NULL = 0,
 
@@ -74,7 +105,9 @@ typedef enum {
       [2] = size_t  StackSize
       [3] = void*   StartRoutine
       [4] = void*   Arg
-      [5] = u32     SchedulingPolicy B8_OS_SCHED_*
+      [5] = u32     SchedulingPolicy B8_OS_SCHED_* | (Priority << 8) | (Detached << 16)
+                    Priority 0 selects the default of the policy.
+                    Detached 1 reaps the thread as soon as it exits.
       [6] = u32     IrqNo
 
     out:
@@ -85,6 +118,7 @@ typedef enum {
   /*
     in:
       [0] = B8_OS_SYSCALL_EXIT
+      [1] = void*   value passed to pthread_join()
   */
   B8_OS_SYSCALL_EXIT,
 
@@ -158,6 +192,130 @@ typedef enum {
   */
   B8_OS_SYSCALL_CLOCK_SETTIME,
 
+  /*
+    in:
+      [0] = B8_OS_SYSCALL_SCHED_SETPARAM
+      [1] = b8OsPid pid
+      [2] = u32     SchedulingPolicy B8_OS_SCHED_*
+      [3] = u32     Priority B8_OS_PRIORITY_MIN .. B8_OS_PRIORITY_MAX
+  */
+  B8_OS_SYSCALL_SCHED_SETPARAM,
+
+  /*
+    in:
+      [0] = B8_OS_SYSCALL_SCHED_GETPARAM
+      [1] = b8OsPid pid
+
+    out:
+      b8OsBridgeUsr2Svc::ret_policy
+      b8OsBridgeUsr2Svc::ret_priority
+  */
+  B8_OS_SYSCALL_SCHED_GETPARAM,
+
+  /*
+    Sleeps until B8_OS_SYSCALL_MUTEX_WAKE if the lock word is still
+    B8_OS_MUTEX_CONTENDED. The owner inherits the caller's priority.
+
+    in:
+      [0] = B8_OS_SYSCALL_MUTEX_WAIT
+      [1] = b8OsMutex* mutex
+  */
+  B8_OS_SYSCALL_MUTEX_WAIT,
+
+  /*
+    Wakes the highest priority thread sleeping on the mutex and drops the
+    priority inherited through it.
+
+    in:
+      [0] = B8_OS_SYSCALL_MUTEX_WAKE
+      [1] = b8OsMutex* mutex
+  */
+  B8_OS_SYSCALL_MUTEX_WAKE,
+
+  /*
+    Waits for the thread to exit and releases its TCB and stack.
+
+    in:
+      [0] = B8_OS_SYSCALL_THREAD_JOIN
+      [1] = b8OsPid pid
+    out:
+      b8OsBridgeUsr2Svc::ret_value
+  */
+  B8_OS_SYSCALL_THREAD_JOIN,
+
+  /*
+    Lets the kernel release the thread when it exits, or at once if it
+    already has.
+
+    in:
+      [0] = B8_OS_SYSCALL_THREAD_DETACH
+      [1] = b8OsPid pid
+  */
+  B8_OS_SYSCALL_THREAD_DETACH,
+
+  /*
+    Sleeps until B8_OS_SYSCALL_COND_SIGNAL if the sequence word still
+    holds the value the caller read before releasing its mutex.
+    Returns at once otherwise.
+
+    in:
+      [0] = B8_OS_SYSCALL_COND_WAIT
+      [1] = b8OsCond* cond
+      [2] = u32     seq
+      [3] = u32     timed
+      [4] = u32     tv_sec    CLOCK_REALTIME deadline when timed
+      [5] = u32     tv_nsec
+  */
+  B8_OS_SYSCALL_COND_WAIT,
+
+  /*
+    Wakes the highest priority thread sleeping on the condition, or all
+    of them.
+
+    in:
+      [0] = B8_OS_SYSCALL_COND_SIGNAL
+      [1] = b8OsCond* cond
+      [2] = u32     broadcast
+  */
+  B8_OS_SYSCALL_COND_SIGNAL,
+
+  /*
+    Stack usage of a thread, or of the whole stack pool.
+
+    in:
+      [0] = B8_OS_SYSCALL_STACK_INFO
+      [1] = b8OsPid pid   B8_OS_INVALID_PID selects the pool
+    out:
+      b8OsBridgeUsr2Svc::ret_stack_size   block size, or pool size
+      b8OsBridgeUsr2Svc::ret_stack_used   high-water mark, or peak bytes
+                                          held by all stacks
+  */
+  B8_OS_SYSCALL_STACK_INFO,
+
+  /*
+    Copies the state and CPU time of every live thread.
+
+    in:
+      [0] = B8_OS_SYSCALL_THREAD_STAT
+      [1] = b8OsThreadStat* stat
+      [2] = u32     max entries
+    out:
+      b8OsBridgeUsr2Svc::ret_count    number of entries written
+      b8OsBridgeUsr2Svc::ret_cycles   CPU cycles since boot
+  */
+  B8_OS_SYSCALL_THREAD_STAT,
+
+  /*
+    Makes the kernel post a semaphore every time the irq fires, from the
+    interrupt itself. The irq can't be used by a SCHED_IRQ thread anymore.
+
+    in:
+      [0] = B8_OS_SYSCALL_IRQ_SEM_BIND
+      [1] = u32       irq
+      [2] = b8OsSid   SemaphoreID
+  */
+  B8_OS_SYSCALL_IRQ_SEM_BIND,
+
   /* --- */
   B8_OS_SYSCALL_MAX,
 } b8OsSysCallNum;
@@ -204,12 +362,158 @@ typedef struct _b8OsBridgeUsr2Svc{
   u64       tv_sec;
   u32       tv_nsec;
   s32       errcode;
+  int       ret_policy;
+  int       ret_priority;
+  void*     ret_value;
+  size_t    ret_stack_size;
+  size_t    ret_stack_used;
+  int       ret_count;
+  u64       ret_cycles;
 } b8OsBridgeUsr2Svc;
+
+// Bridge of the running thread, kept up to date by the kernel on every switch.
+extern  b8OsBridgeUsr2Svc* volatile b8OsCurrentBridge;
 extern  b8OsBridgeUsr2Svc* b8OsGetBridge(void);
 
+/**
+ * @brief Reads a clock without entering the kernel.
+ *
+ * Same result as B8_OS_SYSCALL_CLOCK_GETTIME. The read is retried when a
+ * thread switch happens in the middle of it.
+ *
+ * @param clkid   B8_OS_CLOCKID_*
+ * @param tv_sec  Receives the seconds.
+ * @param tv_nsec Receives the nanoseconds.
+ * @return 0 on success, -EINVAL for an unknown clock, -EAGAIN before
+ *         b8OsReset() has run.
+ */
+extern  int  b8OsClockGetTime( u32 clkid , u64* tv_sec , u32* tv_nsec );
+
+/**
+ * @brief Reports how much of a thread's stack has ever been used.
+ *
+ * Stacks allocated by the kernel are painted when the thread is created, so the
+ * high-water mark is exact. Use it to size pthread_attr_setstacksize() tightly.
+ * A thread that runs over the bottom of its stack halts the system with
+ * "stack overflow" at the next thread switch.
+ *
+ * @param pid  Thread to query, or B8_OS_INVALID_PID for the whole stack pool.
+ * @param size Receives the stack size (rounded up to its size class), or the pool size.
+ * @param used Receives the high-water mark, or the peak bytes held by all stacks.
+ * @return B8_OS_OK on success, -ESRCH for an unknown thread, or -EINVAL for a
+ *         thread running on a stack given with pthread_attr_setstack().
+ */
+extern  int  b8OsGetStackInfo( b8OsPid pid , size_t* size , size_t* used );
+
+#define B8_OS_THREAD_RUNNING  ('R')   // running or ready to run
+#define B8_OS_THREAD_SLEEPING ('S')   // blocked on a timer, semaphore, mutex, condition, irq or join
+#define B8_OS_THREAD_ZOMBIE   ('Z')   // exited, not joined yet
+
+typedef struct _b8OsThreadStat {
+  b8OsPid   pid;
+  u8        state;        // B8_OS_THREAD_*
+  u8        policy;       // B8_OS_SCHED_*
+  u8        priority;     // current priority, including inheritance
+  u8        is_idle;      // the kernel's idle thread
+  u64       cpu_cycles;   // CPU cycles spent in the thread, kernel time of its syscalls included
+} b8OsThreadStat;
+
+/**
+ * @brief Takes a snapshot of every live thread.
+ *
+ * CPU time is counted in DWT cycles at each thread switch. The share of a thread over an
+ * interval is the difference of cpu_cycles between two snapshots divided by the difference
+ * of *total_cycles.
+ *
+ * @param stat Array receiving one entry per thread.
+ * @param max Number of entries in stat.
+ * @param total_cycles Receives the CPU cycles since boot, or NULL.
+ * @return The number of entries written, or a negative error code.
+ */
+extern  int  b8OsGetThreadStat( b8OsThreadStat* stat , int max , u64* total_cycles );
+
+/**
+ * @brief Prints a top-like table of the threads to the debug console.
+ *
+ * The CPU share of each thread is measured since the previous call (since boot on the
+ * first call). Call it once per second or so from any thread to find out which one
+ * eats the frame budget.
+ */
+extern  void b8OsTop(void);
+
+// b8OsTraceEvent::type
+#define B8_OS_TRACE_SWITCH    (1)   // pid starts running
+#define B8_OS_TRACE_SYSCALL   (2)   // pid entered the kernel, arg = B8_OS_SYSCALL_*
+#define B8_OS_TRACE_IRQ       (3)   // pid was interrupted, arg = irq number
+#define B8_OS_TRACE_RETURN    (4)   // the kernel returns to pid
+#define B8_OS_TRACE_BLOCK     (5)   // pid blocks, arg = B8_OS_TRACE_WAIT_*
+#define B8_OS_TRACE_WAKE      (6)   // pid is woken, arg = B8_OS_TRACE_WAIT_*
+
+// What a thread blocks on: b8OsTraceEvent::arg of BLOCK and WAKE.
+#define B8_OS_TRACE_WAIT_SEMAPHORE  (1)
+#define B8_OS_TRACE_WAIT_TIMER      (2)
+#define B8_OS_TRACE_WAIT_IRQ        (3)
+#define B8_OS_TRACE_WAIT_MUTEX      (4)
+#define B8_OS_TRACE_WAIT_JOIN       (5)
+#define B8_OS_TRACE_WAIT_COND       (6)
+
+typedef struct _b8OsTraceEvent {
+  u32       cycle;    // low 32 bits of the CPU cycles since boot
+  b8OsPid   pid;
+  u16       arg;
+  u8        type;     // B8_OS_TRACE_*
+  u8        reserved;
+} b8OsTraceEvent;
+
+/**
+ * @brief Starts or stops recording kernel events into the trace ring.
+ *
+ * The ring holds the most recent events; older ones are overwritten. Recording is off
+ * after reset.
+ *
+ * @param enable Non-zero to record.
+ */
+extern  void b8OsTraceEnable( int enable );
+
+/**
+ * @brief Copies the events recorded after *seq, without stopping the kernel.
+ *
+ * Start with *seq = 0. Events the kernel overwrote before they could be copied are
+ * skipped, which shows up as a jump in *seq larger than the return value.
+ *
+ * @param ev Array receiving the events, oldest first.
+ * @param max Number of entries in ev.
+ * @param seq In: sequence number of the next event wanted. Out: the one after the last copied.
+ * @return The number of events copied.
+ */
+extern  int  b8OsTraceRead( b8OsTraceEvent* ev , int max , u32* seq );
+
+/**
+ * @brief Prints the trace ring to the debug console.
+ *
+ * The output is meant for tool/b8trace, which turns it into Chrome trace JSON
+ * (chrome://tracing, Perfetto). Stop recording first to get a consistent picture.
+ */
+extern  void b8OsTraceDump(void);
+
 typedef struct _sem_t sem_t;
 
 extern b8OsBridgeUsr2Svc* b8OsSysCall( b8OsSysCallNum syscall,u32 arg0,u32 arg1,u32 arg2,u32 arg3,u32 arg4,u32 arg5);
+
+/**
+ * @brief Swaps the state of a mutex lock word and publishes its owner in the same step.
+ *
+ * Stores `state` and returns the previous state. If the previous state was
+ * B8_OS_MUTEX_UNLOCKED, `owner` is set to `self` as part of the same atomic
+ * step, so the kernel always finds the holder of a locked mutex. The kernel
+ * restarts the sequence when an IRQ interrupts it, since ARMv4 has no ldrex/strex.
+ *
+ * @param mutex Lock word.
+ * @param state B8_OS_MUTEX_LOCKED or B8_OS_MUTEX_CONTENDED.
+ * @param self  Pid of the calling thread.
+ * @return The previous state.
+ */
+extern u32 b8OsMutexSwap( b8OsMutex* mutex , u32 state , b8OsPid self );
 typedef struct _b8OsConfig{
   void*         StackTop;
   size_t        StackSize;
@@ -220,8 +524,6 @@ typedef struct _b8OsConfig{
   // 1000Hz: 1ms =  1*1000us =  1000
   u32           UsecPerTick;
 
-  sem_t*        sem_heap;
-
   // driver
   int   (*ArchDriverGetTimerIrq)(u16* irq);
   int   (*ArchDriverOnStartTimer)(u32 hz);
@@ -230,6 +532,10 @@ typedef struct _b8OsConfig{
   void  (*ArchDriverGetCycleAndClear)(u32* cyccnt );
   void  (*ArchDriverPicDistributor)(u8 enable );
   void  (*ArchDriverGetClockTime)( u64* clock );
+
+  // optional: arms the OS timer to fire once after usec.
+  // When provided, the kernel runs tickless instead of calling ArchDriverOnStartTimer().
+  int   (*ArchDriverSetTimerOneShot)(u32 usec);
 } b8OsConfig;
 extern  int  b8OsReset( b8OsConfig* cfg_ );
 extern  int  b8OsIsRunning(void);
@@ -116,6 +116,11 @@ enum b8PpuColor {
  * @brief Structure representing a PPU command buffer for the BEEP-8 system.
  * 
  * This structure holds information about the command buffer that the PPU uses for drawing operations.
+ *
+ * Allocation never writes past the end of the buffer. When the buffer is full, the list
+ * continues in the overflow segment set by b8PpuCmdSetOverflow(), joined with a JMP.
+ * When that is full too, or there is none, new commands are dropped: the allocators
+ * return a scratch area that is never linked into the list, and `dropped` counts them.
  */
 typedef struct _b8PpuCmd {
   u32*  buff;     /**< Pointer to the buffer storing the PPU commands. */
@@ -127,6 +132,13 @@ typedef struct _b8PpuCmd {
   u32*  ot_prev;
   u32   otnum;    /**< Number of objects in the object table. */
   u32*  addr_halt;
+  u32*  ot_used;  /**< Bitmap of the OT entries used this frame, or NULL. See b8PpuClearOTSparse(). */
+
+  u32*  seg;          /**< Start of the segment being filled. */
+  u32*  ovl_buff;     /**< Overflow segment not entered yet, or NULL. */
+  u32   ovl_bytesize; /**< Size of the overflow segment in bytes. */
+  u32   words_prev;   /**< Words used in the segments already filled. */
+  u32   dropped;      /**< Commands dropped since b8PpuCmdSetBuff() because every segment was full. */
 } b8PpuCmd;
 
 /**
@@ -147,6 +159,39 @@ typedef struct _b8PpuCmd {
  */
 extern void b8PpuCmdSetBuff(b8PpuCmd* cmd_, u32* buff_, u32 bytesize_);
 
+/**
+ * @brief Sets the segment the command list continues in once its buffer is full.
+ *
+ * Call it after b8PpuCmdSetBuff(), which clears it. The segment is joined with a JMP
+ * between two commands, so it works for lists with and without an Ordering Table.
+ * It must stay valid until the PPU is done with the list.
+ *
+ * @param cmd_ Pointer to the `b8PpuCmd` structure.
+ * @param buff_ Overflow buffer, or NULL for none.
+ * @param bytesize_ Size of the overflow buffer in bytes.
+ */
+extern void b8PpuCmdSetOverflow(b8PpuCmd* cmd_, u32* buff_, u32 bytesize_);
+
+/**
+ * @brief Returns the number of words used so far, over every segment.
+ *
+ * @param cmd_ Pointer to the `b8PpuCmd` structure.
+ * @return Words used, including the jump into the overflow segment.
+ */
+extern u32 b8PpuCmdUsedWords(const b8PpuCmd* cmd_);
+
+/**
+ * @brief Allocates contiguous words in the PPU command buffer.
+ *
+ * Use it to build a command of several words; consecutive b8PpuCmdPush() calls
+ * may be split by the jump into the overflow segment.
+ *
+ * @param cmd_ Pointer to the `b8PpuCmd` structure.
+ * @param words_ Number of words, at most 16.
+ * @return Pointer to the words. When the list is full, a scratch area that is never executed.
+ */
+extern u32* b8PpuCmdAlloc(b8PpuCmd* cmd_, u32 words_);
+
 /**
  * @brief Pushes a command word onto the PPU command buffer.
  * 
@@ -350,6 +395,64 @@ extern b8PpuSetpal* b8PpuSetpalAllocZ(b8PpuCmd* cmd_, u32 otz, u8 flush);
  */
 extern b8PpuSetpal* b8PpuSetpalAllocZPB(b8PpuCmd* cmd_, u32 otz, u8 flush);
 
+/**
+ * @brief Palette state tracked on the CPU side of a command list.
+ *
+ * Palette writes made through b8PpuPalCacheSet() are held back until
+ * b8PpuPalCacheCommit(), which emits one SETPAL per modified palette and a single
+ * FLUSH for all of them. A write is dropped when the entry already holds that value
+ * in the same Z-value, so a color set again and again costs nothing.
+ *
+ * Call b8PpuPalCacheCommit() before allocating any primitive that may use the
+ * palettes, and once more before the command list ends. Pending writes are pushed
+ * back at the Z-value they were made at, so the result is the same as calling
+ * b8PpuSetpalAllocZPB() with `flush` set for each write.
+ *
+ * Every palette write to the command list must go through the same cache,
+ * otherwise the values it remembers no longer match the PPU.
+ */
+typedef struct _b8PpuPalCache {
+  b8PpuCmd* cmd;          /**< Command list the palette commands go to. */
+  u32   otz;              /**< Z-value of the pending writes. */
+  u16   pending;          /**< Palettes with pending writes, one bit per palsel. */
+  u16   wmask[16];        /**< Pending entries of each palette. */
+  u16   known[16];        /**< Entries whose value in zknown is held in pidx. */
+  u32   zknown[16];       /**< Z-value the known entries were written at. */
+  u8    pidx[16][16];     /**< Pending or known value of each entry. */
+} b8PpuPalCache;
+
+/**
+ * @brief Starts tracking the palettes of a command list.
+ *
+ * Call it whenever the command list is reset; nothing is known about the palettes afterwards.
+ *
+ * @param pc_ Pointer to the palette cache.
+ * @param cmd_ Pointer to the PPU command list.
+ */
+extern void b8PpuPalCacheReset(b8PpuPalCache* pc_, b8PpuCmd* cmd_);
+
+/**
+ * @brief Records palette writes without emitting any command.
+ *
+ * Pending writes made at another Z-value are committed first.
+ *
+ * @param pc_ Pointer to the palette cache.
+ * @param otz_ Z-value the palette change belongs to.
+ * @param palsel Palette selection index (0-15).
+ * @param wmask Entries to write, one bit per entry.
+ * @param pidx 16 entry values; only the ones selected by `wmask` are read.
+ */
+extern void b8PpuPalCacheSet(b8PpuPalCache* pc_, u32 otz_, u32 palsel, u16 wmask, const u8* pidx);
+
+/**
+ * @brief Emits the pending palette writes, followed by one FLUSH.
+ *
+ * Does nothing when no write is pending.
+ *
+ * @param pc_ Pointer to the palette cache.
+ */
+extern void b8PpuPalCacheCommit(b8PpuPalCache* pc_);
+
 
 /**
  * @brief Structure representing a background tile for the PPU (Pixel Processing Unit).
@@ -964,6 +1067,54 @@ extern b8PpuJmp* b8PpuJmpAlloc(b8PpuCmd* cmd_, u32* cpuaddr_);
  */
 extern void b8PpuClearOT(b8PpuCmd* cmd_, u32* ot_, u32* ot_prev_, u32 num_);
 
+/**
+ * @brief Number of `u32` words of the bitmap b8PpuClearOTSparse() needs for an OT of `num_` entries.
+ */
+#define B8_PPU_OT_USED_WORDS(num_) ((((num_) + 31) >> 5) + 1)
+
+/**
+ * @brief Clears an Ordering Table in time proportional to the entries used, not to its size.
+ *
+ * Same result as `b8PpuClearOT`, for OTs of hundreds or thousands of Z-values.
+ * The pushes record which entries they use in `used_`, and the next clear of the
+ * same OT restores only those. Call `b8PpuLinkOT` before executing the list, so
+ * the PPU does not walk the empty entries either.
+ *
+ * The first call links every entry, like `b8PpuClearOT`.
+ *
+ * @param cmd_ A pointer to the PPU command structure.
+ * @param ot_ The Ordering Table, `num_` entries.
+ * @param ot_prev_ The previous-entry table, `num_` entries.
+ * @param used_ Bitmap of `B8_PPU_OT_USED_WORDS(num_)` words. It belongs to `ot_`,
+ *              and must be zero-filled before the first call.
+ * @param num_ The number of entries in the Ordering Table.
+ *
+ * Example:
+ * @code
+ * static u32 ot[ 1024 ], ot_prev[ 1024 ];
+ * static u32 ot_used[ B8_PPU_OT_USED_WORDS( 1024 ) ];
+ *
+ * b8PpuCmdSetBuff( &cmd , buff , sizeof( buff ) );
+ * b8PpuClearOTSparse( &cmd , ot , ot_prev , ot_used , 1024 );
+ * ...
+ * b8PpuLinkOT( &cmd );
+ * b8PpuHaltAlloc( &cmd );
+ * b8PpuExec( &cmd );
+ * @endcode
+ */
+extern void b8PpuClearOTSparse(b8PpuCmd* cmd_, u32* ot_, u32* ot_prev_, u32* used_, u32 num_);
+
+/**
+ * @brief Makes the PPU skip the empty entries of an OT cleared with b8PpuClearOTSparse().
+ *
+ * Each used entry is followed by at most one jump before the next used one.
+ * Call it after the last push of the frame. Does nothing for an OT cleared with
+ * b8PpuClearOT().
+ *
+ * @param cmd_ A pointer to the PPU command structure.
+ */
+extern void b8PpuLinkOT(b8PpuCmd* cmd_);
+
 /**
  * @brief Adds a primitive to the front of the Ordering Table (OT) at the specified Z-value.
  *
@@ -1079,6 +1230,80 @@ extern void b8PpuPushFrontOT(b8PpuCmd* cmd_, u32 otz_, void* prim_);
  */
 extern void b8PpuPushBackOT(b8PpuCmd* cmd_, u32 otz_, void* prim_);
 
+/**
+ * @brief Structure representing a recorded run of PPU commands (a display list).
+ *
+ * A display list is recorded once into a buffer of its own and linked into the
+ * Ordering Table of later frames with a single jump, so static content such as a
+ * HUD, level geometry or a title screen costs nothing to rebuild every frame.
+ *
+ * Record primitives with the usual allocators on `cmd`, without a Z-value
+ * (e.g. `b8PpuRectAlloc(&dl.cmd)`). They run in the order they were recorded.
+ * Keep the returned pointers to patch positions or palettes later; a patch is
+ * seen by every frame the list is linked into from then on.
+ *
+ * The list ends with one exit word that each link rewrites, so a display list
+ * can be part of only one command list the PPU may still be running. When
+ * frames are pipelined with b8PpuExecFence(), keep one display list per frame
+ * buffer, and patch a list only once the fence of the frame that used it is done.
+ */
+typedef struct _b8PpuDl {
+  b8PpuCmd  cmd;    /**< Command buffer the primitives are recorded into. */
+  u32*      head;   /**< First recorded command. */
+  u32*      exit;   /**< Last word, jumps back into the frame once linked. */
+} b8PpuDl;
+
+/**
+ * @brief Starts recording a display list.
+ *
+ * @param dl_ Pointer to the display list.
+ * @param buff_ Buffer that holds the commands. It must outlive every frame the list is linked into.
+ * @param bytesize_ Size of the buffer in bytes.
+ */
+extern void b8PpuDlBegin(b8PpuDl* dl_, u32* buff_, u32 bytesize_);
+
+/**
+ * @brief Ends recording a display list.
+ *
+ * Appends the exit word. Until the list is linked, it halts the PPU.
+ *
+ * @param dl_ Pointer to the display list.
+ */
+extern void b8PpuDlEnd(b8PpuDl* dl_);
+
+/**
+ * @brief Links a display list to the front of the Ordering Table at the specified Z-value.
+ *
+ * Same ordering as `b8PpuPushFrontOT`, without using any space in `cmd_`.
+ *
+ * @param cmd_ A pointer to the PPU command structure of the frame.
+ * @param otz_ The Z-value to link the display list at.
+ * @param dl_ The display list, ended with `b8PpuDlEnd`.
+ */
+extern void b8PpuDlPushFrontOT(b8PpuCmd* cmd_, u32 otz_, b8PpuDl* dl_);
+
+/**
+ * @brief Links a display list to the end of the Ordering Table at the specified Z-value.
+ *
+ * Same ordering as `b8PpuPushBackOT`, without using any space in `cmd_`.
+ * Primitives pushed back at the same Z-value afterwards follow the display list.
+ *
+ * @param cmd_ A pointer to the PPU command structure of the frame.
+ * @param otz_ The Z-value to link the display list at.
+ * @param dl_ The display list, ended with `b8PpuDlEnd`.
+ */
+extern void b8PpuDlPushBackOT(b8PpuCmd* cmd_, u32 otz_, b8PpuDl* dl_);
+
+/**
+ * @brief Links a display list at the current position of a command buffer that has no OT.
+ *
+ * Writes one jump to the display list; the commands allocated next run after it.
+ *
+ * @param cmd_ A pointer to the PPU command structure of the frame.
+ * @param dl_ The display list, ended with `b8PpuDlEnd`.
+ */
+extern void b8PpuDlLink(b8PpuCmd* cmd_, b8PpuDl* dl_);
+
 /**
  * @brief Executes the PPU commands stored in the buffer.
  *
@@ -1092,6 +1317,69 @@ extern void b8PpuPushBackOT(b8PpuCmd* cmd_, u32 otz_, void* prim_);
  */
 extern  void  b8PpuExec( b8PpuCmd* cmd_ );
 
+/**
+ * @brief Prints a command list to the debug console, the way the PPU would walk it.
+ *
+ * Each command is printed with its address, followed by the image data a LOADIMG reads
+ * and the tile map a BG reads. Save the console output and replay it on the host with
+ * `tool/b8ppuref`, which renders each list to a PNG.
+ *
+ * @param cmd_ The command list, ready to be executed.
+ */
+extern  void  b8PpuDump( const b8PpuCmd* cmd_ );
+
+/**
+ * @brief Makes b8PpuExec() dump every list it starts, with b8PpuDump().
+ *
+ * Dumping is slow; enable it for the few frames to capture. It is off after reset.
+ *
+ * @param enable_ Non-zero to dump.
+ */
+extern  void  b8PpuDumpEnable( int enable_ );
+
+/**
+ * @brief Executes a command list and returns a fence for it.
+ *
+ * Waits until the previously fenced list is done, kicks this one and
+ * returns without waiting for it. The caller can record the next frame
+ * into another buffer meanwhile, and must not touch this buffer (nor the
+ * OT it links) until b8PpuFenceDone() reports the fence.
+ *
+ * Example usage:
+ * @code
+ * static u32 _buff[ 2 ][ PPU_CMD_BUFF_WORDS ];
+ * static u32 _fence[ 2 ];
+ * for( u32 frm=0 ; ; frm ^= 1 ){
+ *   b8PpuFenceWait( _fence[ frm ] );
+ *   b8PpuCmdSetBuff( &_ppu_cmd , _buff[ frm ] , sizeof( _buff[ frm ] ) );
+ *   // ... record the frame ...
+ *   b8PpuHaltAlloc( &_ppu_cmd );
+ *   _fence[ frm ] = b8PpuExecFence( &_ppu_cmd );
+ * }
+ * @endcode
+ *
+ * Fences are counted with b8PpuVsyncWait(), so use them from one thread.
+ *
+ * @param cmd_ A pointer to the PPU command structure containing the commands to be executed.
+ * @return The fence of the list.
+ */
+extern  u32   b8PpuExecFence( b8PpuCmd* cmd_ );
+
+/**
+ * @brief Tells whether the PPU is done with a fenced command list.
+ *
+ * @param fence_ A value returned by b8PpuExecFence(). 0 is always done.
+ * @return Non-zero once the list is done.
+ */
+extern  int   b8PpuFenceDone( u32 fence_ );
+
+/**
+ * @brief Waits until the PPU is done with a fenced command list.
+ *
+ * @param fence_ A value returned by b8PpuExecFence(). 0 is always done.
+ */
+extern  void  b8PpuFenceWait( u32 fence_ );
+
 /**
  * @brief Enables the V-blank interrupt for the PPU.
  *
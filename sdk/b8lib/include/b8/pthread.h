@@ -19,22 +19,55 @@
  *   - pthread_attr_getstack
  *   - pthread_attr_getdetachstate
  *   - pthread_attr_setdetachstate
- *
- * - The following functions are not supported in this OS environment and always return -ERRNOSYS:
+ *   - pthread_attr_setschedpolicy
+ *   - pthread_attr_getschedpolicy
+ *   - pthread_attr_setschedparam
+ *   - pthread_attr_getschedparam
  *   - pthread_getschedparam
  *   - pthread_setschedparam
- *   - pthread_detach
+ *   - pthread_mutex_init
+ *   - pthread_mutex_destroy
+ *   - pthread_mutex_lock
+ *   - pthread_mutex_trylock
+ *   - pthread_mutex_unlock
+ *   - pthread_mutexattr_init
+ *   - pthread_mutexattr_destroy
+ *   - pthread_mutexattr_settype
+ *   - pthread_mutexattr_gettype
+ *   - pthread_mutexattr_setprotocol
+ *   - pthread_mutexattr_getprotocol
+ *   - pthread_cond_init
+ *   - pthread_cond_destroy
+ *   - pthread_cond_wait
+ *   - pthread_cond_timedwait
+ *   - pthread_cond_signal
+ *   - pthread_cond_broadcast
+ *   - pthread_condattr_init
+ *   - pthread_condattr_destroy
+ *   - pthread_exit
  *   - pthread_join
+ *   - pthread_detach
+ *
+ * - Scheduling: b8OS always runs the highest-priority ready thread. Priorities range from
+ *   sched_get_priority_min() (1) to sched_get_priority_max() (31); a larger value is a higher
+ *   priority. SCHED_RR threads of equal priority share the CPU in 10 ms time slices, while a
+ *   SCHED_FIFO thread keeps the CPU until it blocks, yields or is preempted by a higher priority.
+ *
+ * - Mutexes: an uncontended lock or unlock is a single atomic swap in user mode and never enters
+ *   the kernel. Only a contended lock sleeps in the kernel, and while it does, the owner runs at
+ *   the priority of the highest waiter (priority inheritance is always applied).
+ *
+ * - Threads: returning from the start routine is the same as calling pthread_exit(). The TCB slot
+ *   and a stack allocated by the kernel are released once the thread is joined, or on exit when
+ *   it is detached. A joinable thread that is never joined keeps both.
+ *
+ * - The following functions are not supported in this OS environment and always return -ERRNOSYS:
  *   - pthread_cancel
  *   - pthread_setcanceltype
  *   - pthread_testcancel
  *
- * - The following functions can be called and will set attributes, but the actual scheduling
- *   policy or affinity settings are ignored in this BEEP-8 environment, making them effectively unsupported:
- *   - pthread_attr_setschedpolicy
- *   - pthread_attr_getschedpolicy
- *   - pthread_attr_setschedparam
- *   - pthread_attr_getschedparam
+ * - The following functions can be called and will set attributes, but the actual inheritance
+ *   or affinity settings are ignored in this BEEP-8 environment, making them effectively unsupported:
  *   - pthread_attr_setinheritsched
  *   - pthread_attr_getinheritsched
  *   - pthread_attr_setaffinity_np
@@ -49,6 +82,7 @@ extern  "C" {
 #include <b8/os.h>
 #include <b8/type.h>
 #include <b8/sched.h>
+#include <time.h>
 
 #undef  pthread_attr_t
 #define pthread_attr_t b8_pthread_attr_t
@@ -65,7 +99,7 @@ typedef struct _b8_pthread_attr_t {
   size_t  stacksize;    // Size of the stack allocated for the pthread
   u8      policy;
   u8      detachstate;  // Initialize to the detach state
-  s16     priority;     // The actual scheduling policy is ignored and thus effectively unsupported.
+  s16     priority;     // sched_param::sched_priority, 0 selects the default of the policy.
   u16     irq_no;
 } b8_pthread_attr_t;
 
@@ -79,6 +113,62 @@ typedef struct _b8_pthread_attr_t {
 
 #define pthread_equal(t1,t2) ((t1) == (t2))
 
+#undef  PTHREAD_MUTEX_NORMAL
+#define PTHREAD_MUTEX_NORMAL          0
+#undef  PTHREAD_MUTEX_RECURSIVE
+#define PTHREAD_MUTEX_RECURSIVE       1
+#undef  PTHREAD_MUTEX_ERRORCHECK
+#define PTHREAD_MUTEX_ERRORCHECK      2
+#undef  PTHREAD_MUTEX_DEFAULT
+#define PTHREAD_MUTEX_DEFAULT         3
+
+#undef  PTHREAD_PRIO_NONE
+#define PTHREAD_PRIO_NONE             0
+#undef  PTHREAD_PRIO_INHERIT
+#define PTHREAD_PRIO_INHERIT          1
+
+#undef  pthread_mutex_t
+#define pthread_mutex_t b8_pthread_mutex_t
+
+typedef struct _b8_pthread_mutex_t {
+  b8OsMutex lock;       // Lock word shared with the kernel
+  u16       count;      // Recursion depth of the owner
+  u8        type;       // PTHREAD_MUTEX_*
+} b8_pthread_mutex_t;
+
+#undef  pthread_mutexattr_t
+#define pthread_mutexattr_t b8_pthread_mutexattr_t
+
+typedef struct _b8_pthread_mutexattr_t {
+  u8      type;         // PTHREAD_MUTEX_*
+  u8      protocol;     // PTHREAD_PRIO_*, inheritance is applied either way
+} b8_pthread_mutexattr_t;
+
+#undef  PTHREAD_MUTEX_INITIALIZER
+#define PTHREAD_MUTEX_INITIALIZER \
+  { { B8_OS_MUTEX_UNLOCKED, B8_OS_INVALID_PID }, 0, PTHREAD_MUTEX_DEFAULT }
+
+#undef  PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP
+#define PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP \
+  { { B8_OS_MUTEX_UNLOCKED, B8_OS_INVALID_PID }, 0, PTHREAD_MUTEX_RECURSIVE }
+
+#undef  pthread_cond_t
+#define pthread_cond_t b8_pthread_cond_t
+
+typedef struct _b8_pthread_cond_t {
+  b8OsCond  cond;       // Sequence word shared with the kernel
+} b8_pthread_cond_t;
+
+#undef  pthread_condattr_t
+#define pthread_condattr_t b8_pthread_condattr_t
+
+typedef struct _b8_pthread_condattr_t {
+  u8      reserved;     // Timeouts are always CLOCK_REALTIME
+} b8_pthread_condattr_t;
+
+#undef  PTHREAD_COND_INITIALIZER
+#define PTHREAD_COND_INITIALIZER { { 0, 0 } }
+
 /**
  * @brief Creates a new thread.
  *
@@ -219,13 +309,12 @@ extern int pthread_attr_setdetachstate(pthread_attr_t *attr, int detachstate);
  * @brief Sets the scheduling parameters in the thread attributes object.
  *
  * This function is part of the POSIX standard and allows setting the scheduling parameters
- * in the thread attributes object. However, in this specific OS environment, while the function
- * can be called and the parameters can be set, the actual scheduling policy is ignored, making
- * it effectively unsupported.
+ * in the thread attributes object. `sched_priority` becomes the priority of threads created
+ * with this attribute object.
  *
  * @param attr A pointer to the thread attributes object.
  * @param param A pointer to a struct sched_param containing the scheduling parameters.
- * @return 0 indicating success, but note that the scheduling policy is ignored.
+ * @return 0 on success, or EINVAL if the priority is out of range.
  */
 extern int pthread_attr_setschedparam(pthread_attr_t *attr, const struct sched_param *param);
 
@@ -233,73 +322,66 @@ extern int pthread_attr_setschedparam(pthread_attr_t *attr, const struct sched_p
  * @brief Retrieves the scheduling parameters from the thread attributes object.
  *
  * This function is part of the POSIX standard and allows retrieving the scheduling parameters
- * from the thread attributes object. However, in this specific OS environment, while the function
- * can be called and the parameters can be retrieved, the actual scheduling policy is ignored, making
- * it effectively unsupported.
+ * from the thread attributes object.
  *
  * @param attr A pointer to the thread attributes object.
  * @param param A pointer to a struct sched_param where the scheduling parameters will be stored.
- * @return 0 indicating success, but note that the retrieved scheduling policy is ignored.
+ * @return 0 on success.
  */
 extern int pthread_attr_getschedparam(const pthread_attr_t *attr, struct sched_param *param);
 
 /**
  * @brief Retrieves the scheduling policy and parameters of the specified thread.
  *
- * This function is part of the POSIX standard. However, in this specific environment,
- * it is not supported and will always return -ERRNOSYS.
- *
  * @param thread The thread whose scheduling parameters are to be retrieved.
  * @param policy A pointer to an integer where the policy will be stored.
  * @param param A pointer to a struct sched_param where the scheduling parameters will be stored.
- * @return -ERRNOSYS as this function is not supported in this environment.
+ * @return 0 on success, EINVAL if an argument is NULL, or ESRCH if the thread does not exist.
  */
 extern int pthread_getschedparam(pthread_t thread, int* policy, struct sched_param* param);
 
 /**
  * @brief Sets the scheduling policy and parameters of the specified thread.
  *
- * This function is part of the POSIX standard. However, in this specific environment,
- * it is not supported and will always return -ERRNOSYS.
+ * The change takes effect immediately: if the thread now outranks the caller, it preempts it.
  *
  * @param thread The thread whose scheduling parameters are to be set.
- * @param policy The new scheduling policy.
+ * @param policy The new scheduling policy (SCHED_FIFO, SCHED_RR or SCHED_IRQ).
  * @param param A pointer to a struct sched_param containing the new scheduling parameters.
- * @return -ERRNOSYS as this function is not supported in this environment.
+ * @return 0 on success, EINVAL for an invalid policy or priority, or ESRCH if the thread does not exist.
  */
 extern int pthread_setschedparam(pthread_t thread, int policy, const struct sched_param* param);
 
 /**
  * @brief Sets the scheduling policy attribute in the thread attributes object.
  *
- * This function is part of the POSIX standard. In this specific environment, while the function can be called and 
- * the policy can be set, the actual scheduling policy is ignored and thus effectively unsupported.
+ * This function is part of the POSIX standard. SCHED_FIFO and SCHED_RR are honoured by the
+ * b8OS scheduler; SCHED_IRQ is reserved for IRQ handler threads.
  *
  * @param attr A pointer to the thread attributes object.
  * @param policy The new scheduling policy.
- * @return 0 indicating success, but note that the policy is ignored.
+ * @return 0 indicating success.
  */
 extern int pthread_attr_setschedpolicy(pthread_attr_t *attr, int policy);
 
 /**
  * @brief Retrieves the scheduling policy from the thread attributes object.
  *
- * This function is part of the POSIX standard. In this specific environment, while the function can be called and 
- * the policy can be retrieved, the actual scheduling policy is ignored and thus effectively unsupported.
+ * This function is part of the POSIX standard and allows retrieving the scheduling policy
+ * from the thread attributes object.
  *
  * @param attr A pointer to the thread attributes object.
  * @param policy A pointer to an integer where the policy will be stored.
- * @return 0 indicating success, but note that the retrieved policy is ignored in practice.
+ * @return 0 indicating success.
  */
 extern int pthread_attr_getschedpolicy(const pthread_attr_t *attr, int *policy);
 
 /**
  * @brief Terminates the calling thread.
  *
- * This function is part of the POSIX standard and allows for the termination of the calling thread.
- * However, in this specific OS environment, thread termination is not supported. While the function
- * can be called, it will only put the thread into an indefinite wait state, and the thread will not
- * be released or cleaned up.
+ * The value is handed to the thread that joins it. A detached thread is released at once; a
+ * joinable one stays a zombie until pthread_join() is called. Mutexes still owned by the
+ * thread stay locked.
  *
  * @param value The exit status of the thread.
  */
@@ -308,24 +390,24 @@ extern  void pthread_exit(pthread_addr_t value);
 /**
  * @brief Detaches the specified thread.
  *
- * This function is part of the POSIX standard and is used to detach a thread, allowing its resources
- * to be automatically reclaimed upon termination. However, in this OS environment, this function is not supported
- * and always returns -ERRNOSYS.
+ * The TCB slot and stack of a detached thread are released as soon as it exits, or at once
+ * if it already has.
  *
  * @param thread The thread to be detached.
- * @return -ERRNOSYS indicating that this function is not supported.
+ * @return 0 on success, ESRCH if no such thread exists, or EINVAL if it is already detached.
  */
 extern int pthread_detach(pthread_t thread);
 
 /**
  * @brief Waits for the specified thread to terminate.
  *
- * This function is part of the POSIX standard and is used to wait for a thread to terminate and optionally
- * retrieve its exit status. However, in this OS environment, this function is not supported and always returns -ERRNOSYS.
+ * The caller sleeps until the thread exits, then receives its exit status and the
+ * thread's TCB slot and stack are released.
  *
  * @param thread The thread to wait for.
- * @param value A pointer to a location where the exit status of the thread will be stored.
- * @return -ERRNOSYS indicating that this function is not supported.
+ * @param value A pointer to a location where the exit status of the thread will be stored, or NULL.
+ * @return 0 on success, ESRCH if no such thread exists, EINVAL if it is detached or already
+ *         being joined, or EDEADLK if it is the caller or is joining the caller.
  */
 extern int pthread_join(pthread_t thread, pthread_addr_t *value);
 
@@ -361,6 +443,185 @@ extern int pthread_setcanceltype(int type, int *oldtype);
  */
 extern void pthread_testcancel(void);
 
+/**
+ * @brief Initializes a mutex attributes object with the default type and protocol.
+ *
+ * @param attr A pointer to the mutex attributes object.
+ * @return 0 on success, or EINVAL if attr is NULL.
+ */
+extern int pthread_mutexattr_init(pthread_mutexattr_t* attr);
+
+/**
+ * @brief Destroys a mutex attributes object.
+ *
+ * @param attr A pointer to the mutex attributes object.
+ * @return 0 on success, or EINVAL if attr is NULL.
+ */
+extern int pthread_mutexattr_destroy(pthread_mutexattr_t* attr);
+
+/**
+ * @brief Sets the mutex type (PTHREAD_MUTEX_NORMAL, RECURSIVE, ERRORCHECK or DEFAULT).
+ *
+ * @param attr A pointer to the mutex attributes object.
+ * @param type The new mutex type.
+ * @return 0 on success, or EINVAL for an unknown type.
+ */
+extern int pthread_mutexattr_settype(pthread_mutexattr_t* attr, int type);
+
+/**
+ * @brief Retrieves the mutex type from a mutex attributes object.
+ *
+ * @param attr A pointer to the mutex attributes object.
+ * @param type A pointer to an integer where the type will be stored.
+ * @return 0 on success, or EINVAL if an argument is NULL.
+ */
+extern int pthread_mutexattr_gettype(const pthread_mutexattr_t* attr, int* type);
+
+/**
+ * @brief Sets the mutex protocol.
+ *
+ * PTHREAD_PRIO_NONE and PTHREAD_PRIO_INHERIT are accepted. b8OS applies priority
+ * inheritance to every contended mutex, so the value is only stored.
+ *
+ * @param attr A pointer to the mutex attributes object.
+ * @param protocol The new protocol.
+ * @return 0 on success, or ENOTSUP for PTHREAD_PRIO_PROTECT.
+ */
+extern int pthread_mutexattr_setprotocol(pthread_mutexattr_t* attr, int protocol);
+
+/**
+ * @brief Retrieves the mutex protocol from a mutex attributes object.
+ *
+ * @param attr A pointer to the mutex attributes object.
+ * @param protocol A pointer to an integer where the protocol will be stored.
+ * @return 0 on success, or EINVAL if an argument is NULL.
+ */
+extern int pthread_mutexattr_getprotocol(const pthread_mutexattr_t* attr, int* protocol);
+
+/**
+ * @brief Initializes a mutex.
+ *
+ * No kernel object is allocated; a statically initialized mutex
+ * (PTHREAD_MUTEX_INITIALIZER) is equivalent.
+ *
+ * @param mutex A pointer to the mutex.
+ * @param attr A pointer to the mutex attributes object, or NULL for defaults.
+ * @return 0 on success, or EINVAL if mutex is NULL.
+ */
+extern int pthread_mutex_init(pthread_mutex_t* mutex, const pthread_mutexattr_t* attr);
+
+/**
+ * @brief Destroys a mutex.
+ *
+ * @param mutex A pointer to the mutex.
+ * @return 0 on success, EINVAL if mutex is NULL, or EBUSY if it is locked.
+ */
+extern int pthread_mutex_destroy(pthread_mutex_t* mutex);
+
+/**
+ * @brief Locks a mutex, sleeping while another thread owns it.
+ *
+ * The uncontended case does not enter the kernel.
+ *
+ * @param mutex A pointer to the mutex.
+ * @return 0 on success, EINVAL if mutex is NULL, EDEADLK if the caller already owns a
+ *         non-recursive mutex, or EAGAIN if the recursion count would overflow.
+ */
+extern int pthread_mutex_lock(pthread_mutex_t* mutex);
+
+/**
+ * @brief Locks a mutex only if it is free.
+ *
+ * @param mutex A pointer to the mutex.
+ * @return 0 on success, EBUSY if another thread owns it, or the errors of pthread_mutex_lock().
+ */
+extern int pthread_mutex_trylock(pthread_mutex_t* mutex);
+
+/**
+ * @brief Unlocks a mutex owned by the caller.
+ *
+ * The kernel is only entered when another thread is sleeping on the mutex.
+ *
+ * @param mutex A pointer to the mutex.
+ * @return 0 on success, EINVAL if mutex is NULL, or EPERM if the caller does not own it.
+ */
+extern int pthread_mutex_unlock(pthread_mutex_t* mutex);
+
+/**
+ * @brief Initializes a condition variable attributes object.
+ *
+ * @param attr A pointer to the condition variable attributes object.
+ * @return 0 on success, or EINVAL if attr is NULL.
+ */
+extern int pthread_condattr_init(pthread_condattr_t* attr);
+
+/**
+ * @brief Destroys a condition variable attributes object.
+ *
+ * @param attr A pointer to the condition variable attributes object.
+ * @return 0 on success, or EINVAL if attr is NULL.
+ */
+extern int pthread_condattr_destroy(pthread_condattr_t* attr);
+
+/**
+ * @brief Initializes a condition variable.
+ *
+ * No kernel object is allocated; PTHREAD_COND_INITIALIZER is equivalent.
+ *
+ * @param cond A pointer to the condition variable.
+ * @param attr A pointer to the attributes object, or NULL for defaults.
+ * @return 0 on success, or EINVAL if cond is NULL.
+ */
+extern int pthread_cond_init(pthread_cond_t* cond, const pthread_condattr_t* attr);
+
+/**
+ * @brief Destroys a condition variable.
+ *
+ * @param cond A pointer to the condition variable.
+ * @return 0 on success, EINVAL if cond is NULL, or EBUSY if threads are waiting on it.
+ */
+extern int pthread_cond_destroy(pthread_cond_t* cond);
+
+/**
+ * @brief Releases the mutex and sleeps until the condition is signalled, then locks the mutex again.
+ *
+ * A signal sent between the release and the sleep is not lost. The recursion count of a
+ * recursive mutex is restored.
+ *
+ * @param cond A pointer to the condition variable.
+ * @param mutex A pointer to a mutex owned by the caller.
+ * @return 0 on success, EINVAL if an argument is NULL, or EPERM if the caller does not own the mutex.
+ */
+extern int pthread_cond_wait(pthread_cond_t* cond, pthread_mutex_t* mutex);
+
+/**
+ * @brief Same as pthread_cond_wait(), but gives up at an absolute CLOCK_REALTIME time.
+ *
+ * @param cond A pointer to the condition variable.
+ * @param mutex A pointer to a mutex owned by the caller.
+ * @param abstime The deadline.
+ * @return 0 on success, ETIMEDOUT when the deadline passed, or the errors of pthread_cond_wait().
+ */
+extern int pthread_cond_timedwait(pthread_cond_t* cond, pthread_mutex_t* mutex, const struct timespec* abstime);
+
+/**
+ * @brief Wakes the highest priority thread waiting on the condition.
+ *
+ * The kernel is only entered when some thread is waiting.
+ *
+ * @param cond A pointer to the condition variable.
+ * @return 0 on success, or EINVAL if cond is NULL.
+ */
+extern int pthread_cond_signal(pthread_cond_t* cond);
+
+/**
+ * @brief Wakes every thread waiting on the condition.
+ *
+ * @param cond A pointer to the condition variable.
+ * @return 0 on success, or EINVAL if cond is NULL.
+ */
+extern int pthread_cond_broadcast(pthread_cond_t* cond);
+
 /*
 Note: The following functions are not supported and are not defined in this environment.
 - pthread_attr_setinheritsched
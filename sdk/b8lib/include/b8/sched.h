@@ -13,8 +13,8 @@
  * - `SCHED_IRQ`: IRQ handler scheduling policy
  * - `SCHED_OTHER`: Not supported
  * 
- * This file also provides a function prototype for retrieving the maximum priority 
- * value for a given scheduling policy.
+ * This file also provides function prototypes for retrieving the maximum and minimum
+ * priority values for a given scheduling policy.
  * 
  * Typically, users do not need to use this header directly. It is intended for internal 
  * use within the BEEP-8 system to handle scheduling-related operations.
@@ -48,6 +48,7 @@ struct b8_sched_param{
 };
 
 extern  int sched_get_priority_max(int policy);
+extern  int sched_get_priority_min(int policy);
 
 #ifdef  __cplusplus
 }
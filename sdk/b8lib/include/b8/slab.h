@@ -0,0 +1,53 @@
+/**
+ * @file slab.h
+ * @brief Small-block allocator in front of newlib's malloc.
+ *
+ * Allocations of up to B8_SLAB_MAX_SIZE bytes are served from size classes
+ * carved out of 4 KB pages. Each thread keeps a short free list per class, so
+ * most malloc()/free() pairs on small blocks touch no lock at all. Larger
+ * blocks, and aligned blocks, go to newlib as before.
+ *
+ * The allocator sits behind the linker's --wrap of _malloc_r, _free_r,
+ * _realloc_r, _calloc_r, _memalign_r and _malloc_usable_size_r (see
+ * makefile.inc), so malloc(), operator new and newlib's own allocations all
+ * use it, and free() accepts blocks from either allocator.
+ *
+ * Pages are never given back to newlib; a freed block stays available to its
+ * size class. mallinfo() does not see blocks handed out by the slab allocator.
+ *
+ * Functions provided:
+ * - `b8SlabGetStat`: Report the pages held by each size class
+ */
+#pragma once
+
+#ifdef  __cplusplus
+extern  "C" {
+#endif
+
+#include <b8/type.h>
+
+#define B8_SLAB_MAX_SIZE    (256)   // larger blocks come from newlib
+#define B8_SLAB_PAGE_SIZE   (4096)
+#define B8_SLAB_NUM_CLASSES (10)
+
+/**
+ * @brief Usage of one size class.
+ */
+typedef struct {
+  u32 block_size;   ///< Bytes per block.
+  u32 pages;        ///< Pages carved for the class.
+  u32 free_blocks;  ///< Blocks in the shared free list, not counting thread caches.
+} b8SlabStat;
+
+/**
+ * @brief Report the pages held by each size class.
+ *
+ * @param st Receives one entry per class, smallest first.
+ * @param max Number of entries `st` can hold.
+ * @return Number of entries written.
+ */
+extern int b8SlabGetStat(b8SlabStat* st, int max);
+
+#ifdef  __cplusplus
+}
+#endif
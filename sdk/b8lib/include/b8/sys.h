@@ -16,6 +16,7 @@
  * - `b8SysGetCpuClock`: Get the CPU clock speed
  * - `b8SysSetupIrqWait`: Set up an IRQ wait handler
  * - `b8SysIrqWait`: Wait for an IRQ
+ * - `b8SysIrqPending`: Count IRQs nobody has waited for yet
  * 
  * These functions are intended for use under special conditions, such as in the bootloader,
  * operating system, or for handling exceptional halts. They should not be used in regular 
@@ -29,6 +30,7 @@ extern  "C" {
 #endif
 
 #include <b8/type.h>
+#include <b8/con.h>   // b8ConPanic() in B8_SYS_ASSERT
 
 /**
  * @brief Halt the system.
@@ -91,6 +93,9 @@ extern u32 b8SysGetCpuClock(void);
  * @brief Set up an IRQ wait handler.
  * 
  * This function sets up an IRQ wait handler for the specified IRQ.
+ * The kernel posts a semaphore straight from the interrupt, so a thread
+ * waiting in b8SysIrqWait() wakes up without any helper thread.
+ * The IRQ can't be given to a SCHED_IRQ thread afterwards.
  * 
  * @param irq The IRQ number to set up.
  * @return 0 on success; an error code on failure.
@@ -107,6 +112,16 @@ extern int b8SysSetupIrqWait(u32 irq);
  */
 extern int b8SysIrqWait(u32 irq);
 
+/**
+ * @brief Count the IRQs that fired and were not waited for yet.
+ * 
+ * That many calls to b8SysIrqWait() return without blocking.
+ * 
+ * @param irq The IRQ number set up with b8SysSetupIrqWait().
+ * @return The number of pending IRQs; -1 with errno set on failure.
+ */
+extern int b8SysIrqPending(u32 irq);
+
 /**
  * @brief Assert macro for system checks.
  * 
@@ -119,6 +134,7 @@ extern int b8SysIrqWait(u32 irq);
 #define B8_SYS_ASSERT(expr_, comment_) \
     do { \
         if (!(expr_)) { \
+          b8ConPanic();\
           b8SysPuts( "[B8_SYS_ASSERT]" );\
           b8SysPuts( comment_ );\
           b8SysPutCR();\
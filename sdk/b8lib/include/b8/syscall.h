@@ -13,8 +13,8 @@
  * - `CLOCK_MONOTONIC_COARSE`: Coarse resolution version of `CLOCK_MONOTONIC`
  * - `CLOCK_MONOTONIC_RAW`: Raw hardware-based version of `CLOCK_MONOTONIC`
  * - `CLOCK_BOOTTIME`: Monotonic clock including time spent in suspend
- * - `CLOCK_PROCESS_CPUTIME_ID`: High-resolution per-process timer from the CPU
- * - `CLOCK_THREAD_CPUTIME_ID`: Thread-specific CPU-time clock
+ * - `CLOCK_PROCESS_CPUTIME_ID`: CPU time of all threads but the idle thread, counted in CPU cycles
+ * - `CLOCK_THREAD_CPUTIME_ID`: CPU time of the calling thread, counted in CPU cycles at each thread switch
  * 
  * Functions provided:
  * - `clock_getres`: Get the resolution of the specified clock
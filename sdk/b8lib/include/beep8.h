@@ -25,6 +25,9 @@
  * - <b8/pthread.h>: BEEP-8 pthread functions
  * - <b8/syscall.h>: BEEP-8 system call interface
  * - <b8/misc.h>: Miscellaneous BEEP-8 functions
+ * - <b8/con.h>: BEEP-8 buffered console output
+ * - <b8/slab.h>: BEEP-8 small-block allocator
+ * - <b8/heap.h>: BEEP-8 heap usage and allocation tracking
  *
  * @note Ensure that this header is included at the beginning of your source files to access
  * all the functionalities of the BEEP-8 SDK.
@@ -47,4 +50,7 @@
 #include <b8/semaphore.h>
 #include <b8/pthread.h>
 #include <b8/syscall.h>
-#include <b8/misc.h>
\ No newline at end of file
+#include <b8/misc.h>
+#include <b8/con.h>
+#include <b8/slab.h>
+#include <b8/heap.h>
\ No newline at end of file
@@ -20,7 +20,9 @@ extern  "C" {
  * @brief Represents a file in the file system.
  * 
  * This structure is used to store information about an open file.
- * Each file has its own private data and driver-specific private data.
+ * There is one per file descriptor, so a path can be open several times at once,
+ * each with its own private data and offset. The driver-specific private data is
+ * shared by every descriptor opened through the same driver.
  * The 'used' flag indicates whether the file is currently in use.
  * The 'mode' represents the access mode for the file.
  */
@@ -30,6 +32,7 @@ typedef struct
   void*   d_priv;     ///< Driver-specific private data
   uint8_t used;       ///< Flag indicating if the file is in use
   int     mode;       ///< Access mode for the file
+  off_t   offset;     ///< Position for drivers that keep one. 0 after open.
 } File;
 
 /**
@@ -66,13 +69,15 @@ typedef struct {
  * @brief Registers a file system driver.
  * 
  * This function registers a new file system driver with the specified path,
- * file operations, access mode, and private data.
+ * file operations, access mode, and private data. open() looks paths up in a
+ * hash table, so the number of registered drivers does not slow it down.
  * 
  * @param path The path managed by the driver.
  * @param fops The file operations supported by the driver.
  * @param mode The access mode for the driver.
  * @param priv The driver-specific private data.
- * @return int 0 on success, negative value on failure.
+ * @return int 0 on success, negative value on failure. Fails with EEXIST if the
+ *         path is already registered.
  */
 extern  int fs_register_driver(
   const char* path,
@@ -0,0 +1,191 @@
+#include <beep8.h>
+#include <b8/con.h>
+#include <b8/os.h>
+#include <b8/pthread.h>
+#include <sys/errno.h>
+#include <string.h>
+
+#define SCI_CH      (0)
+#define RING_MASK   (B8_CON_RING_SIZE-1)
+#define USR_MODE    (0x10)
+
+#if B8_CON_RING_SIZE & RING_MASK
+#error "B8_CON_RING_SIZE must be a power of 2"
+#endif
+
+extern  u32   _b8OsGetCPSR(void);
+
+static  char          _ring[ B8_CON_RING_SIZE ];
+static  volatile u32  _head;      // advanced by writers, under _mutex
+static  volatile u32  _tail;      // advanced by whoever copies to the FIFO
+static  u32           _dropped;
+static  u32           _dropped_unreported;
+static  int           _policy = B8_CON_BLOCK;
+static  u8            _running = 0;
+static  volatile u8   _panic = 0;
+
+/*
+  _mutex guards the ring and _head. _mutex_drain is held by whoever copies
+  the ring to the FIFO. Writers that find the ring full drain it themselves,
+  so output never waits for the low-priority drain thread to be scheduled;
+  if that thread is in the middle of a drain, priority inheritance lets it
+  finish. Lock order: _mutex, then _mutex_drain.
+*/
+static  pthread_mutex_t _mutex        = PTHREAD_MUTEX_INITIALIZER;
+static  pthread_mutex_t _mutex_drain  = PTHREAD_MUTEX_INITIALIZER;
+static  pthread_cond_t  _cond_data    = PTHREAD_COND_INITIALIZER;
+
+// Only threads may sleep on the mutex; the kernel and exception handlers write directly.
+static  int   _b8ConBuffered(void){
+  return  _running && !_panic && b8OsIsRunning() && (_b8OsGetCPSR() & 31) == USR_MODE;
+}
+
+// Byte by byte, so a drain interrupted by an exception loses or repeats at most one byte.
+static  void  _b8ConDrain( u32 head ){
+  while( (s32)(head - _tail) > 0 ){
+    B8_FIFO_SCI_TX( SCI_CH ) = (u32)_ring[ _tail & RING_MASK ];
+    ++_tail;
+  }
+}
+
+static  void  _b8ConPush( const char* buf , u32 len ){
+  const u32 pos = _head & RING_MASK;
+  const u32 first = len < B8_CON_RING_SIZE - pos ? len : B8_CON_RING_SIZE - pos;
+  memcpy( &_ring[ pos ] , buf , first );
+  memcpy( &_ring[ 0 ] , buf + first , len - first );
+  _head += len;
+}
+
+static  u32   _b8ConRoom(void){
+  return  B8_CON_RING_SIZE - (_head - _tail);
+}
+
+static  void  _b8ConReportDropped(void){
+  char msg[ 48 ] = "\n[b8con: ";
+  u32 up = strlen( msg );
+
+  char digits[ 10 ];
+  u32 num = 0;
+  u32 value = _dropped_unreported;
+  do {
+    digits[ num++ ] = '0' + value % 10;
+    value /= 10;
+  } while( value );
+  while( num ) msg[ up++ ] = digits[ --num ];
+
+  static const char tail[] = " bytes dropped]\n";
+  memcpy( &msg[ up ] , tail , sizeof(tail) - 1 );
+  up += sizeof(tail) - 1;
+
+  if( _b8ConRoom() < up ) return;
+  _b8ConPush( msg , up );
+  _dropped_unreported = 0;
+}
+
+static  void* _b8ConDrainThread( void* arg ){
+  (void)arg;
+  for(;;){
+    pthread_mutex_lock( &_mutex );
+    while( _tail == _head ) pthread_cond_wait( &_cond_data , &_mutex );
+    const u32 head = _head;
+    pthread_mutex_unlock( &_mutex );
+
+    pthread_mutex_lock( &_mutex_drain );
+    _b8ConDrain( head );
+    pthread_mutex_unlock( &_mutex_drain );
+  }
+  return  NULL;
+}
+
+/**
+ * @brief This is a system function intended to be called only from crt0.c.
+ *
+ * @warning Do not call this function directly.
+ */
+int   b8ConReset(void){
+  if( _running ) return 0;
+
+  pthread_t pid;
+  pthread_attr_t attr;
+  pthread_attr_init( &attr );
+  pthread_attr_setstacksize( &attr, 0x800 );
+
+  struct sched_param param;
+  param.sched_priority = B8_OS_PRIORITY_MIN;
+  pthread_attr_setschedparam( &attr, &param );
+
+  const int ret = pthread_create( &pid, &attr, _b8ConDrainThread, NULL );
+  if( ret != 0 ) return ret;
+  _running = 1;
+  return  0;
+}
+
+size_t  b8ConWrite( const char* buf , size_t len ){
+  if( !_b8ConBuffered() ){
+    _b8ConDrain( _head );
+    for( size_t nn=0 ; nn<len ; ++nn ) B8_FIFO_SCI_TX( SCI_CH ) = (u32)buf[ nn ];
+    return  len;
+  }
+
+  pthread_mutex_lock( &_mutex );
+  if( _dropped_unreported ) _b8ConReportDropped();
+
+  size_t done = 0;
+  if( _policy == B8_CON_DROP ){
+    if( _dropped_unreported || _b8ConRoom() < len ){
+      _dropped += len;
+      _dropped_unreported += len;
+    } else {
+      _b8ConPush( buf , len );
+      done = len;
+    }
+  } else {
+    while( done < len ){
+      u32 room = _b8ConRoom();
+      if( 0 == room ){
+        pthread_mutex_lock( &_mutex_drain );
+        _b8ConDrain( _head );
+        pthread_mutex_unlock( &_mutex_drain );
+        room = _b8ConRoom();
+      }
+      const u32 num = len - done < room ? len - done : room;
+      _b8ConPush( buf + done , num );
+      done += num;
+    }
+  }
+
+  pthread_cond_signal( &_cond_data );
+  pthread_mutex_unlock( &_mutex );
+  return  done;
+}
+
+void  b8ConFlush(void){
+  if( !_b8ConBuffered() ){
+    _b8ConDrain( _head );
+    return;
+  }
+
+  pthread_mutex_lock( &_mutex );
+  pthread_mutex_lock( &_mutex_drain );
+  _b8ConDrain( _head );
+  pthread_mutex_unlock( &_mutex_drain );
+  pthread_mutex_unlock( &_mutex );
+}
+
+void  b8ConPanic(void){
+  _panic = 1;
+  _b8ConDrain( _head );
+}
+
+int   b8ConSetPolicy( int policy ){
+  if( policy != B8_CON_BLOCK && policy != B8_CON_DROP ){
+    return  set_errno( EINVAL );
+  }
+  const int prev = _policy;
+  _policy = policy;
+  return  prev;
+}
+
+u32   b8ConGetDropped(void){
+  return  _dropped;
+}
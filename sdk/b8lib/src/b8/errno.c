@@ -13,6 +13,5 @@ int   set_errno(int errcode){
 
 int   get_errno(void){
   if( ! b8OsIsRunning() ) return 0;
-  b8OsBridgeUsr2Svc* bridge = b8OsSysCall(B8_OS_SYSCALL_GET_ERRNO,0,0,0,0,0,0);
-  return - bridge->errcode;
+  return - b8OsCurrentBridge->errcode;
 }
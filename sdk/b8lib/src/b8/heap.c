@@ -0,0 +1,359 @@
+#include <beep8.h>
+#include <b8/heap.h>
+#include <b8/pthread.h>
+#include <sys/errno.h>
+#include <string.h>
+#include <reent.h>
+
+#define N_SITES       (256)   // a power of 2; sites beyond it are counted as "other"
+#define SITE_OTHER    (N_SITES)
+#define CHUNK_MIN     (16)    // smallest chunk newlib hands out
+#define PREV_INUSE    (1)
+#define SIZE_MASK     (~3u)
+
+extern  void*   __real__malloc_r( struct _reent* r, size_t size );
+extern  void    __real__free_r( struct _reent* r, void* ptr );
+extern  void*   __real_malloc( size_t size );
+extern  void*   __real_calloc( size_t num, size_t size );
+extern  void*   __real_realloc( void* ptr, size_t size );
+extern  void*   _sbrk_r( struct _reent* r, ptrdiff_t incr );
+extern  void    __malloc_lock( struct _reent* r );
+extern  void    __malloc_unlock( struct _reent* r );
+
+extern  char*   __malloc_sbrk_base;   // start of newlib's arena, (char*)-1 until the first sbrk
+extern  void*   __malloc_av_[];       // bin headers; [2] is the top chunk
+extern  u32     __stack_top;
+
+typedef struct {
+  u32 prev_size;
+  u32 size;       // bytes including this header, PREV_INUSE in bit 0
+} Chunk;
+
+typedef struct {
+  const void* ptr;    // NULL if the slot is empty
+  u32         size;
+  u16         site;
+} Track;
+
+typedef struct {
+  const void* addr;
+  u32         count;
+  u32         bytes;
+} Site;
+
+volatile u8     _b8HeapTracking = 0;   // read by slab.c without the lock
+
+static  Track*  _track;
+static  u32     _track_mask;
+static  u32     _track_shift;
+static  u32     _track_max;
+static  Site    _site[ N_SITES + 1 ];
+
+static  u32     _cur_bytes;
+static  u32     _peak_bytes;
+static  u32     _live;
+static  u32     _allocs;
+static  u32     _frame_allocs;
+static  u32     _last_frame_allocs;
+static  u32     _max_frame_allocs;
+static  u32     _dropped;
+
+static  pthread_mutex_t _mutex_track = PTHREAD_MUTEX_INITIALIZER;
+
+static  u32   _b8HeapHash( const void* ptr , u32 shift ){
+  return  ((u32)ptr * 2654435761u) >> shift;
+}
+
+// Slot holding `ptr`, or the empty slot where it would go.
+static  u32   _b8HeapSlot( const void* ptr ){
+  u32 ii = _b8HeapHash( ptr , _track_shift );
+  while( _track[ ii ].ptr && _track[ ii ].ptr != ptr ) ii = (ii + 1) & _track_mask;
+  return  ii;
+}
+
+// Backward-shift deletion, so lookups never need tombstones.
+static  void  _b8HeapRemoveSlot( u32 ii ){
+  _track[ ii ].ptr = NULL;
+  u32 jj = ii;
+  for(;;){
+    jj = (jj + 1) & _track_mask;
+    if( !_track[ jj ].ptr ) return;
+    const u32 home = _b8HeapHash( _track[ jj ].ptr , _track_shift );
+    const int stays = ii <= jj ? (ii < home && home <= jj) : (ii < home || home <= jj);
+    if( stays ) continue;
+    _track[ ii ] = _track[ jj ];
+    _track[ jj ].ptr = NULL;
+    ii = jj;
+  }
+}
+
+static  u16   _b8HeapSiteAdd( const void* addr , u32 size ){
+  u32 ii = SITE_OTHER;
+  if( addr ){
+    u32 probe = _b8HeapHash( addr , 32 - 8 ) & (N_SITES - 1);
+    for( u32 nn=0 ; nn<N_SITES ; ++nn , probe = (probe + 1) & (N_SITES - 1) ){
+      if( _site[ probe ].addr == addr || !_site[ probe ].addr ){
+        _site[ probe ].addr = addr;
+        ii = probe;
+        break;
+      }
+    }
+  }
+  ++_site[ ii ].count;
+  _site[ ii ].bytes += size;
+  return  (u16)ii;
+}
+
+static  void  _b8HeapSiteSub( u16 ii , u32 size ){
+  --_site[ ii ].count;
+  _site[ ii ].bytes -= size;
+}
+
+/**
+ * @brief Record `ptr`, or update its size and site if it is already recorded.
+ *
+ * Called from slab.c while tracking is on.
+ */
+void  _b8HeapOnAlloc( const void* ptr , u32 size , const void* site ){
+  pthread_mutex_lock( &_mutex_track );
+  if( _track ){
+    const u32 ii = _b8HeapSlot( ptr );
+    Track* tr = &_track[ ii ];
+    if( tr->ptr ){
+      _cur_bytes -= tr->size;
+      _b8HeapSiteSub( tr->site , tr->size );
+    } else if( _live >= _track_max ){
+      ++_dropped;
+      tr = NULL;
+    } else {
+      tr->ptr = ptr;
+      ++_live;
+      ++_allocs;
+      ++_frame_allocs;
+    }
+    if( tr ){
+      tr->size = size;
+      tr->site = _b8HeapSiteAdd( site , size );
+      _cur_bytes += size;
+      if( _peak_bytes < _cur_bytes ) _peak_bytes = _cur_bytes;
+    }
+  }
+  pthread_mutex_unlock( &_mutex_track );
+}
+
+/**
+ * @brief Forget `ptr`. Blocks allocated before tracking started are ignored.
+ *
+ * Called from slab.c while tracking is on.
+ */
+void  _b8HeapOnFree( const void* ptr ){
+  pthread_mutex_lock( &_mutex_track );
+  if( _track ){
+    const u32 ii = _b8HeapSlot( ptr );
+    Track* tr = &_track[ ii ];
+    if( tr->ptr ){
+      _cur_bytes -= tr->size;
+      _b8HeapSiteSub( tr->site , tr->size );
+      --_live;
+      _b8HeapRemoveSlot( ii );
+    }
+  }
+  pthread_mutex_unlock( &_mutex_track );
+}
+
+void  b8HeapSetSite( const void* ptr , const void* site ){
+  if( !_b8HeapTracking || !ptr ) return;
+
+  pthread_mutex_lock( &_mutex_track );
+  if( _track ){
+    Track* tr = &_track[ _b8HeapSlot( ptr ) ];
+    if( tr->ptr ){
+      _b8HeapSiteSub( tr->site , tr->size );
+      tr->site = _b8HeapSiteAdd( site , tr->size );
+    }
+  }
+  pthread_mutex_unlock( &_mutex_track );
+}
+
+// malloc(), calloc() and realloc() call the _r functions, so without these
+// every allocation would be reported at newlib's malloc.c.
+void* __wrap_malloc( size_t size ){
+  void* ptr = __real_malloc( size );
+  b8HeapSetSite( ptr , __builtin_return_address( 0 ) );
+  return  ptr;
+}
+
+void* __wrap_calloc( size_t num , size_t size ){
+  void* ptr = __real_calloc( num , size );
+  b8HeapSetSite( ptr , __builtin_return_address( 0 ) );
+  return  ptr;
+}
+
+void* __wrap_realloc( void* ptr , size_t size ){
+  void* newp = __real_realloc( ptr , size );
+  b8HeapSetSite( newp , __builtin_return_address( 0 ) );
+  return  newp;
+}
+
+int   b8HeapTrackEnable( u32 max_allocs ){
+  struct _reent* r = _REENT;
+  Track* table = NULL;
+  u32 shift = 32;
+  if( max_allocs ){
+    if( max_allocs > 0x10000 ) return  set_errno( EINVAL );
+
+    // At least twice as many slots as records keeps the probes short.
+    while( (1u << (32 - shift)) < max_allocs * 2 ) --shift;
+    const u32 bytes = sizeof(Track) << (32 - shift);
+    table = (Track*)__real__malloc_r( r, bytes );
+    if( !table ) return  set_errno( ENOMEM );
+    memset( table, 0, bytes );
+  }
+
+  // The old table is freed after unlocking; newlib's lock must never be taken under ours.
+  pthread_mutex_lock( &_mutex_track );
+  Track* old = _track;
+  _track = table;
+  _track_shift = shift;
+  _track_mask = table ? (1u << (32 - shift)) - 1 : 0;
+  _track_max = max_allocs;
+  memset( _site, 0, sizeof(_site) );
+  _cur_bytes = _peak_bytes = _live = _allocs = 0;
+  _frame_allocs = _last_frame_allocs = _max_frame_allocs = _dropped = 0;
+  _b8HeapTracking = table ? 1 : 0;
+  pthread_mutex_unlock( &_mutex_track );
+
+  if( old ) __real__free_r( r, old );
+  return  0;
+}
+
+void  b8HeapFrame(void){
+  if( !_b8HeapTracking ) return;
+
+  pthread_mutex_lock( &_mutex_track );
+  _last_frame_allocs = _frame_allocs;
+  if( _max_frame_allocs < _frame_allocs ) _max_frame_allocs = _frame_allocs;
+  _frame_allocs = 0;
+  pthread_mutex_unlock( &_mutex_track );
+}
+
+// Walks newlib's chunks from the start of the arena to the top chunk. Slab
+// pages are ordinary allocated chunks here, so their free blocks are not counted.
+static  void  _b8HeapWalk( b8HeapStat* st ){
+  struct _reent* r = _REENT;
+  __malloc_lock( r );
+
+  const u32 end = (u32)_sbrk_r( r, 0 );
+  const u32 limit = (u32)&__stack_top;
+  u32 free_bytes = 0;
+  u32 largest = 0;
+  u32 start = end;
+
+  if( __malloc_sbrk_base != (char*)-1 ){
+    start = (u32)__malloc_sbrk_base;
+    const Chunk* top = (const Chunk*)__malloc_av_[ 2 ];
+
+    // newlib aligns the first chunk so that the block after its header is 8-byte aligned.
+    u32 pp = start;
+    if( (pp + sizeof(Chunk)) & 7 ) pp += 8 - ((pp + sizeof(Chunk)) & 7);
+
+    while( pp < (u32)top ){
+      const u32 size = ((const Chunk*)pp)->size & SIZE_MASK;
+      if( size < CHUNK_MIN || pp + size > (u32)top ) break;
+      const Chunk* next = (const Chunk*)(pp + size);
+      if( !(next->size & PREV_INUSE) ){
+        free_bytes += size;
+        if( largest < size - sizeof(Chunk) ) largest = size - sizeof(Chunk);
+      }
+      pp += size;
+    }
+
+    // The top chunk can be extended up to __stack_top.
+    const u32 top_size = top->size & SIZE_MASK;
+    const u32 room = end < limit ? limit - end : 0;
+    free_bytes += top_size + room;
+    if( largest < top_size + room - sizeof(Chunk) ) largest = top_size + room - sizeof(Chunk);
+  } else {
+    free_bytes = largest = end < limit ? limit - end : 0;
+  }
+  __malloc_unlock( r );
+
+  st->free_bytes   = free_bytes;
+  st->largest_free = largest;
+  st->heap_bytes   = end - start;
+}
+
+void  b8HeapGetStat( b8HeapStat* st ){
+  if( !st ) return;
+
+  memset( st, 0, sizeof(*st) );
+  _b8HeapWalk( st );
+
+  pthread_mutex_lock( &_mutex_track );
+  if( _track ){
+    st->track_cur_bytes        = _cur_bytes;
+    st->track_peak_bytes       = _peak_bytes;
+    st->track_live             = _live;
+    st->track_allocs           = _allocs;
+    st->track_frame_allocs     = _last_frame_allocs;
+    st->track_max_frame_allocs = _max_frame_allocs;
+    st->track_dropped          = _dropped;
+  }
+  pthread_mutex_unlock( &_mutex_track );
+}
+
+static  void  _b8HeapPutField( const char* name , u32 value ){
+  b8SysPuts( " " );
+  b8SysPuts( name );
+  b8SysPuts( "=" );
+  b8SysPutNum( (s32)value );
+}
+
+void  b8HeapDump( u32 max_sites ){
+  b8HeapStat st;
+  b8HeapGetStat( &st );
+
+  b8SysPuts( "B8HEAP" );
+  _b8HeapPutField( "free", st.free_bytes );
+  _b8HeapPutField( "largest", st.largest_free );
+  _b8HeapPutField( "heap", st.heap_bytes );
+  b8SysPutCR();
+  if( !_b8HeapTracking ) return;
+
+  b8SysPuts( "B8HEAP" );
+  _b8HeapPutField( "cur", st.track_cur_bytes );
+  _b8HeapPutField( "peak", st.track_peak_bytes );
+  _b8HeapPutField( "live", st.track_live );
+  _b8HeapPutField( "allocs", st.track_allocs );
+  _b8HeapPutField( "frame", st.track_frame_allocs );
+  _b8HeapPutField( "max_frame", st.track_max_frame_allocs );
+  _b8HeapPutField( "dropped", st.track_dropped );
+  b8SysPutCR();
+
+  // Largest first, by repeated selection; the table is small and this is a debug path.
+  u32 printed[ (N_SITES + 1 + 31) / 32 ];
+  memset( printed, 0, sizeof(printed) );
+  for( u32 nn=0 ; nn<max_sites ; ++nn ){
+    Site site;
+    u32 best = N_SITES + 1;
+    pthread_mutex_lock( &_mutex_track );
+    for( u32 ii=0 ; ii<=N_SITES ; ++ii ){
+      if( !_site[ ii ].count || (printed[ ii >> 5 ] & (1u << (ii & 31))) ) continue;
+      if( best > N_SITES || _site[ best ].bytes < _site[ ii ].bytes ) best = ii;
+    }
+    if( best <= N_SITES ) site = _site[ best ];
+    pthread_mutex_unlock( &_mutex_track );
+    if( best > N_SITES ) break;
+    printed[ best >> 5 ] |= 1u << (best & 31);
+
+    b8SysPuts( "B8HEAP site=" );
+    if( best == SITE_OTHER ){
+      b8SysPuts( "other" );
+    } else {
+      b8SysPutHex( (u32)site.addr );
+    }
+    _b8HeapPutField( "bytes", site.bytes );
+    _b8HeapPutField( "count", site.count );
+    b8SysPutCR();
+  }
+}
@@ -4,7 +4,7 @@
 #include <errno.h>
 
 #define B8_HIF_SCI_CH (15)
-static  sem_t             _sem_touch;
+static  pthread_mutex_t   _mutex_touch = PTHREAD_MUTEX_INITIALIZER;
 static  b8HifEvents       _touch_events;
 static  b8HifMouseStatus  _mouse_status;
 static  u16               _latest_identifier = 0xffff;
@@ -15,11 +15,11 @@ static  u8  _b8HifRecvSci(void){
 }
 
 static  void  _b8HifEventPushBack( b8HifEvent* ev ){
-  if( sem_wait(&_sem_touch) < 0 ) return;
+  if( pthread_mutex_lock(&_mutex_touch) != 0 ) return;
   if (_touch_events.num < B8_HIF_MAX_TOUCH_EVENTS) {
     _touch_events.events[_touch_events.num++] = *ev;
   }
-  sem_post(&_sem_touch);
+  pthread_mutex_unlock(&_mutex_touch);
 }
 
 int b8HifGetEvents(b8HifEvents* result) {
@@ -29,8 +29,8 @@ int b8HifGetEvents(b8HifEvents* result) {
   }
   result->num = 0;
 
-  int ret = sem_wait(&_sem_touch);
-  if (ret < 0) return ret;
+  int ret = pthread_mutex_lock(&_mutex_touch);
+  if (ret != 0) return -ret;
 
   result->num = _touch_events.num;
   if( result->num > 0 ){
@@ -39,8 +39,8 @@ int b8HifGetEvents(b8HifEvents* result) {
 
   _touch_events.num = 0;
 
-  ret = sem_post(&_sem_touch);
-  if( ret < 0 ) return ret;
+  ret = pthread_mutex_unlock(&_mutex_touch);
+  if( ret != 0 ) return -ret;
 
   return 0;
 }
@@ -48,10 +48,10 @@ int b8HifGetEvents(b8HifEvents* result) {
 static  void* _b8HifRecvThread(void* arg ){
   (void)arg;
 
-  sem_wait( &_sem_touch );
+  pthread_mutex_lock( &_mutex_touch );
   memset( &_touch_events, 0x00 , sizeof( b8HifEvents ) );
   _touch_events.num = 0;
-  sem_post( &_sem_touch );
+  pthread_mutex_unlock( &_mutex_touch );
 
   B8_HIF_TOUCH_CONNECT = B8_HIF_SCI_CH;
   B8_HIF_TOUCH_CTRL = 1;
@@ -144,9 +144,6 @@ int  b8HifReset(void){
     _mouse_status.mouse_x = _mouse_status.mouse_y = 0;
     _mouse_status.is_dragging = 0;
 
-    int ret = sem_init(&_sem_touch,0,1);
-    if( ret < 0 ) return ret;
-
     pthread_t pid;
     pthread_attr_t attr;
     pthread_attr_init(&attr);
@@ -5,16 +5,35 @@
 #include <sys/errno.h>
 
 #define CONFIG_N_MAX_THREAD_POW2      (5)
-#define CONFIG_BYTESIZE_OF_HEAP       (8*1024)
 #define CONFIG_N_MAX_SEMAPHORE_POW2   (6)
+#define CONFIG_N_MAX_MUTEX_POW2       (5)
+#define CONFIG_N_MAX_COND_POW2        (5)
 #define CONFIG_BYTESIZE_OF_STACK_IDLE_THREAD  (0x100)
 #define CONFIG_BYTESIZE_OF_STACK_MAIN_THREAD  (0x2000)
+#define CONFIG_TICK_HZ                (100)
+#define CONFIG_N_TRACE_POW2           (9)
+
+// Longest tickless sleep. Keeps the 32bit DWT cycle counter from wrapping
+// between two visits of the scheduler.
+#define CONFIG_TICKLESS_MAX_USEC      (1000000)
+
+// Round robin time slice.
+#define SLICE_USEC      (1000000 / CONFIG_TICK_HZ)
 
 #define N_MAX_THREAD    (1<<CONFIG_N_MAX_THREAD_POW2)
 #define N_MAX_SEMAPHORE (1<<CONFIG_N_MAX_SEMAPHORE_POW2)
+#define N_MAX_MUTEX     (1<<CONFIG_N_MAX_MUTEX_POW2)
+#define N_MAX_COND      (1<<CONFIG_N_MAX_COND_POW2)
+#define N_TRACE         (1<<CONFIG_N_TRACE_POW2)
 
 #define B8_OS_BRIDGE_USR2SVC_SIGNATURE  (0xbeafface)
 
+// Bottom of every kernel allocated stack, checked on each switch.
+#define STACK_GUARD       (0x8badf00d)
+#define STACK_GUARD_WORDS (2)
+// Fill of unused stack, for the high-water mark.
+#define STACK_PAINT       (0xa5a5a5a5)
+
 // arm mode
 #define USR_MODE  (0x10)
 #define IRQ_MODE  (0x12)
@@ -28,6 +47,7 @@
 #define REG_MAX (17)
 
 typedef u64 b8OsUsec;         // usec
+#define USEC_NEVER  (0xffffffffffffffff)
 
 extern  void  _b8OsSvc2Usr(void);
 extern  void  _b8OsIrq2Usr(void);
@@ -117,25 +137,57 @@ static  void* _b8OsCastU32(u32 uptr ){
   return cast.data._p32;
 }
 
-typedef struct _Node        Node;
-typedef struct _List        List;
 typedef struct _Tcb         Tcb;
 typedef struct _Semaphore   Semaphore;
+typedef struct _Mutex       Mutex;
+typedef struct _Cond        Cond;
 typedef struct _ReqSchedule ReqSchedule;
 
+// Header written at the bottom of a free stack block.
+typedef struct _FreeStack {
+  struct _FreeStack*  next;
+  size_t              size;
+} FreeStack;
+
 typedef enum {
   TS_NOT_YET_INIT,
   TS_READY,
+  TS_ZOMBIE,        // exited, waiting for pthread_join()
 } TcbStatus;
 
+// Same values as B8_OS_TRACE_WAIT_*.
 typedef enum {
   TWF_NOTHING,
-  TWF_SEMAPHORE,
-  TWF_YIELD,
-  TWF_TIMER,
-  TWF_IRQ
+  TWF_SEMAPHORE = B8_OS_TRACE_WAIT_SEMAPHORE,
+  TWF_TIMER     = B8_OS_TRACE_WAIT_TIMER,
+  TWF_IRQ       = B8_OS_TRACE_WAIT_IRQ,
+  TWF_MUTEX     = B8_OS_TRACE_WAIT_MUTEX,
+  TWF_JOIN      = B8_OS_TRACE_WAIT_JOIN,
+  TWF_COND      = B8_OS_TRACE_WAIT_COND
 } TcbWaitingFor;
 
+// Index into _TaskControlBlocks[], used to link TCBs into queues.
+typedef u8  TcbIdx;
+#define TCB_IDX_NONE  (0xff)
+
+// Index into _Mutexes[].
+typedef u8  MutexIdx;
+#define MUTEX_IDX_NONE  (0xff)
+
+// Index into _Conds[].
+typedef u8  CondIdx;
+#define COND_IDX_NONE   (0xff)
+
+/*
+  Intrusive FIFO of TCBs linked through Tcb::q_next/q_prev.
+  A thread sits in at most one queue at a time: either the ready queue of
+  its priority, or the wait queue of the object it is blocked on.
+*/
+typedef struct _TcbQueue {
+  TcbIdx  head;
+  TcbIdx  tail;
+} TcbQueue;
+
 struct _Tcb {
   u32       reg[ REG_MAX ];
   b8OsPid   pid;
@@ -143,18 +195,58 @@ struct _Tcb {
   void*     arg;
   void*     stack_addr;
   size_t    stack_size;
+  void*     stack_alloc;      // top of the block from _b8OsStackAlloc(), NULL for a user stack
+  size_t    stack_alloc_size;
+  void*     exit_value;
   b8OsSid   sid_wait;
   TcbStatus status;
   TcbWaitingFor waiting_for;
-  u8        mode_when_saved;  // MODE_SVC or MODE_IRQ
   u8        scheduling_policy;
   u16       irq;
-  b8OsUsec  wake_up_time;
+  b8OsUsec  wake_up_time;     // deadline on the _AccumelatedTime clock
+  b8OsUsec  slice_end;        // end of the round robin slice, in tickless mode
+  u64       cpu_cycles;       // CPU time, accounted at every scheduler pass
+  u8        priority;         // B8_OS_PRIORITY_*, including inheritance
+  u8        base_priority;    // set by pthread_create() / pthread_setschedparam()
+  MutexIdx  mutex_held;       // contended mutexes owned by this thread
+  MutexIdx  mutex_wait;
+  CondIdx   cond_wait;
+  u8        detached;         // released by the kernel as soon as it exits
+  TcbIdx    joiner;           // thread sleeping in pthread_join() on this one
+  u8        is_ready;         // linked into _ReadyQueue[ priority ]
+  u8        is_timed;         // linked into _TimerQueue
+  TcbIdx    q_next;
+  TcbIdx    q_prev;
+  TcbIdx    t_next;
+  TcbIdx    t_prev;
 };
 
 struct _Semaphore {
-  b8OsSid sid;
-  int     semcount;
+  b8OsSid   sid;
+  int       semcount;
+  TcbQueue  waiters;  // sorted by priority, FIFO among equals
+};
+
+/*
+  Kernel side of a contended pthread mutex. The lock itself lives in user
+  memory (b8OsMutex) and is taken without a syscall; an entry here only
+  exists while some thread sleeps on it.
+*/
+struct _Mutex {
+  b8OsMutex*  umutex;     // NULL : free entry
+  Tcb*        owner;      // receives the priority of the first waiter
+  TcbQueue    waiters;    // sorted by priority, FIFO among equals
+  MutexIdx    next_held;  // next mutex in owner->mutex_held
+};
+
+/*
+  Kernel side of a pthread condition variable, keyed by the address of its
+  b8OsCond word like _Mutex. An entry only exists while some thread sleeps
+  on it.
+*/
+struct _Cond {
+  b8OsCond*   ucond;      // NULL : free entry
+  TcbQueue    waiters;    // sorted by priority, FIFO among equals
 };
 
 typedef int (*b8IrqHandler)(int irq, void* arg);
@@ -172,12 +264,18 @@ typedef struct _b8OsIrqInfo {
 #define REQ_SCHEDULE_YIELD                              (1<<5)
 #define REQ_SCHEDULE_YIELD_TIME                         (1<<6)
 #define REQ_SCHEDULE_EXIT_THREAD                        (1<<7)
+#define REQ_SCHEDULE_PREEMPT                            (1<<8)
+#define REQ_SCHEDULE_MUTEX_WAIT                         (1<<9)
+#define REQ_SCHEDULE_JOIN                               (1<<10)
+#define REQ_SCHEDULE_COND_WAIT                          (1<<11)
 
 struct _ReqSchedule{
   u16       req; // REQ_SCHEDULE_*
   b8OsSid   sid;
   b8OsPid   pid;
   u16       irq;
+  MutexIdx  mutex;
+  CondIdx   cond;
   b8OsUsec  sleep_time;
 };
 static  void  ReqScheduleClear(ReqSchedule* rs){
@@ -186,6 +284,8 @@ static  void  ReqScheduleClear(ReqSchedule* rs){
   rs->sid = B8_OS_INVALID_SID;
   rs->pid = B8_OS_INVALID_PID;
   rs->irq = B8_OS_NOT_USING_IRQ;
+  rs->mutex = MUTEX_IDX_NONE;
+  rs->cond = COND_IDX_NONE;
   rs->sleep_time = 0;
 }
 
@@ -196,6 +296,7 @@ static  void  _b8OsProcessScheduler(ReqSchedule* rs);
 static  b8OsBridgeUsr2Svc*  TcbGetBridge( b8OsPid pid );
 static  int   _b8OsIrqAttach(int irq,b8IrqHandler isr,void* arg);
 static  void  _b8OsGiveBridgeToUsr(void);
+static  void  _b8OsAwakeTcb( Tcb* tcb );
 
 static  b8OsIrqInfo _IrqInfo[ B8_IRQ_NUM_OF_INTERRUPTS ];
 static  b8OsPid     _IdlePid;
@@ -204,13 +305,18 @@ static  uint32_t    _AccThread;
 static  uint32_t    _AccSemaphore;
 static  Tcb         _TaskControlBlocks[ N_MAX_THREAD ];
 static  Semaphore   _Semaphores[ N_MAX_SEMAPHORE ];
-static  u8          _MemoryPool[ CONFIG_BYTESIZE_OF_HEAP ];
-static  u32         _UpMemoryPool;
-static  List*       _ReadyTasksList;
-static  List*       _WaitingTasksList;
-static  List*       _ZombieTasksList;
+static  Mutex       _Mutexes[ N_MAX_MUTEX ];
+static  Cond        _Conds[ N_MAX_COND ];
+static  TcbQueue    _ReadyQueue[ B8_OS_PRIORITY_NUM ];
+static  u32         _ReadyBitmap;   // bit n : _ReadyQueue[ n ] is not empty
+static  Tcb*        _IrqWaiter[ B8_IRQ_NUM_OF_INTERRUPTS ];
+static  b8OsSid     _IrqSem[ B8_IRQ_NUM_OF_INTERRUPTS ];   // posted by _b8OsIrqDispatch
+static  TcbQueue    _TimerQueue;    // sleepers and sem_timedwait() waiters, by wake_up_time
+static  TcbQueue    _ZombieQueue;   // exited joinable threads
 static  b8OsConfig  _Config;
 static  size_t      _UpStackPool;
+static  size_t      _StackPoolUsed;
+static  size_t      _StackPoolPeak;
 static  b8OsUsec    _AccumelatedTime;
 static  u64         _UsPerCpuCycleFixed8;
 static  u16         _IrqTimer;
@@ -220,12 +326,53 @@ static  u64         _UnixEpochTimeMilliseconds;
 static  u64         _UnixEpochTimeCycles;
 static  b8OsUsec    _UnixEpochTimeMicroseconds;
 static  u32         _ClockResolutionNs;
+static  b8OsUsec    _TimerDeadline; // one-shot timer programmed for, in tickless mode
 static  u8          _IsRunning = 0;
 
-u32 b8OsUsrContext   [ REG_MAX ];
+/*
+  Trace ring. Only the kernel writes it, and the kernel is never
+  re-entered, so recording needs no lock. Readers in user mode copy
+  entries and check _TraceHead again afterwards to drop the ones that
+  were overwritten meanwhile.
+*/
+static  b8OsTraceEvent  _Trace[ N_TRACE ];
+static  volatile u32    _TraceHead;     // number of events ever recorded
+static  volatile u8     _TraceEnabled;
+
+/*
+  Bumped at every scheduler pass. User mode reads the clocks without a
+  syscall and retries when the kernel ran in the middle of the read.
+*/
+static  volatile u32  _SchedGeneration;
+
+// Saves the user context of the boot code until the first thread switch.
+static  u32 _BootContext[ REG_MAX ];
+
+volatile b8OsPid b8OsCurrentPid;
+b8OsBridgeUsr2Svc* volatile b8OsCurrentBridge;
+u32* b8OsUsrContext = _BootContext; // reg[] of the running thread, see bootloader.S
 u32 b8OsSysCallArgs  [ 1+6 ];
 
+static  int   _b8OsIsTickless(void){
+  return  _Config.ArchDriverSetTimerOneShot != NULL;
+}
+
+static  void  _b8OsTrace( u8 type , b8OsPid pid , u32 arg ){
+  if( !_TraceEnabled )  return;
+  u32 cyccnt;
+  _Config.ArchDriverGetCycle( &cyccnt );
+
+  b8OsTraceEvent* ev = &_Trace[ _TraceHead & (N_TRACE-1) ];
+  ev->cycle = (u32)_CycCnt + cyccnt;
+  ev->pid = pid;
+  ev->arg = (u16)arg;
+  ev->type = type;
+  ev->reserved = 0;
+  _TraceHead = _TraceHead + 1;
+}
+
 static  void  _b8OsSwitchBackToUsr(void){
+  _b8OsTrace( B8_OS_TRACE_RETURN , _CurrentPid , 0 );
   switch( _b8OsGetCPSRMode() ){
     case  IRQ_MODE:{
       B8_PIC_EOIR = _IrqDispatched;
@@ -240,152 +387,258 @@ static  void  _b8OsSwitchBackToUsr(void){
   // It won't get here
 }
 
-static  void*   _b8OsKernelMalloc( size_t byte_ ){
-  byte_ += 3;
-  byte_ -= byte_ & 3;
+/*
+  Thread stacks come from the pool given by crt0 (b8OsConfig::StackTop).
+  A request is rounded up to a size class, and a freed block goes onto
+  the free list of its class for the next thread of that size. Classes
+  grow by 1.5x and 2x alternately, so at most a third is wasted. A block
+  larger than every class is kept on _FreeStacks[ N_STACK_CLASS ] and
+  reused first fit. The block at the top of the pool is given back to it
+  directly.
+*/
+static  const size_t _StackClass[] = {
+  0x100,  0x180,  0x200,  0x300,  0x400,  0x600,  0x800,  0xc00,
+  0x1000, 0x1800, 0x2000, 0x3000, 0x4000, 0x6000, 0x8000, 0xc000,
+  0x10000
+};
+#define N_STACK_CLASS (sizeof(_StackClass)/sizeof(_StackClass[0]))
+static  FreeStack*  _FreeStacks[ N_STACK_CLASS + 1 ];
 
-  u32 up = _UpMemoryPool;
-  _UpMemoryPool += byte_;
-  KPANIC( _UpMemoryPool <= CONFIG_BYTESIZE_OF_HEAP  , "out of memory" );
-  return &_MemoryPool[ up ];
+static  size_t  _b8OsStackClass( size_t byte_ ){
+  size_t cls = 0;
+  while( cls < N_STACK_CLASS && _StackClass[ cls ] < byte_ ) ++cls;
+  return cls;
 }
 
-static  void*   _b8OsStackAlloc( size_t byte_ ){
+static  void*   _b8OsStackBase( void* top , size_t byte_ ){
+  return  (u8*)top - byte_;
+}
+
+// Returns the top of a block of at least byte_ bytes, and its real size in *block_size.
+static  void*   _b8OsStackAlloc( size_t byte_ , size_t* block_size ){
   byte_ += 7;
   byte_ -= byte_ & 7;
 
-  if( _UpStackPool + byte_ > _Config.StackSize )  return NULL;
+  const size_t cls = _b8OsStackClass( byte_ );
+  if( cls < N_STACK_CLASS ) byte_ = _StackClass[ cls ];
+
+  FreeStack** link = &_FreeStacks[ cls ];
+  while( *link && (*link)->size < byte_ ) link = &(*link)->next;
 
-  _UpStackPool += byte_;
-  return _Config.StackTop + _UpStackPool;
+  void* top = NULL;
+  if( *link ){
+    FreeStack* blk = *link;
+    *link = blk->next;
+    byte_ = blk->size;
+    top = (u8*)blk + byte_;
+  } else {
+    if( _UpStackPool + byte_ > _Config.StackSize )  return NULL;
+    _UpStackPool += byte_;
+    top = (u8*)_Config.StackTop + _UpStackPool;
+  }
+
+  _StackPoolUsed += byte_;
+  if( _StackPoolUsed > _StackPoolPeak ) _StackPoolPeak = _StackPoolUsed;
+  *block_size = byte_;
+  return top;
 }
 
-struct _Node {
-  Node*   _next;
-  Node*   _prev;
-  b8OsPid pid;
-};
-static  void  NodeClear(Node* node){
-  node->_next = node->_prev = NULL;
-  node->pid = B8_OS_INVALID_PID;
+static  void    _b8OsStackFree( void* top , size_t byte_ ){
+  _StackPoolUsed -= byte_;
+  if( top == (u8*)_Config.StackTop + _UpStackPool ){
+    _UpStackPool -= byte_;
+    return;
+  }
+  FreeStack* blk = _b8OsStackBase( top , byte_ );
+  FreeStack** head = &_FreeStacks[ _b8OsStackClass( byte_ ) ];
+  blk->size = byte_;
+  blk->next = *head;
+  *head = blk;
+}
+
+// Paints the block for the high-water mark and puts the guard at its bottom.
+static  void    _b8OsStackPaint( void* top , size_t byte_ ){
+  u32* word = _b8OsStackBase( top , byte_ );
+  const size_t n = byte_ / sizeof(u32);
+  for( size_t nn=0 ; nn<n ; ++nn ){
+    word[ nn ] = nn < STACK_GUARD_WORDS ? STACK_GUARD : STACK_PAINT;
+  }
 }
 
-struct _List {
-  u16   _size;
-  u16   _maxnum;
-  Node* _node_array;
-};
+static  void  _b8OsChkStackGuard( Tcb* tcb ){
+  if( NULL == tcb->stack_alloc )  return;
+  const u32* guard = _b8OsStackBase( tcb->stack_alloc , tcb->stack_alloc_size );
+  for( size_t nn=0 ; nn<STACK_GUARD_WORDS ; ++nn ){
+    if( guard[ nn ] != STACK_GUARD ){
+      b8SysPuts( "pid=0x" );
+      b8SysPutHex( tcb->pid );
+      b8SysPutCR();
+      KPANIC( 0 , "stack overflow" );
+    }
+  }
+}
 
-static  Node*   ListHead(List* list);
-static  Node*   ListEnd(List* list);
-static  Node*   ListBegin(List* list);
-static  Node*   ListAllocNode(List* list);
-static  void    ListPushBack(List* list,uint32_t x_ );
-static  Node*   ListErase(List* list,uint32_t x_ );
-static  Node*   ListBack(List* list);
-static  size_t  ListSize(List* list);
-static  List*   NewList( size_t maxnum_ );
-static  Node*   ListAt(List* list,u32 nn);
+// Bytes of the stack ever touched, found from the paint left at its bottom.
+static  size_t  _b8OsStackHighWater( Tcb* tcb ){
+  const u32* word = _b8OsStackBase( tcb->stack_alloc , tcb->stack_alloc_size );
+  const size_t n = tcb->stack_alloc_size / sizeof(u32);
+  size_t nn = STACK_GUARD_WORDS;
+  while( nn < n && word[ nn ] == STACK_PAINT ) ++nn;
+  return  (n - nn) * sizeof(u32);
+}
 
-/*
-  [head]->[begin]->[]->...[]->[end]
-*/
-static  Node* ListHead(List* list){
-  return  &(list->_node_array[0]);
+static  TcbIdx  TcbToIdx( Tcb* tcb ){
+  return  (TcbIdx)(tcb - _TaskControlBlocks);
 }
 
-static  Node* ListEnd(List* list){
-  return  &(list->_node_array[ list->_maxnum+2-1 ]);
+static  void  TcbQueueClear( TcbQueue* q ){
+  q->head = q->tail = TCB_IDX_NONE;
 }
 
-static  Node* ListBegin(List* list){
-  return  ListHead(list)->_next;
+static  Tcb*  TcbQueueFront( TcbQueue* q ){
+  if( q->head == TCB_IDX_NONE ) return NULL;
+  return &_TaskControlBlocks[ q->head ];
 }
 
-static  Node* ListAllocNode(List* list){
-  for( u16 nn=0 ; nn<= list->_maxnum ; ++nn ){
-    Node* node = &(list->_node_array[ nn+1 ]);
-    if( node->_next ) continue;
-    if( node->_prev ) continue;
-    return node;
+static  void  TcbQueueInsertBefore( TcbQueue* q, Tcb* pos, Tcb* tcb ){
+  const TcbIdx idx = TcbToIdx( tcb );
+  if( NULL == pos ){
+    tcb->q_next = TCB_IDX_NONE;
+    tcb->q_prev = q->tail;
+    if( q->tail == TCB_IDX_NONE ){
+      q->head = idx;
+    } else {
+      _TaskControlBlocks[ q->tail ].q_next = idx;
+    }
+    q->tail = idx;
+    return;
   }
-  return NULL;
-}
 
-Node*   ListAt(List* list,u32 nn){
-  if( nn >= ListSize(list) )  return NULL;
-  Node* node = ListBegin( list );
-  for( u32 ii=0 ; ii<nn ; ++ii ){
-    node = node->_next;
+  tcb->q_next = TcbToIdx( pos );
+  tcb->q_prev = pos->q_prev;
+  if( pos->q_prev == TCB_IDX_NONE ){
+    q->head = idx;
+  } else {
+    _TaskControlBlocks[ pos->q_prev ].q_next = idx;
   }
-  return node;
+  pos->q_prev = idx;
 }
 
-static  void  ListPushBack(List* list,uint32_t x_ ){
-  Node* node = ListAllocNode(list);
-  KPANIC(node,"failed alloc node");
-  KPANIC( ListSize(list) < list->_maxnum , "too many container" );
-  list->_size++;
-
-  Node* end  = ListEnd(list);
-  Node* back = ListBack(list);
-  back->_next = node;
-  end->_prev  = node;
-  node->_prev = back;
-  node->_next = end;
+static  void  TcbQueuePushBack( TcbQueue* q, Tcb* tcb ){
+  TcbQueueInsertBefore( q , NULL , tcb );
+}
 
-  node->pid = x_;
+// Keeps the queue sorted by priority, FIFO among equal priorities.
+static  void  TcbQueueInsertByPriority( TcbQueue* q, Tcb* tcb ){
+  Tcb* pos = TcbQueueFront( q );
+  while( pos && pos->priority >= tcb->priority ){
+    pos = pos->q_next == TCB_IDX_NONE ? NULL : &_TaskControlBlocks[ pos->q_next ];
+  }
+  TcbQueueInsertBefore( q , pos , tcb );
 }
 
-static  Node* ListErase(List* list,uint32_t x_ ){
-  Node* it;
-  for(
-    it =  ListBegin( list ) ;
-    it != ListEnd( list ) ;
-    it = it->_next
-  ){
-    if(it->pid != x_ )  continue;
+static  void  TcbQueueErase( TcbQueue* q, Tcb* tcb ){
+  if( tcb->q_prev == TCB_IDX_NONE ){
+    q->head = tcb->q_next;
+  } else {
+    _TaskControlBlocks[ tcb->q_prev ].q_next = tcb->q_next;
+  }
+  if( tcb->q_next == TCB_IDX_NONE ){
+    q->tail = tcb->q_prev;
+  } else {
+    _TaskControlBlocks[ tcb->q_next ].q_prev = tcb->q_prev;
+  }
+  tcb->q_next = tcb->q_prev = TCB_IDX_NONE;
+}
 
-    Node* prev = it->_prev;
-    Node* next = it->_next;
-    prev->_next = next;
-    next->_prev = prev;
-    list->_size--;
+// Index of the most significant set bit. ARMv4 has no CLZ.
+static  u32 _b8OsBitmapHighest( u32 bitmap ){
+  static  const u8 msb4[ 16 ] = { 0,0,1,1,2,2,2,2,3,3,3,3,3,3,3,3 };
+  u32 n = 0;
+  if( bitmap & 0xffff0000 ){ n += 16; bitmap >>= 16; }
+  if( bitmap & 0x0000ff00 ){ n +=  8; bitmap >>=  8; }
+  if( bitmap & 0x000000f0 ){ n +=  4; bitmap >>=  4; }
+  return  n + msb4[ bitmap ];
+}
 
-    NodeClear( it );
-    return next;
-  }
-  return it; // = ListEnd()
+static  void  ReadyPushBack( Tcb* tcb ){
+  KPANIC( !tcb->is_ready , "already ready" );
+  TcbQueuePushBack( &_ReadyQueue[ tcb->priority ] , tcb );
+  _ReadyBitmap |= 1u << tcb->priority;
+  tcb->is_ready = 1;
 }
 
-static  Node*  ListBack(List* list){
-  return  ListEnd(list)->_prev;
+static  void  ReadyErase( Tcb* tcb ){
+  if( !tcb->is_ready )  return;
+  TcbQueue* q = &_ReadyQueue[ tcb->priority ];
+  TcbQueueErase( q , tcb );
+  if( q->head == TCB_IDX_NONE ){
+    _ReadyBitmap &= ~(1u << tcb->priority);
+  }
+  tcb->is_ready = 0;
 }
 
-static  size_t  ListSize(List* list){
-  return  (size_t)list->_size;
+// Moves tcb behind the other threads of the same priority.
+static  void  ReadyRotate( Tcb* tcb ){
+  if( !tcb->is_ready )  return;
+  ReadyErase( tcb );
+  ReadyPushBack( tcb );
 }
 
-static  List* NewList( size_t maxnum_ ){
-  List* list = _b8OsKernelMalloc( sizeof( List ) );
-  list->_size = 0;
-  list->_maxnum = maxnum_;
-  const u16 array_num = list->_maxnum+2;
-  list->_node_array = _b8OsKernelMalloc( array_num * sizeof( Node ));
-  for( uint16_t ii=0 ; ii < array_num ; ++ii ){
-    NodeClear( &(list->_node_array[ ii ]) );
+/*
+  _TimerQueue is kept sorted by wake_up_time so that the tick only has to
+  look at its head. Most sleeps are for similar periods, so the insertion
+  point is searched from the tail.
+*/
+static  void  TimerInsert( Tcb* tcb ){
+  KPANIC( !tcb->is_timed , "already timed" );
+  const TcbIdx idx = TcbToIdx( tcb );
+  TcbIdx prev = _TimerQueue.tail;
+  while( prev != TCB_IDX_NONE &&
+         _TaskControlBlocks[ prev ].wake_up_time > tcb->wake_up_time ){
+    prev = _TaskControlBlocks[ prev ].t_prev;
   }
 
-  Node* head = ListHead( list );
-  Node* end = ListEnd( list );
+  tcb->t_prev = prev;
+  if( prev == TCB_IDX_NONE ){
+    tcb->t_next = _TimerQueue.head;
+    _TimerQueue.head = idx;
+  } else {
+    tcb->t_next = _TaskControlBlocks[ prev ].t_next;
+    _TaskControlBlocks[ prev ].t_next = idx;
+  }
+  if( tcb->t_next == TCB_IDX_NONE ){
+    _TimerQueue.tail = idx;
+  } else {
+    _TaskControlBlocks[ tcb->t_next ].t_prev = idx;
+  }
+  tcb->is_timed = 1;
+}
 
-  head->_next = end;
-  head->_prev = NULL;
+static  void  TimerErase( Tcb* tcb ){
+  if( !tcb->is_timed )  return;
+  if( tcb->t_prev == TCB_IDX_NONE ){
+    _TimerQueue.head = tcb->t_next;
+  } else {
+    _TaskControlBlocks[ tcb->t_prev ].t_next = tcb->t_next;
+  }
+  if( tcb->t_next == TCB_IDX_NONE ){
+    _TimerQueue.tail = tcb->t_prev;
+  } else {
+    _TaskControlBlocks[ tcb->t_next ].t_prev = tcb->t_prev;
+  }
+  tcb->t_next = tcb->t_prev = TCB_IDX_NONE;
+  tcb->is_timed = 0;
+}
 
-  end->_next = NULL;
-  end->_prev = head;
+static  Tcb*  TimerFront(void){
+  if( _TimerQueue.head == TCB_IDX_NONE ) return NULL;
+  return &_TaskControlBlocks[ _TimerQueue.head ];
+}
 
-  return list;
+static  Tcb*  ReadyHighest(void){
+  KPANIC( _ReadyBitmap , "no ready thread" );
+  return  TcbQueueFront( &_ReadyQueue[ _b8OsBitmapHighest( _ReadyBitmap ) ] );
 }
 
 extern  int usleep(useconds_t useconds);
@@ -399,9 +652,6 @@ static  void* _b8MainThread( void* arg ){
   b8SysPuts( "_b8MainThread:\n" );
 
   (void)arg;
-  int ret = sem_init(_Config.sem_heap, 0, 1);
-  KPANIC( ret >= 0 , "sem_init()" );
-
   FILE* fpo = fopen("stdout","w");
   KPANIC( fpo  , "failed open stdout" );
 
@@ -419,8 +669,8 @@ static  void* _b8MainThread( void* arg ){
 
 static  void* _b8OsCommonEntryPoint( void* arg ){
   Tcb* tcb_cur = _b8OsGetCurrentTcb();
-  tcb_cur->start_routine( arg );
-  b8OsSysCall( B8_OS_SYSCALL_EXIT, 0, 0, 0, 0, 0,0);
+  void* value = tcb_cur->start_routine( arg );
+  b8OsSysCall( B8_OS_SYSCALL_EXIT, _b8OsCastPtr( value ), 0, 0, 0, 0,0);
   KPANIC(0, "Unexpected return from b8OsSysCall");
   return NULL;
 }
@@ -469,10 +719,19 @@ static  void  TcbClear( Tcb* tcb ){
   tcb->stack_size = 0x100;
   tcb->status = TS_NOT_YET_INIT;
   tcb->sid_wait = B8_OS_INVALID_SID;
-  tcb->mode_when_saved = 0x00;
   tcb->irq = B8_OS_NOT_USING_IRQ;
   tcb->waiting_for = TWF_NOTHING;
   tcb->wake_up_time = 0;
+  tcb->priority = B8_OS_PRIORITY_DEFAULT;
+  tcb->base_priority = B8_OS_PRIORITY_DEFAULT;
+  tcb->mutex_held = MUTEX_IDX_NONE;
+  tcb->mutex_wait = MUTEX_IDX_NONE;
+  tcb->cond_wait = COND_IDX_NONE;
+  tcb->joiner = TCB_IDX_NONE;
+  tcb->is_ready = 0;
+  tcb->is_timed = 0;
+  tcb->q_next = tcb->q_prev = TCB_IDX_NONE;
+  tcb->t_next = tcb->t_prev = TCB_IDX_NONE;
 }
 
 static  b8OsBridgeUsr2Svc*  TcbGetBridgeAddr( Tcb* tcb ){
@@ -495,46 +754,11 @@ static  void  TcbInit( Tcb* tcb ){
 
   Cast cast;
   cast.data._p32 = _b8OsCommonEntryPoint;
-  tcb->reg[ REG_15PC ] = cast.data._u32 + 4;
-  tcb->mode_when_saved = IRQ_MODE;
+  tcb->reg[ REG_15PC ] = cast.data._u32;
   tcb->reg[ REG_PSR  ] = USR_MODE;
   tcb->status = TS_READY;
 }
 
-static  void  UsrContext2Tcb( Tcb* tcb ){
-  tcb->mode_when_saved = _b8OsGetCPSRMode();
-  for( u8 reg=REG_0 ; reg < REG_MAX ; ++reg ){
-    tcb->reg[ reg ] = b8OsUsrContext[ reg ];
-  }
-}
-
-static  void  Tcb2UsrContext( Tcb* tcb ){
-  for( u8 reg=REG_0 ; reg < REG_MAX ; ++reg ){
-    if( reg == REG_15PC ){
-      const u32 cpsr_mode =_b8OsGetCPSRMode();
-      if( cpsr_mode != tcb->mode_when_saved ){
-        if(
-          tcb->mode_when_saved == SVC_MODE &&
-          cpsr_mode == IRQ_MODE
-        ){
-          b8OsUsrContext[ reg ] = tcb->reg[ reg ] + 4;
-        } else if (
-          tcb->mode_when_saved == IRQ_MODE &&
-          cpsr_mode == SVC_MODE
-        ){
-          b8OsUsrContext[ reg ] = tcb->reg[ reg ] - 4;
-        } else {
-          KPANIC(0,"unknown cpsr_mode");
-        }
-      } else {
-        b8OsUsrContext[ reg ] = tcb->reg[ reg ];
-      }
-    } else {
-      b8OsUsrContext[ reg ] = tcb->reg[ reg ];
-    }
-  }
-}
-
 static  b8OsPid _b8OsAllocTcb(void){
   for( size_t nn=0 ; nn<N_MAX_THREAD ; ++nn ){
     if( _TaskControlBlocks[ nn ].pid != B8_OS_INVALID_PID )  continue;
@@ -542,6 +766,8 @@ static  b8OsPid _b8OsAllocTcb(void){
     TcbClear( &_TaskControlBlocks[ nn ] );
     _TaskControlBlocks[ nn ].pid = (_AccThread<<16) | (u32)nn;
     ++_AccThread;
+    // Slots are reused, so the upper half must never wrap to 0.
+    if( 0 == (_AccThread & 0xffff) ) _AccThread = 1;
     return  _TaskControlBlocks[ nn ].pid;
   }
   return  B8_OS_INVALID_PID;
@@ -550,6 +776,7 @@ static  b8OsPid _b8OsAllocTcb(void){
 static  void  SemaphoreClear( Semaphore* sem ){
   memset( sem , 0 , sizeof(Semaphore) );
   sem->sid = B8_OS_INVALID_SID;
+  TcbQueueClear( &sem->waiters );
 }
 
 static  Semaphore*  _b8OsGetSemaphore( b8OsSid sid ){
@@ -648,6 +875,15 @@ static  Tcb*  _b8OsGetTcb( b8OsPid pid ){
   return &_TaskControlBlocks[ idx ];
 }
 
+static  int   _b8OsIrqInUse( u32 irq ){
+  if( _IrqSem[ irq ] != B8_OS_INVALID_SID ) return 1;
+  for( size_t nn=0 ; nn<N_MAX_THREAD ; ++nn ){
+    if( _TaskControlBlocks[ nn ].pid != B8_OS_INVALID_PID &&
+        _TaskControlBlocks[ nn ].irq == irq ) return 1;
+  }
+  return 0;
+}
+
 static  int  _b8OsThreadCreate(
   b8OsPid*  ppid ,
   void*     StackAddr,
@@ -655,11 +891,22 @@ static  int  _b8OsThreadCreate(
   void*     (*StartRoutine)(void*),
   void*     Arg,
   u32       SchedulingPolicy,
-  u32       IrqNo
+  u32       Priority,
+  u32       IrqNo,
+  u32       Detached
 ){
+  if( Priority >= B8_OS_PRIORITY_NUM ){
+    return  _b8OsSetError(-EINVAL);
+  }
+
   if( IrqNo != B8_OS_NOT_USING_IRQ ){
-    int ret = _b8OsIrqAttach(IrqNo,_b8OsIrqDispatch,NULL);
-    if( ret < 0 ) return ret;
+    // The dispatcher stays attached after an irq thread is reaped.
+    if( IrqNo < B8_IRQ_NUM_OF_INTERRUPTS && _IrqInfo[ IrqNo ].handler == _b8OsIrqDispatch ){
+      if( _b8OsIrqInUse( IrqNo ) )  return  _b8OsSetError(-EINVAL);
+    } else {
+      int ret = _b8OsIrqAttach(IrqNo,_b8OsIrqDispatch,NULL);
+      if( ret < 0 ) return ret;
+    }
   }
 
   *ppid = _b8OsAllocTcb();
@@ -670,18 +917,25 @@ static  int  _b8OsThreadCreate(
   tcb->start_routine = StartRoutine;
   tcb->arg = Arg;
   if( NULL == StackAddr){
-    StackAddr = _b8OsStackAlloc( StackSize );
+    StackAddr = _b8OsStackAlloc( StackSize , &tcb->stack_alloc_size );
     if( NULL == StackAddr ){
+      tcb->pid = B8_OS_INVALID_PID;
+      *ppid = B8_OS_INVALID_PID;
       return  _b8OsSetError(-ENOMEM);
     }
+    tcb->stack_alloc = StackAddr;
+    _b8OsStackPaint( StackAddr , tcb->stack_alloc_size );
   }
   StackAddr -= sizeof( b8OsBridgeUsr2Svc );
   tcb->stack_addr = StackAddr;
   tcb->stack_size = StackSize;
   tcb->scheduling_policy = SchedulingPolicy;
+  tcb->priority = Priority;
+  tcb->base_priority = Priority;
   tcb->irq = IrqNo;
+  tcb->detached = Detached ? 1 : 0;
 
-  ListPushBack( _ReadyTasksList , *ppid );
+  ReadyPushBack( tcb );
 
   b8OsBridgeUsr2Svc* bridge = TcbGetBridgeAddr( tcb );
   bridge->signature = B8_OS_BRIDGE_USR2SVC_SIGNATURE;
@@ -690,6 +944,7 @@ static  int  _b8OsThreadCreate(
   bridge->ret_pid = B8_OS_INVALID_PID;
   bridge->ret_sid = B8_OS_INVALID_SID;
   bridge->ret_semcount = 0;
+  bridge->ret_value = NULL;
 
   return B8_OS_OK;
 }
@@ -705,7 +960,6 @@ int  b8OsReset( b8OsConfig* cfg_ ){
     return -ENOMEM;
   }
 
-  if( NULL == cfg_->sem_heap )                    return -EINVAL;
   if( NULL == cfg_->ArchDriverGetTimerIrq )       return -EINVAL;
   if( NULL == cfg_->ArchDriverOnStartTimer)       return -EINVAL;
   if( NULL == cfg_->ArchDriverOnStartCycleCnt )   return -EINVAL;
@@ -735,7 +989,8 @@ int  b8OsReset( b8OsConfig* cfg_ ){
   }
   _b8OsIrqEnable();
 
-  memset( b8OsUsrContext , 0 , sizeof(b8OsUsrContext ) );
+  memset( _BootContext , 0 , sizeof(_BootContext ) );
+  b8OsUsrContext = _BootContext;
   _Config = *cfg_;
 
   _Config.ArchDriverGetClockTime( &_UnixEpochTimeMilliseconds );
@@ -752,9 +1007,11 @@ int  b8OsReset( b8OsConfig* cfg_ ){
   _Config.StackTop = cast.data._p32;
 
   _UpStackPool = 0;
+  _StackPoolUsed = 0;
+  _StackPoolPeak = 0;
+  memset( _FreeStacks , 0 , sizeof(_FreeStacks) );
 
   _AccThread = 1;
-  _UpMemoryPool = 0;
   for( size_t nn=0 ; nn<N_MAX_THREAD ; ++nn ){
     _TaskControlBlocks[ nn ].pid = B8_OS_INVALID_PID;
   }
@@ -763,32 +1020,57 @@ int  b8OsReset( b8OsConfig* cfg_ ){
   for( size_t nn=0 ; nn<N_MAX_SEMAPHORE ; ++nn ){
     _Semaphores[ nn ].sid = B8_OS_INVALID_SID;
   }
+  for( size_t nn=0 ; nn<N_MAX_MUTEX ; ++nn ){
+    _Mutexes[ nn ].umutex = NULL;
+  }
+  for( size_t nn=0 ; nn<N_MAX_COND ; ++nn ){
+    _Conds[ nn ].ucond = NULL;
+  }
 
-  _ReadyTasksList = NewList( N_MAX_THREAD );
-  _WaitingTasksList = NewList( N_MAX_THREAD );
-  _ZombieTasksList = NewList( N_MAX_THREAD );
+  for( size_t nn=0 ; nn<B8_OS_PRIORITY_NUM ; ++nn ){
+    TcbQueueClear( &_ReadyQueue[ nn ] );
+  }
+  _ReadyBitmap = 0;
+  for( size_t nn=0 ; nn<B8_IRQ_NUM_OF_INTERRUPTS ; ++nn ){
+    _IrqWaiter[ nn ] = NULL;
+    _IrqSem[ nn ] = B8_OS_INVALID_SID;
+  }
+
+  TcbQueueClear( &_TimerQueue );
+  TcbQueueClear( &_ZombieQueue );
 
   _AccumelatedTime = 0;
   ret = cfg_->ArchDriverOnStartCycleCnt();
   if( ret < 0 ) return ret;
 
-  ret = _b8OsThreadCreate( &_IdlePid,NULL,CONFIG_BYTESIZE_OF_STACK_IDLE_THREAD, _b8IdleThread , NULL, B8_OS_SCHED_RR , B8_OS_NOT_USING_IRQ );
+  ret = _b8OsThreadCreate( &_IdlePid,NULL,CONFIG_BYTESIZE_OF_STACK_IDLE_THREAD, _b8IdleThread , NULL, B8_OS_SCHED_RR , B8_OS_PRIORITY_IDLE , B8_OS_NOT_USING_IRQ , 0 );
   if( ret < 0 ) return ret;
 
   _CurrentPid = _IdlePid;
+  b8OsCurrentPid = _CurrentPid;
+  b8OsCurrentBridge = TcbGetBridge( _CurrentPid );
 
   b8OsPid main_th;
-  ret = _b8OsThreadCreate( &main_th,NULL,CONFIG_BYTESIZE_OF_STACK_MAIN_THREAD, _b8MainThread , NULL, B8_OS_SCHED_RR , B8_OS_NOT_USING_IRQ );
+  ret = _b8OsThreadCreate( &main_th,NULL,CONFIG_BYTESIZE_OF_STACK_MAIN_THREAD, _b8MainThread , NULL, B8_OS_SCHED_RR , B8_OS_PRIORITY_DEFAULT , B8_OS_NOT_USING_IRQ , 0 );
   if( ret < 0 ) return ret;
 
-  b8SysPuts( "b8os heap:" );
-  b8SysPutHex( _UpMemoryPool );
+  b8SysPuts( "b8os stack:" );
+  b8SysPutHex( _UpStackPool );
+  b8SysPuts( "/" );
+  b8SysPutHex( _Config.StackSize );
   b8SysPutCR();
 
   ret = _b8OsIrqAttach(_IrqTimer,_b8OsIrqDispatch,NULL);
   if( ret < 0 ) return ret;
 
-  ret = cfg_->ArchDriverOnStartTimer(100);
+  _TimerDeadline = USEC_NEVER;
+  if( _b8OsIsTickless() ){
+    // The first expiry starts the main thread.
+    _TimerDeadline = 1000000 / CONFIG_TICK_HZ;
+    ret = cfg_->ArchDriverSetTimerOneShot( (u32)_TimerDeadline );
+  } else {
+    ret = cfg_->ArchDriverOnStartTimer( CONFIG_TICK_HZ );
+  }
   if( ret < 0 ) return ret;
 
   cfg_->ArchDriverPicDistributor(1);
@@ -851,23 +1133,42 @@ static  void _B8_OS_SYSCALL_THREAD_CREATE(void){
     return;
   }
 
-  b8OsPid pid;
-  _b8OsThreadCreate(
+  const u32 SchedulingPolicy = b8OsSysCallArgs[5] & 0xff;
+  u32 Priority = (b8OsSysCallArgs[5] >> 8) & 0xff;
+  if( Priority == 0 ){
+    Priority = SchedulingPolicy == B8_OS_SCHED_IRQ ? B8_OS_PRIORITY_IRQ : B8_OS_PRIORITY_DEFAULT;
+  }
+
+  b8OsPid pid = B8_OS_INVALID_PID;
+  const int ret = _b8OsThreadCreate(
     &pid,
     _b8OsCastU32( b8OsSysCallArgs[1] ), // void*  StackAddr
     (size_t)b8OsSysCallArgs[2],         // size_t StackSize
     _b8OsCastU32( b8OsSysCallArgs[3] ), // void*  StartRoutine
     _b8OsCastU32( b8OsSysCallArgs[4] ), // void*  arg
-    b8OsSysCallArgs[5],                 // u32    SchedulingPolicy
-    b8OsSysCallArgs[6]                  // u32    IrqNo
+    SchedulingPolicy,                   // u32    SchedulingPolicy
+    Priority,                           // u32    Priority
+    b8OsSysCallArgs[6],                 // u32    IrqNo
+    (b8OsSysCallArgs[5] >> 16) & 1      // u32    Detached
   );
 
   b8OsBridgeUsr2Svc* bridge = TcbGetBridge( _CurrentPid );
   bridge->ret_pid = pid;
   _b8OsGiveBridgeToUsr();
+
+  // The new thread runs at once if it outranks the caller.
+  Tcb* tcb_new = _b8OsGetTcb( pid );
+  if( ret == B8_OS_OK && tcb_new && tcb_new->priority > _b8OsGetCurrentTcb()->priority ){
+    ReqSchedule rs;
+    ReqScheduleClear( &rs );
+    rs.req = REQ_SCHEDULE_PREEMPT;
+    _b8OsProcessScheduler( &rs );
+    // It won't get here
+  }
 }
 
 static  void _B8_OS_SYSCALL_EXIT(void){
+  _b8OsGetCurrentTcb()->exit_value = _b8OsCastU32( b8OsSysCallArgs[1] );
   ReqSchedule rs;
   ReqScheduleClear( &rs );
   rs.req = REQ_SCHEDULE_EXIT_THREAD;
@@ -900,8 +1201,33 @@ static  void _B8_OS_SYSCALL_SEM_POST(void){
   _b8OsGiveBridgeToUsr();
 }
 
+static  void _B8_OS_SYSCALL_IRQ_SEM_BIND(void){
+  const u32 irq = b8OsSysCallArgs[1];
+  const b8OsSid sid = b8OsSysCallArgs[2];
+  if( irq >= B8_IRQ_NUM_OF_INTERRUPTS || irq == _IrqTimer || NULL == _b8OsGetSemaphore( sid ) ){
+    _b8OsSetError(-EINVAL);
+    return;
+  }
+  if( _IrqInfo[ irq ].handler == _b8OsIrqDispatch ){
+    if( _b8OsIrqInUse( irq ) ){
+      _b8OsSetError(-EBUSY);
+      return;
+    }
+  } else if( _b8OsIrqAttach( irq , _b8OsIrqDispatch , NULL ) < 0 ){
+    return;
+  }
+  _IrqSem[ irq ] = sid;
+  _b8OsGiveBridgeToUsr();
+}
+
+// The timer queue runs on _AccumelatedTime, user deadlines are CLOCK_REALTIME.
+static  b8OsUsec  _b8OsRealtimeToDeadline( u32 sec , u32 nsec ){
+  const b8OsUsec epoch_us = (u64)sec*1000000 + nsec/1000;
+  return  epoch_us > _UnixEpochTimeMicroseconds ? epoch_us - _UnixEpochTimeMicroseconds : 0;
+}
+
 static  void _B8_OS_SYSCALL_SEM_WAIT(void){
-  b8OsUsec wake_up_time = 0xffffffffffffffff;
+  b8OsUsec wake_up_time = USEC_NEVER;
   const b8OsSid sid = b8OsSysCallArgs[1];
   const u32 wait_type = b8OsSysCallArgs[2];
   if( wait_type == B8_OS_SEM_TIMEDWAIT ){
@@ -912,8 +1238,7 @@ static  void _B8_OS_SYSCALL_SEM_WAIT(void){
       _b8OsSwitchBackToUsr();
     }
 
-    const u64 sec = (u64)b8OsSysCallArgs[3];
-    wake_up_time = sec*1000000 + nsec/1000;
+    wake_up_time = _b8OsRealtimeToDeadline( b8OsSysCallArgs[3] , nsec );
   }
   _b8OsSemaphoreWait( sid , wait_type , wake_up_time );
   _b8OsGiveBridgeToUsr();
@@ -929,18 +1254,42 @@ static  void _B8_OS_SYSCALL_SEM_GETVALUE(void){
   _b8OsGiveBridgeToUsr();
 }
 
+static  int   _b8OsIsClockId( u32 clkid ){
+  return  clkid == B8_OS_CLOCKID_REALTIME ||
+          clkid == B8_OS_CLOCKID_MONOTONIC ||
+          clkid == B8_OS_CLOCKID_PROCESS_CPUTIME_ID ||
+          clkid == B8_OS_CLOCKID_THREAD_CPUTIME_ID;
+}
+
 static  void  _b8OsChkClockId(void){
-  const u32 clkid = b8OsSysCallArgs[1];
-  if( clkid == B8_OS_CLOCKID_PROCESS_CPUTIME_ID ||
-      clkid == B8_OS_CLOCKID_THREAD_CPUTIME_ID
-  ){
-    _b8OsSetError(-EOPNOTSUPP); 
+  if( !_b8OsIsClockId( b8OsSysCallArgs[1] ) ){
+    _b8OsSetError(-EINVAL);
     _b8OsGiveBridgeToUsr();
     _b8OsSwitchBackToUsr();
     // It won't get here
   }
 }
 
+// The cycles since the last scheduler pass belong to the current thread.
+static  u64   _b8OsCpuCycles( u32 clkid , u32 cyccnt ){
+  switch( clkid ){
+    case  B8_OS_CLOCKID_REALTIME:
+      return  _UnixEpochTimeCycles + _CycCnt + (u64)cyccnt;
+    case  B8_OS_CLOCKID_PROCESS_CPUTIME_ID:
+      return  _CycCnt + (u64)cyccnt - _b8OsGetTcb( _IdlePid )->cpu_cycles;
+    case  B8_OS_CLOCKID_THREAD_CPUTIME_ID:
+      return  _b8OsGetCurrentTcb()->cpu_cycles + (u64)cyccnt;
+    default:
+      return  _CycCnt + (u64)cyccnt;
+  }
+}
+
+static  void  _b8OsCyclesToTime( u64 cycles , u64* tv_sec , u32* tv_nsec ){
+  static  const u64 ns = 1000000000UL;
+  *tv_sec = cycles / _Config.CpuCyclesPerSec;
+  *tv_nsec = (u32) (((cycles % _Config.CpuCyclesPerSec) * ns) / _Config.CpuCyclesPerSec);
+}
+
 static  void  _B8_OS_SYSCALL_CLOCK_GETRES(void){
   _b8OsChkClockId();
   b8OsBridgeUsr2Svc* bridge = TcbGetBridge( _CurrentPid );
@@ -955,12 +1304,8 @@ static  void  _B8_OS_SYSCALL_CLOCK_GETTIME(void){
   const u32 clkid = b8OsSysCallArgs[1];
   u32 cyccnt;
   _Config.ArchDriverGetCycle( &cyccnt );
-  static  const u64 ns = 1000000000UL;
-  const u64 BaseCycle = (clkid == B8_OS_CLOCKID_REALTIME) ? _UnixEpochTimeCycles : 0;
-  const u64 _CurCycCnt = BaseCycle + _CycCnt + (u64)cyccnt;
   b8OsBridgeUsr2Svc* bridge = TcbGetBridge( _CurrentPid );
-  bridge->tv_sec = _CurCycCnt / _Config.CpuCyclesPerSec;
-  bridge->tv_nsec = (u32) (((_CurCycCnt % _Config.CpuCyclesPerSec) * ns) / _Config.CpuCyclesPerSec);
+  _b8OsCyclesToTime( _b8OsCpuCycles( clkid , cyccnt ) , &bridge->tv_sec , &bridge->tv_nsec );
 
   _b8OsGiveBridgeToUsr();
 }
@@ -970,6 +1315,452 @@ static  void  _B8_OS_SYSCALL_CLOCK_SETTIME(void){
   _b8OsSwitchBackToUsr();
 }
 
+static  void  _b8OsSetPriority( Tcb* tcb , u8 priority ){
+  if( tcb->is_ready ){
+    ReadyErase( tcb );
+    tcb->priority = priority;
+    ReadyPushBack( tcb );
+  } else if( tcb->waiting_for == TWF_SEMAPHORE ){
+    Semaphore* sem = _b8OsGetSemaphore( tcb->sid_wait );
+    KPANIC( sem , "invalid sem" );
+    TcbQueueErase( &sem->waiters , tcb );
+    tcb->priority = priority;
+    TcbQueueInsertByPriority( &sem->waiters , tcb );
+  } else if( tcb->waiting_for == TWF_MUTEX ){
+    Mutex* mtx = &_Mutexes[ tcb->mutex_wait ];
+    TcbQueueErase( &mtx->waiters , tcb );
+    tcb->priority = priority;
+    TcbQueueInsertByPriority( &mtx->waiters , tcb );
+  } else if( tcb->waiting_for == TWF_COND ){
+    Cond* cv = &_Conds[ tcb->cond_wait ];
+    TcbQueueErase( &cv->waiters , tcb );
+    tcb->priority = priority;
+    TcbQueueInsertByPriority( &cv->waiters , tcb );
+  } else {
+    tcb->priority = priority;
+  }
+}
+
+/*
+  Priority inheritance: a thread runs at the highest of its base priority
+  and the priority of the first waiter of every contended mutex it owns.
+  A change is passed down the chain when the thread is itself blocked on
+  a mutex.
+*/
+static  void  _b8OsUpdatePriority( Tcb* tcb ){
+  for( u32 depth=0 ; tcb && depth<N_MAX_THREAD ; ++depth ){
+    u8 priority = tcb->base_priority;
+    for( MutexIdx mi=tcb->mutex_held ; mi != MUTEX_IDX_NONE ; mi=_Mutexes[ mi ].next_held ){
+      Tcb* waiter = TcbQueueFront( &_Mutexes[ mi ].waiters );
+      if( waiter && waiter->priority > priority ) priority = waiter->priority;
+    }
+    if( priority == tcb->priority ) return;
+    _b8OsSetPriority( tcb , priority );
+
+    if( tcb->waiting_for != TWF_MUTEX ) return;
+    tcb = _Mutexes[ tcb->mutex_wait ].owner;
+  }
+}
+
+static  void  _b8OsMutexDetachOwner( Mutex* mtx ){
+  Tcb* owner = mtx->owner;
+  if( NULL == owner ) return;
+  const MutexIdx idx = (MutexIdx)(mtx - _Mutexes);
+  MutexIdx* link = &owner->mutex_held;
+  while( *link != MUTEX_IDX_NONE ){
+    if( *link == idx ){
+      *link = mtx->next_held;
+      break;
+    }
+    link = &_Mutexes[ *link ].next_held;
+  }
+  mtx->owner = NULL;
+  mtx->next_held = MUTEX_IDX_NONE;
+  _b8OsUpdatePriority( owner );
+}
+
+static  void  _b8OsMutexAttachOwner( Mutex* mtx , Tcb* owner ){
+  if( mtx->owner == owner ) return;
+  _b8OsMutexDetachOwner( mtx );
+  if( NULL == owner ) return;
+  mtx->owner = owner;
+  mtx->next_held = owner->mutex_held;
+  owner->mutex_held = (MutexIdx)(mtx - _Mutexes);
+  _b8OsUpdatePriority( owner );
+}
+
+static  Mutex*  _b8OsFindMutex( b8OsMutex* umutex ){
+  for( size_t nn=0 ; nn<N_MAX_MUTEX ; ++nn ){
+    if( _Mutexes[ nn ].umutex == umutex ) return &_Mutexes[ nn ];
+  }
+  return NULL;
+}
+
+static  Mutex*  _b8OsAllocMutex( b8OsMutex* umutex ){
+  Mutex* mtx = _b8OsFindMutex( NULL );
+  if( NULL == mtx ) return NULL;
+  mtx->umutex = umutex;
+  mtx->owner = NULL;
+  mtx->next_held = MUTEX_IDX_NONE;
+  TcbQueueClear( &mtx->waiters );
+  return mtx;
+}
+
+static  void  _B8_OS_SYSCALL_MUTEX_WAIT(void){
+  b8OsMutex* umutex = _b8OsCastU32( b8OsSysCallArgs[1] );
+  if( NULL == umutex ){
+    _b8OsSetError(-EINVAL);
+    return;
+  }
+
+  // The owner released the lock before we got here; retry in user mode.
+  if( umutex->state != B8_OS_MUTEX_CONTENDED ){
+    _b8OsSetError( B8_OS_OK );
+    return;
+  }
+
+  Mutex* mtx = _b8OsFindMutex( umutex );
+  if( NULL == mtx ) mtx = _b8OsAllocMutex( umutex );
+  if( NULL == mtx ){
+    _b8OsSetError(-EAGAIN);
+    return;
+  }
+  _b8OsSetError( B8_OS_OK );
+
+  ReqSchedule rs;
+  ReqScheduleClear( &rs );
+  rs.req = REQ_SCHEDULE_MUTEX_WAIT;
+  rs.mutex = (MutexIdx)(mtx - _Mutexes);
+  _b8OsProcessScheduler( &rs );
+  // It won't get here
+}
+
+static  void  _B8_OS_SYSCALL_MUTEX_WAKE(void){
+  b8OsMutex* umutex = _b8OsCastU32( b8OsSysCallArgs[1] );
+  Mutex* mtx = umutex ? _b8OsFindMutex( umutex ) : NULL;
+  _b8OsSetError( B8_OS_OK );
+  if( NULL == mtx ) return;
+
+  Tcb* tcb = TcbQueueFront( &mtx->waiters );
+  if( tcb ){
+    TcbQueueErase( &mtx->waiters , tcb );
+    tcb->mutex_wait = MUTEX_IDX_NONE;
+    tcb->waiting_for = TWF_NOTHING;
+    ReadyPushBack( tcb );
+  }
+
+  if( TcbQueueFront( &mtx->waiters ) ){
+    // The woken thread is about to take the lock; let it inherit now.
+    _b8OsMutexAttachOwner( mtx , tcb );
+  } else {
+    _b8OsMutexDetachOwner( mtx );
+    mtx->umutex = NULL;
+  }
+
+  ReqSchedule rs;
+  ReqScheduleClear( &rs );
+  rs.req = REQ_SCHEDULE_PREEMPT;
+  _b8OsProcessScheduler( &rs );
+  // It won't get here
+}
+
+/*
+  Releases the TCB slot and the stack of an exited thread. The thread's
+  irq, if any, stays attached to _b8OsIrqDispatch and finds no waiter.
+*/
+static  void  _b8OsReapTcb( Tcb* tcb ){
+  KPANIC( tcb->status == TS_ZOMBIE , "not a zombie" );
+  TcbQueueErase( &_ZombieQueue , tcb );
+  if( tcb->stack_alloc ){
+    _b8OsStackFree( tcb->stack_alloc , tcb->stack_alloc_size );
+  }
+  if( tcb->irq != B8_OS_NOT_USING_IRQ && _IrqWaiter[ tcb->irq ] == tcb ){
+    _IrqWaiter[ tcb->irq ] = NULL;
+  }
+  tcb->pid = B8_OS_INVALID_PID;
+}
+
+static  void  _b8OsExitTcb( Tcb* tcb ){
+  ReadyErase( tcb );
+  // Mutexes left locked stay locked, but nobody inherits from a dead owner.
+  while( tcb->mutex_held != MUTEX_IDX_NONE ){
+    _b8OsMutexDetachOwner( &_Mutexes[ tcb->mutex_held ] );
+  }
+  tcb->status = TS_ZOMBIE;
+  TcbQueuePushBack( &_ZombieQueue , tcb );
+
+  if( tcb->joiner != TCB_IDX_NONE ){
+    Tcb* joiner = &_TaskControlBlocks[ tcb->joiner ];
+    TcbGetBridge( joiner->pid )->ret_value = tcb->exit_value;
+    _b8OsAwakeTcb( joiner );
+    _b8OsReapTcb( tcb );
+  } else if( tcb->detached ){
+    _b8OsReapTcb( tcb );
+  }
+}
+
+// Threads that may be joined or detached: not the idle thread.
+static  Tcb*  _b8OsGetUserTcb( b8OsPid pid ){
+  Tcb* tcb = _b8OsGetTcb( pid );
+  if( tcb == _b8OsGetTcb( _IdlePid ) ) return NULL;
+  return tcb;
+}
+
+static  void  _B8_OS_SYSCALL_THREAD_JOIN(void){
+  Tcb* tcb = _b8OsGetUserTcb( b8OsSysCallArgs[1] );
+  Tcb* tcb_cur = _b8OsGetCurrentTcb();
+  if( NULL == tcb ){
+    _b8OsSetError(-ESRCH);
+    return;
+  }
+  if( tcb == tcb_cur || tcb_cur->joiner == TcbToIdx( tcb ) ){
+    _b8OsSetError(-EDEADLK);
+    return;
+  }
+  if( tcb->detached || tcb->joiner != TCB_IDX_NONE ){
+    _b8OsSetError(-EINVAL);
+    return;
+  }
+  _b8OsSetError( B8_OS_OK );
+
+  if( tcb->status == TS_ZOMBIE ){
+    TcbGetBridge( _CurrentPid )->ret_value = tcb->exit_value;
+    _b8OsReapTcb( tcb );
+    return;
+  }
+
+  tcb->joiner = TcbToIdx( tcb_cur );
+  ReqSchedule rs;
+  ReqScheduleClear( &rs );
+  rs.req = REQ_SCHEDULE_JOIN;
+  _b8OsProcessScheduler( &rs );
+  // It won't get here
+}
+
+static  void  _B8_OS_SYSCALL_THREAD_DETACH(void){
+  Tcb* tcb = _b8OsGetUserTcb( b8OsSysCallArgs[1] );
+  if( NULL == tcb ){
+    _b8OsSetError(-ESRCH);
+    return;
+  }
+  if( tcb->detached ){
+    _b8OsSetError(-EINVAL);
+    return;
+  }
+  _b8OsSetError( B8_OS_OK );
+
+  if( tcb->status == TS_ZOMBIE ){
+    _b8OsReapTcb( tcb );
+  } else {
+    tcb->detached = 1;
+  }
+}
+
+static  Cond*   _b8OsFindCond( b8OsCond* ucond ){
+  for( size_t nn=0 ; nn<N_MAX_COND ; ++nn ){
+    if( _Conds[ nn ].ucond == ucond ) return &_Conds[ nn ];
+  }
+  return NULL;
+}
+
+static  Cond*   _b8OsAllocCond( b8OsCond* ucond ){
+  Cond* cv = _b8OsFindCond( NULL );
+  if( NULL == cv ) return NULL;
+  cv->ucond = ucond;
+  TcbQueueClear( &cv->waiters );
+  return cv;
+}
+
+// Takes tcb off the condition it sleeps on. The caller wakes it.
+static  void  _b8OsCondRemove( Tcb* tcb ){
+  Cond* cv = &_Conds[ tcb->cond_wait ];
+  TcbQueueErase( &cv->waiters , tcb );
+  TimerErase( tcb );
+  tcb->cond_wait = COND_IDX_NONE;
+  cv->ucond->waiters--;
+  if( NULL == TcbQueueFront( &cv->waiters ) ){
+    cv->ucond = NULL;
+  }
+}
+
+static  void  _B8_OS_SYSCALL_COND_WAIT(void){
+  b8OsCond* ucond = _b8OsCastU32( b8OsSysCallArgs[1] );
+  if( NULL == ucond ){
+    _b8OsSetError(-EINVAL);
+    return;
+  }
+
+  // Signalled after the caller released its mutex; nothing to wait for.
+  if( ucond->seq != b8OsSysCallArgs[2] ){
+    _b8OsSetError( B8_OS_OK );
+    return;
+  }
+
+  b8OsUsec wake_up_time = USEC_NEVER;
+  if( b8OsSysCallArgs[3] ){
+    const u32 nsec = b8OsSysCallArgs[5];
+    if( nsec >= 1000000000 ){
+      _b8OsSetError(-EINVAL);
+      return;
+    }
+    wake_up_time = _b8OsRealtimeToDeadline( b8OsSysCallArgs[4] , nsec );
+    if( wake_up_time <= _AccumelatedTime ){
+      _b8OsSetError(-ETIMEDOUT);
+      return;
+    }
+  }
+
+  Cond* cv = _b8OsFindCond( ucond );
+  if( NULL == cv ) cv = _b8OsAllocCond( ucond );
+  if( NULL == cv ){
+    _b8OsSetError(-EAGAIN);
+    return;
+  }
+  _b8OsSetError( B8_OS_OK );
+  _b8OsGetCurrentTcb()->wake_up_time = wake_up_time;
+
+  ReqSchedule rs;
+  ReqScheduleClear( &rs );
+  rs.req = REQ_SCHEDULE_COND_WAIT;
+  rs.cond = (CondIdx)(cv - _Conds);
+  _b8OsProcessScheduler( &rs );
+  // It won't get here
+}
+
+static  void  _B8_OS_SYSCALL_COND_SIGNAL(void){
+  b8OsCond* ucond = _b8OsCastU32( b8OsSysCallArgs[1] );
+  Cond* cv = ucond ? _b8OsFindCond( ucond ) : NULL;
+  _b8OsSetError( B8_OS_OK );
+  if( NULL == cv ) return;
+
+  const u32 broadcast = b8OsSysCallArgs[2];
+  Tcb* tcb;
+  while( cv->ucond == ucond && (tcb = TcbQueueFront( &cv->waiters )) ){
+    _b8OsCondRemove( tcb );
+    _b8OsAwakeTcb( tcb );
+    if( !broadcast ) break;
+  }
+
+  ReqSchedule rs;
+  ReqScheduleClear( &rs );
+  rs.req = REQ_SCHEDULE_PREEMPT;
+  _b8OsProcessScheduler( &rs );
+  // It won't get here
+}
+
+static  void  _B8_OS_SYSCALL_STACK_INFO(void){
+  b8OsBridgeUsr2Svc* bridge = TcbGetBridge( _CurrentPid );
+  const b8OsPid pid = b8OsSysCallArgs[1];
+  if( pid == B8_OS_INVALID_PID ){
+    bridge->ret_stack_size = _Config.StackSize;
+    bridge->ret_stack_used = _StackPoolPeak;
+    _b8OsSetError( B8_OS_OK );
+    return;
+  }
+
+  Tcb* tcb = _b8OsGetTcb( pid );
+  if( NULL == tcb ){
+    _b8OsSetError(-ESRCH);
+    return;
+  }
+  if( NULL == tcb->stack_alloc ){
+    _b8OsSetError(-EINVAL);
+    return;
+  }
+  bridge->ret_stack_size = tcb->stack_alloc_size;
+  bridge->ret_stack_used = _b8OsStackHighWater( tcb );
+  _b8OsSetError( B8_OS_OK );
+}
+
+static  void  _B8_OS_SYSCALL_THREAD_STAT(void){
+  b8OsThreadStat* stat = _b8OsCastU32( b8OsSysCallArgs[1] );
+  const u32 max = b8OsSysCallArgs[2];
+  if( NULL == stat && max ){
+    _b8OsSetError(-EINVAL);
+    return;
+  }
+
+  u32 cyccnt;
+  _Config.ArchDriverGetCycle( &cyccnt );
+  Tcb* tcb_cur = _b8OsGetCurrentTcb();
+
+  int count = 0;
+  for( size_t nn=0 ; nn<N_MAX_THREAD && (u32)count < max ; ++nn ){
+    Tcb* tcb = &_TaskControlBlocks[ nn ];
+    if( tcb->pid == B8_OS_INVALID_PID ) continue;
+
+    b8OsThreadStat* st = &stat[ count++ ];
+    st->pid = tcb->pid;
+    if( tcb->status == TS_ZOMBIE ){
+      st->state = B8_OS_THREAD_ZOMBIE;
+    } else if( tcb->is_ready ){
+      st->state = B8_OS_THREAD_RUNNING;
+    } else {
+      st->state = B8_OS_THREAD_SLEEPING;
+    }
+    st->policy = tcb->scheduling_policy;
+    st->priority = tcb->priority;
+    st->is_idle = tcb->pid == _IdlePid;
+    st->cpu_cycles = tcb->cpu_cycles + (tcb == tcb_cur ? (u64)cyccnt : 0);
+  }
+
+  b8OsBridgeUsr2Svc* bridge = TcbGetBridge( _CurrentPid );
+  bridge->ret_count = count;
+  bridge->ret_cycles = _CycCnt + (u64)cyccnt;
+  _b8OsSetError( B8_OS_OK );
+}
+
+static  int   _b8OsChkSchedParam( u32 policy , u32 priority ){
+  if( policy != B8_OS_SCHED_FIFO &&
+      policy != B8_OS_SCHED_RR &&
+      policy != B8_OS_SCHED_IRQ
+  ){
+    return  -EINVAL;
+  }
+  if( priority < B8_OS_PRIORITY_MIN || priority > B8_OS_PRIORITY_MAX ){
+    return  -EINVAL;
+  }
+  return  B8_OS_OK;
+}
+
+static  void  _B8_OS_SYSCALL_SCHED_SETPARAM(void){
+  Tcb* tcb = _b8OsGetTcb( b8OsSysCallArgs[1] );
+  if( NULL == tcb || tcb == _b8OsGetTcb( _IdlePid ) ){
+    _b8OsSetError(-ESRCH);
+    return;
+  }
+  const u32 policy = b8OsSysCallArgs[2];
+  const u32 priority = b8OsSysCallArgs[3];
+  const int ret = _b8OsChkSchedParam( policy , priority );
+  if( ret < 0 ){
+    _b8OsSetError( ret );
+    return;
+  }
+
+  tcb->scheduling_policy = policy;
+  tcb->base_priority = priority;
+  _b8OsUpdatePriority( tcb );
+  _b8OsSetError( B8_OS_OK );
+
+  ReqSchedule rs;
+  ReqScheduleClear( &rs );
+  rs.req = REQ_SCHEDULE_PREEMPT;
+  _b8OsProcessScheduler( &rs );
+  // It won't get here
+}
+
+static  void  _B8_OS_SYSCALL_SCHED_GETPARAM(void){
+  Tcb* tcb = _b8OsGetTcb( b8OsSysCallArgs[1] );
+  if( NULL == tcb ){
+    _b8OsSetError(-ESRCH);
+    return;
+  }
+  b8OsBridgeUsr2Svc* bridge = TcbGetBridge( _CurrentPid );
+  bridge->ret_policy = tcb->scheduling_policy;
+  bridge->ret_priority = tcb->base_priority;
+  _b8OsSetError( B8_OS_OK );
+}
+
 typedef void  (*B8_OS_SYSCALL_FUNC)(void);
 static  const B8_OS_SYSCALL_FUNC  _b8OsSysCallTbl[ B8_OS_SYSCALL_MAX ] = {
   _B8_OS_SYSCALL_NULL,
@@ -987,12 +1778,24 @@ static  const B8_OS_SYSCALL_FUNC  _b8OsSysCallTbl[ B8_OS_SYSCALL_MAX ] = {
   _B8_OS_SYSCALL_CLOCK_GETRES,
   _B8_OS_SYSCALL_CLOCK_GETTIME,
   _B8_OS_SYSCALL_CLOCK_SETTIME,
+  _B8_OS_SYSCALL_SCHED_SETPARAM,
+  _B8_OS_SYSCALL_SCHED_GETPARAM,
+  _B8_OS_SYSCALL_MUTEX_WAIT,
+  _B8_OS_SYSCALL_MUTEX_WAKE,
+  _B8_OS_SYSCALL_THREAD_JOIN,
+  _B8_OS_SYSCALL_THREAD_DETACH,
+  _B8_OS_SYSCALL_COND_WAIT,
+  _B8_OS_SYSCALL_COND_SIGNAL,
+  _B8_OS_SYSCALL_STACK_INFO,
+  _B8_OS_SYSCALL_THREAD_STAT,
+  _B8_OS_SYSCALL_IRQ_SEM_BIND,
 };
 
 // Called only from bootloader.s / __svc_dispatch:
 void  _b8OsSvcDispatch(void){
   _b8OsGiveBridgeToUsrByPid( _CurrentPid );
   const b8OsSysCallNum syscall = b8OsSysCallArgs[ 0 ];
+  _b8OsTrace( B8_OS_TRACE_SYSCALL , _CurrentPid , syscall );
   if( syscall >= B8_OS_SYSCALL_MAX ){
     _b8OsSetError(-EINVAL);
     _b8OsSwitchBackToUsr();
@@ -1009,7 +1812,16 @@ static  int   _b8OsIrqDispatch(int irq, void* arg){
   ReqSchedule rs;
   ReqScheduleClear( &rs );
   if( irq == _IrqTimer ){
+    _TimerDeadline = USEC_NEVER;
     rs.req |= REQ_SCHEDULE_REGULAR;
+  } else if( _IrqSem[ irq ] != B8_OS_INVALID_SID ){
+    // sem_post() on behalf of the irq. Only a woken waiter needs a pass.
+    Semaphore* sem = _b8OsGetSemaphore( _IrqSem[ irq ] );
+    KPANIC( sem , "invalid sem" );
+    if( sem->semcount < SEM_VALUE_MAX && ++sem->semcount <= 0 ){
+      rs.sid = sem->sid;
+      rs.req |= REQ_SCHEDULE_AWAKE_THREAD_WAITING_FOR_SEMAPHORE;
+    }
   } else {
     rs.req |= REQ_SCHEDULE_AWAKE_THREAD_WAITING_FOR_IRQ;
   }
@@ -1020,120 +1832,122 @@ static  int   _b8OsIrqDispatch(int irq, void* arg){
   return B8_OS_OK;
 }
 
-static  b8OsPid _b8OsPickupThreadYield( void ){
-  Node* it;
-  for(
-    it =  ListBegin( _WaitingTasksList ) ;
-    it != ListEnd( _WaitingTasksList )   ;
-    it =  it->_next
-  ){
-    Tcb* tcb = _b8OsGetTcb( it->pid );
-    KPANIC(tcb,"not found");
-    if( tcb->waiting_for != TWF_YIELD ) continue;
-    return it->pid;
-  }
-  return  B8_OS_INVALID_PID;
+static  Tcb*  _b8OsWaitCurrentPid( TcbWaitingFor waiting_for ){
+  Tcb* tcb = _b8OsGetTcb( _CurrentPid );
+  KPANIC( tcb , "not found current tcb" );
+  ReadyErase( tcb );
+  tcb->waiting_for = waiting_for;
+  _b8OsTrace( B8_OS_TRACE_BLOCK , tcb->pid , waiting_for );
+  return tcb;
 }
 
-static  b8OsPid _b8OsPickupThreadWaitingForTimer( void ){
-  Node* it;
-  for(
-    it =  ListBegin( _WaitingTasksList ) ;
-    it != ListEnd( _WaitingTasksList )   ;
-    it =  it->_next
-  ){
-    Tcb* tcb = _b8OsGetTcb( it->pid );
-    KPANIC(tcb,"not found");
-    if( tcb->waiting_for != TWF_TIMER ) continue;
-    if( _AccumelatedTime < tcb->wake_up_time ) continue;
-    return it->pid;
-  }
-  return  B8_OS_INVALID_PID;
-}
+/*
+  Tickless mode: instead of a fixed CONFIG_TICK_HZ interrupt, the timer is
+  armed for the earliest sleeper, and for the end of the time slice only
+  when the next thread has to share the CPU with a round robin peer.
+  When every thread is blocked the CPU stays in the idle thread until an
+  IRQ or CONFIG_TICKLESS_MAX_USEC passes. Time keeping does not depend on the tick: the
+  DWT cycle counter is folded into _AccumelatedTime on every scheduler pass.
+*/
+static  void  _b8OsProgramTimer( Tcb* tcb_next ){
+  if( !_b8OsIsTickless() )  return;
 
-static  b8OsPid _b8OsPickupThreadWaitingForSemaphore( b8OsSid sid ){
-  Node* it;
-  for(
-    it =  ListBegin( _WaitingTasksList ) ;
-    it != ListEnd( _WaitingTasksList )   ;
-    it =  it->_next
-  ){
-    Tcb* tcb = _b8OsGetTcb( it->pid );
-    KPANIC(tcb,"not found");
-    if( tcb->waiting_for != TWF_SEMAPHORE ) continue;
-    if( tcb->sid_wait != sid )  continue;
-    tcb->sid_wait = B8_OS_INVALID_SID;
-    return it->pid;
+  b8OsUsec deadline = USEC_NEVER;
+  Tcb* sleeper = TimerFront();
+  if( sleeper ){
+    deadline = sleeper->wake_up_time;
   }
-  return  B8_OS_INVALID_PID;
-}
 
-static  b8OsPid _b8OsPickupThreadWaitingForSemaphoreTimeOut( void ){
-  Node* it;
-  for(
-    it =  ListBegin( _WaitingTasksList ) ;
-    it != ListEnd( _WaitingTasksList )   ;
-    it =  it->_next
-  ){
-    Tcb* tcb = _b8OsGetTcb( it->pid );
-    KPANIC(tcb,"not found");
-    if( tcb->waiting_for != TWF_SEMAPHORE ) continue;
-    if( _UnixEpochTimeMicroseconds + _AccumelatedTime < tcb->wake_up_time )  continue;
-    return it->pid;
+  const int shares_cpu =
+    tcb_next->scheduling_policy != B8_OS_SCHED_FIFO &&
+    _ReadyQueue[ tcb_next->priority ].head != _ReadyQueue[ tcb_next->priority ].tail;
+  if( shares_cpu ){
+    if( tcb_next->slice_end < deadline ) deadline = tcb_next->slice_end;
+  } else {
+    // The slice only runs down while a peer is waiting for the CPU.
+    tcb_next->slice_end = _AccumelatedTime + SLICE_USEC;
   }
-  return  B8_OS_INVALID_PID;
-}
 
-static  b8OsPid _b8OsPickThreadWaitingForIrq(void){
-  Node* it;
-  for(
-    it =  ListBegin( _WaitingTasksList ) ;
-    it != ListEnd( _WaitingTasksList )   ;
-    it =  it->_next
-  ){
-    Tcb* tcb = _b8OsGetTcb( it->pid );
-    KPANIC(tcb,"not found");
-    if( tcb->waiting_for != TWF_IRQ ) continue;
-    if(tcb->irq != _IrqDispatched)    continue;
-    return it->pid;
-  }
-  return  B8_OS_INVALID_PID;
-}
+  // An interrupt that is already armed earlier than needed is kept. It only
+  // costs one extra pass through the scheduler.
+  if( _TimerDeadline > _AccumelatedTime && _TimerDeadline <= deadline ) return;
 
-static  Tcb*  _b8OsWaitCurrentPid( TcbWaitingFor waiting_for ){
-  ListErase( _ReadyTasksList , _CurrentPid );
-  ListPushBack( _WaitingTasksList , _CurrentPid );
-  Tcb* tcb = _b8OsGetTcb( _CurrentPid );
-  KPANIC( tcb , "not found current tcb" );
-  tcb->waiting_for = waiting_for;
-  return tcb;
+  // With nothing to wait for, the timer still fires every
+  // CONFIG_TICKLESS_MAX_USEC to fold the DWT counter.
+
+  b8OsUsec usec = deadline > _AccumelatedTime ? deadline - _AccumelatedTime : 1;
+  if( usec > CONFIG_TICKLESS_MAX_USEC ) usec = CONFIG_TICKLESS_MAX_USEC;
+  _TimerDeadline = _AccumelatedTime + usec;
+  _Config.ArchDriverSetTimerOneShot( (u32)usec );
 }
 
 static  void  _b8OsSwitchPidAndBackToUsr( b8OsPid pid_pickup ){
   KPANIC( pid_pickup != B8_OS_INVALID_PID , "no tcb" );
+  const int switched = pid_pickup != _CurrentPid;
+  if( switched ){
+    _b8OsTrace( B8_OS_TRACE_SWITCH , pid_pickup , 0 );
+  }
   _CurrentPid = pid_pickup;
+  b8OsCurrentPid = pid_pickup;
   Tcb* tcb_cur = _b8OsGetTcb( _CurrentPid );
   KPANIC(tcb_cur,"invalid _CurrentPid" );
+  if( switched ){
+    tcb_cur->slice_end = _AccumelatedTime + SLICE_USEC;
+  }
+  b8OsCurrentBridge = TcbGetBridgeAddr( tcb_cur );
+  _b8OsProgramTimer( tcb_cur );
   if( tcb_cur->status == TS_NOT_YET_INIT ){
     TcbInit( tcb_cur );
   }
-  Tcb2UsrContext( tcb_cur );
+  b8OsUsrContext = tcb_cur->reg;
   _b8OsSwitchBackToUsr();
   // It won't get here
 }
 
-static  void  _b8OsAwakePid( b8OsPid pid ){
-  Tcb* tcb_wakeup = _b8OsGetTcb( pid );
-  KPANIC( tcb_wakeup , "invalid tcb_wakeup" );
-  tcb_wakeup->waiting_for = TWF_NOTHING;
-
-  ListErase( _WaitingTasksList , pid );
-  ListErase( _ReadyTasksList   , pid );
+static  void  _b8OsAwakeTcb( Tcb* tcb ){
+  _b8OsTrace( B8_OS_TRACE_WAKE , tcb->pid , tcb->waiting_for );
+  tcb->waiting_for = TWF_NOTHING;
+  ReadyPushBack( tcb );
+}
+
+// Wakes every sleeper and timed waiter whose deadline has passed.
+static  void  _b8OsAwakeExpiredThreads(void){
+  Tcb* tcb;
+  while( (tcb = TimerFront()) && tcb->wake_up_time <= _AccumelatedTime ){
+    TimerErase( tcb );
+
+    if( tcb->waiting_for == TWF_SEMAPHORE ){
+      Semaphore* sem = _b8OsGetSemaphore( tcb->sid_wait );
+      KPANIC( sem , "invalid sem" );
+      TcbQueueErase( &sem->waiters , tcb );
+      sem->semcount++;
+      tcb->sid_wait = B8_OS_INVALID_SID;
+
+      _b8OsSetErrorInBridge( -ETIMEDOUT , tcb->pid );
+    } else if( tcb->waiting_for == TWF_COND ){
+      _b8OsCondRemove( tcb );
+      _b8OsSetErrorInBridge( -ETIMEDOUT , tcb->pid );
+    }
+    _b8OsAwakeTcb( tcb );
+  }
+}
 
-  ListPushBack( _ReadyTasksList , pid );
+static  void  _b8OsAwakeThreadWaitingForSemaphore( b8OsSid sid ){
+  Semaphore* sem = _b8OsGetSemaphore( sid );
+  KPANIC( sem , "invalid sem" );
+  Tcb* tcb = TcbQueueFront( &sem->waiters );
+  KPANIC( tcb , "no thread waiting for semaphore" );
+  TcbQueueErase( &sem->waiters , tcb );
+  tcb->sid_wait = B8_OS_INVALID_SID;
+  TimerErase( tcb );
+  _b8OsAwakeTcb( tcb );
+}
 
-  _b8OsSwitchPidAndBackToUsr( pid );
-  // It won't get here.
+static  void  _b8OsAwakeThreadWaitingForIrq(void){
+  Tcb* tcb = _IrqWaiter[ _IrqDispatched ];
+  if( NULL == tcb ) return;
+  _IrqWaiter[ _IrqDispatched ] = NULL;
+  _b8OsAwakeTcb( tcb );
 }
 
 static  void  _b8OsProcessScheduler(ReqSchedule* rs){
@@ -1142,111 +1956,226 @@ static  void  _b8OsProcessScheduler(ReqSchedule* rs){
   u32 cyccnt;
   _Config.ArchDriverGetCycleAndClear( &cyccnt );
   _CycCnt += (u64)cyccnt;
+  _SchedGeneration = _SchedGeneration + 1;
   const b8OsUsec  dt = ((u64)cyccnt * _UsPerCpuCycleFixed8 )>>8;
   _AccumelatedTime += dt;
 
   Tcb* tcb_cur = _b8OsGetCurrentTcb();
   KPANIC(tcb_cur ,"invalid tcb_cur" );
+  tcb_cur->cpu_cycles += (u64)cyccnt;
   if(tcb_cur->status == TS_READY ){
-    UsrContext2Tcb( tcb_cur );
+    _b8OsChkStackGuard( tcb_cur );
   }
 
-  // Check if there is any pid waiting for irq.
   if( rs->req & REQ_SCHEDULE_AWAKE_THREAD_WAITING_FOR_IRQ){
-    b8OsPid pid_pickup = _b8OsPickThreadWaitingForIrq();
-    if( pid_pickup != B8_OS_INVALID_PID ){
-      _b8OsAwakePid( pid_pickup );
-      // It won't get here
-    }
+    _b8OsAwakeThreadWaitingForIrq();
   }
 
   if( rs->req & REQ_SCHEDULE_REGULAR ){
-    // Check if there is any pid waiting for semaphore.
-    {
-      b8OsPid pid_pickup = _b8OsPickupThreadWaitingForSemaphoreTimeOut();
-      if( pid_pickup != B8_OS_INVALID_PID ){
-        Tcb* tcb = _b8OsGetTcb( pid_pickup );
-        KPANIC( tcb , "invalid tcb" );
-
-        Semaphore* sem = _b8OsGetSemaphore( tcb->sid_wait );
-        sem->semcount++;
-        tcb->sid_wait = B8_OS_INVALID_SID;
-
-        _b8OsSetErrorInBridge( -ETIMEDOUT , pid_pickup );
-        _b8OsGiveBridgeToUsrByPid( pid_pickup );
-
-        _b8OsAwakePid( pid_pickup );
-        // It won't get here
-      }
-    }
-
-    // Check if there is any pid waiting for timer.
-    {
-      b8OsPid pid_pickup = _b8OsPickupThreadWaitingForTimer();
-      if( pid_pickup != B8_OS_INVALID_PID ){
-        _b8OsAwakePid( pid_pickup );
-        // It won't get here
-      }
+    // Every tick ends a slice. The one-shot timer of tickless mode also
+    // fires for sleepers, which must not cut the running thread's slice.
+    const int slice_over = !_b8OsIsTickless() || tcb_cur->slice_end <= _AccumelatedTime;
+    if( slice_over && tcb_cur->scheduling_policy != B8_OS_SCHED_FIFO ){
+      ReadyRotate( tcb_cur );
+      tcb_cur->slice_end = _AccumelatedTime + SLICE_USEC;
     }
+    _b8OsAwakeExpiredThreads();
   }
 
   if( rs->req & REQ_SCHEDULE_SEMAPHORE_WAIT  ){
-    _b8OsWaitCurrentPid( TWF_SEMAPHORE );
+    Tcb* tcb_wait = _b8OsWaitCurrentPid( TWF_SEMAPHORE );
+    Semaphore* sem = _b8OsGetSemaphore( tcb_wait->sid_wait );
+    KPANIC( sem , "invalid sem" );
+    TcbQueueInsertByPriority( &sem->waiters , tcb_wait );
+    if( tcb_wait->wake_up_time != USEC_NEVER ){
+      TimerInsert( tcb_wait );
+    }
+
+  } else if( rs->req & REQ_SCHEDULE_MUTEX_WAIT ){
+    Mutex* mtx = &_Mutexes[ rs->mutex ];
+    Tcb* tcb_wait = _b8OsWaitCurrentPid( TWF_MUTEX );
+    tcb_wait->mutex_wait = rs->mutex;
+    TcbQueueInsertByPriority( &mtx->waiters , tcb_wait );
+    _b8OsMutexAttachOwner( mtx , _b8OsGetTcb( mtx->umutex->owner ) );
+    _b8OsUpdatePriority( mtx->owner );
+
+  } else if( rs->req & REQ_SCHEDULE_COND_WAIT ){
+    Cond* cv = &_Conds[ rs->cond ];
+    Tcb* tcb_wait = _b8OsWaitCurrentPid( TWF_COND );
+    tcb_wait->cond_wait = rs->cond;
+    TcbQueueInsertByPriority( &cv->waiters , tcb_wait );
+    cv->ucond->waiters++;
+    if( tcb_wait->wake_up_time != USEC_NEVER ){
+      TimerInsert( tcb_wait );
+    }
+
+  } else if( rs->req & REQ_SCHEDULE_JOIN ){
+    _b8OsWaitCurrentPid( TWF_JOIN );
 
   // yield
   } else if( rs->req & REQ_SCHEDULE_YIELD ){
-    _b8OsWaitCurrentPid(
-      _b8OsGetTcb( _CurrentPid )->irq == B8_OS_NOT_USING_IRQ ?
-      TWF_YIELD : TWF_IRQ
-    );
+    if( tcb_cur->irq == B8_OS_NOT_USING_IRQ ){
+      ReadyRotate( tcb_cur );
+    } else {
+      _IrqWaiter[ tcb_cur->irq ] = _b8OsWaitCurrentPid( TWF_IRQ );
+    }
 
   } else if( rs->req & REQ_SCHEDULE_YIELD_TIME ){
     Tcb* tcb_yield = _b8OsWaitCurrentPid( TWF_TIMER );
-    tcb_yield->wake_up_time = _AccumelatedTime + rs->sleep_time;
+    const b8OsUsec limit = USEC_NEVER - _AccumelatedTime;
+    tcb_yield->wake_up_time = _AccumelatedTime + (rs->sleep_time < limit ? rs->sleep_time : limit);
+    TimerInsert( tcb_yield );
 
   // wake up a task that is waiting for semaphore.
   } else if( rs->req & REQ_SCHEDULE_AWAKE_THREAD_WAITING_FOR_SEMAPHORE ){
-    _b8OsAwakePid( _b8OsPickupThreadWaitingForSemaphore( rs->sid ) );
-    // It won't get here
+    _b8OsAwakeThreadWaitingForSemaphore( rs->sid );
 
   // exit
   } else if( rs->req & REQ_SCHEDULE_EXIT_THREAD ){
-    ListErase( _ReadyTasksList , rs->pid );
-    ListErase( _WaitingTasksList , rs->pid );
-    ListPushBack( _ZombieTasksList , rs->pid );
+    Tcb* tcb_exit = _b8OsGetTcb( rs->pid );
+    KPANIC( tcb_exit , "invalid tcb_exit" );
+    _b8OsExitTcb( tcb_exit );
   }
 
-  // wake up TWF_YIELD
-  if( ListSize( _WaitingTasksList ) > 0 ){
-    b8OsPid pid = _b8OsPickupThreadYield();
-    if( pid != B8_OS_INVALID_PID ){
-      _b8OsAwakePid( pid );
-      // It won't get here.
+  // The idle thread is always ready at B8_OS_PRIORITY_IDLE.
+  _b8OsSwitchPidAndBackToUsr( ReadyHighest()->pid );
+  // It won't get here
+}
+
+b8OsBridgeUsr2Svc* b8OsGetBridge(void){
+  KPANIC( _b8OsGetCPSRMode() == USR_MODE , "it must be usr mode" );
+  return  b8OsCurrentBridge;
+}
+
+int  b8OsClockGetTime( u32 clkid , u64* tv_sec , u32* tv_nsec ){
+  if( !_b8OsIsClockId( clkid ) ) return -EINVAL;
+
+  // Static constructors run before b8OsReset() has set up the clock.
+  if( 0 == _Config.CpuCyclesPerSec ) return -EAGAIN;
+
+  // A scheduler pass in the middle would clear the cycle counter.
+  u32 generation;
+  u64 cycles;
+  do {
+    generation = _SchedGeneration;
+    __asm__ __volatile__( "" ::: "memory" );
+    u32 cyccnt;
+    _Config.ArchDriverGetCycle( &cyccnt );
+    cycles = _b8OsCpuCycles( clkid , cyccnt );
+    __asm__ __volatile__( "" ::: "memory" );
+  } while( generation != _SchedGeneration );
+
+  _b8OsCyclesToTime( cycles , tv_sec , tv_nsec );
+  return 0;
+}
+
+int  b8OsGetThreadStat( b8OsThreadStat* stat , int max , u64* total_cycles ){
+  if( max < 0 ) return -EINVAL;
+  b8OsBridgeUsr2Svc* bridge = b8OsSysCall(B8_OS_SYSCALL_THREAD_STAT,_b8OsCastPtr( stat ),(u32)max,0,0,0,0);
+  if( bridge->errcode < 0 ) return bridge->errcode;
+  if( total_cycles ) *total_cycles = bridge->ret_cycles;
+  return bridge->ret_count;
+}
+
+void b8OsTop(void){
+  static  b8OsThreadStat  prev[ N_MAX_THREAD ];
+  static  int             prev_num = 0;
+  static  u64             prev_total = 0;
+  b8OsThreadStat  cur[ N_MAX_THREAD ];
+  u64 total = 0;
+
+  const int num = b8OsGetThreadStat( cur , N_MAX_THREAD , &total );
+  if( num < 0 ) return;
+
+  const u64 interval = total - prev_total;
+  b8SysPuts( "PID      S PRI  CPU%  TIME(ms)\n" );
+  for( int nn=0 ; nn<num ; ++nn ){
+    const b8OsThreadStat* st = &cur[ nn ];
+    u64 last = 0;
+    for( int pp=0 ; pp<prev_num ; ++pp ){
+      if( prev[ pp ].pid == st->pid ) last = prev[ pp ].cpu_cycles;
     }
+    // Tenths of a percent.
+    const u32 permil = interval ? (u32)(((st->cpu_cycles - last) * 1000) / interval) : 0;
+    const u32 ms = (u32)((st->cpu_cycles * 1000) / _Config.CpuCyclesPerSec);
+
+    b8SysPutHex( st->pid );
+    b8SysPuts( st->state == B8_OS_THREAD_RUNNING ? " R " :
+               st->state == B8_OS_THREAD_SLEEPING ? " S " : " Z " );
+    b8SysPutNum( st->priority );
+    b8SysPuts( "  " );
+    b8SysPutNum( permil / 10 );
+    b8SysPuts( "." );
+    b8SysPutNum( permil % 10 );
+    b8SysPuts( "  " );
+    b8SysPutNum( ms );
+    b8SysPuts( st->is_idle ? "  (idle)\n" : "\n" );
   }
 
-  static int _debug_sel = 0;
-  if( ListSize( _ReadyTasksList ) > 1 ){
-    const u32 sel = 1 + (_debug_sel % (ListSize( _ReadyTasksList )-1) );
-    Node* node_pick = ListAt( _ReadyTasksList , sel );
-    if( node_pick ){
-      _debug_sel++;
-      _b8OsSwitchPidAndBackToUsr( node_pick->pid );
-      // It won't get here
-    }
+  memcpy( prev , cur , sizeof(b8OsThreadStat) * num );
+  prev_num = num;
+  prev_total = total;
+}
+
+void b8OsTraceEnable( int enable ){
+  _TraceEnabled = enable ? 1 : 0;
+}
+
+int  b8OsTraceRead( b8OsTraceEvent* ev , int max , u32* seq ){
+  u32 head = _TraceHead;
+  u32 from = *seq;
+  if( head - from > N_TRACE ) from = head - N_TRACE;
+  u32 num = head - from;
+  if( max < 0 ) max = 0;
+  if( num > (u32)max ) num = (u32)max;
+
+  for( u32 nn=0 ; nn<num ; ++nn ){
+    ev[ nn ] = _Trace[ (from + nn) & (N_TRACE-1) ];
   }
 
-  // pick up idle thread
-  Node* node_pick = ListAt( _ReadyTasksList , 0 );
-  KPANIC( node_pick , "not found idle pid" );
-  KPANIC( node_pick->pid == _IdlePid , "invalid idle pid" );
-  _b8OsSwitchPidAndBackToUsr( node_pick->pid );
-  // It won't get here
+  // Entries the kernel wrapped over while we were copying.
+  head = _TraceHead;
+  u32 skip = 0;
+  if( head - from > N_TRACE ){
+    skip = head - from - N_TRACE;
+    if( skip > num ) skip = num;
+    memmove( ev , ev + skip , (num - skip) * sizeof(b8OsTraceEvent) );
+  }
+  *seq = from + num;
+  return (int)(num - skip);
 }
 
-b8OsBridgeUsr2Svc* b8OsGetBridge(void){
-  KPANIC( _b8OsGetCPSRMode() == USR_MODE , "it must be usr mode" );
-  return  b8OsSysCall(B8_OS_SYSCALL_GET_BRIDGE,0,0,0,0,0,0);
+void b8OsTraceDump(void){
+  b8OsTraceEvent ev[ 16 ];
+  u32 seq = 0;
+  int num;
+
+  // Events recorded while printing are left out, or this would never end.
+  const u32 end = _TraceHead;
+  b8SysPuts( "B8TRACE BEGIN " );
+  b8SysPutHex( _Config.CpuCyclesPerSec );
+  b8SysPutCR();
+  while( (s32)(end - seq) > 0 ){
+    num = b8OsTraceRead( ev , end - seq < 16 ? (int)(end - seq) : 16 , &seq );
+    for( int nn=0 ; nn<num ; ++nn ){
+      b8SysPuts( "B8T " );
+      b8SysPutHex( ev[ nn ].cycle );
+      b8SysPuts( " " );
+      b8SysPutHex( ev[ nn ].pid );
+      b8SysPuts( " " );
+      b8SysPutHex( ((u32)ev[ nn ].type << 16) | ev[ nn ].arg );
+      b8SysPutCR();
+    }
+  }
+  b8SysPuts( "B8TRACE END\n" );
+}
+
+int  b8OsGetStackInfo( b8OsPid pid , size_t* size , size_t* used ){
+  b8OsBridgeUsr2Svc* bridge = b8OsSysCall(B8_OS_SYSCALL_STACK_INFO,pid,0,0,0,0,0);
+  if( bridge->errcode < 0 ) return bridge->errcode;
+  if( size ) *size = bridge->ret_stack_size;
+  if( used ) *used = bridge->ret_stack_used;
+  return B8_OS_OK;
 }
 
 static  int _b8OsIrqAttach(int irq,b8IrqHandler isr,void* arg){
@@ -1272,6 +2201,17 @@ static  int _b8OsIrqAttach(int irq,b8IrqHandler isr,void* arg){
 #define B8_MIF_ADDR             (0xffffd000)
 #define B8_MIF_DATAABORT_ADDR   _B8_REG(B8_MIF_ADDR + 0x00)
 
+extern  const u32 __mutex_swap_begin[];
+extern  const u32 __mutex_swap_end[];
+
+// An IRQ in the middle of b8OsMutexSwap() restarts it, see bootloader.S.
+static  void  _b8OsRestartMutexSwap(void){
+  const u32 pc = b8OsUsrContext[ REG_15PC ];
+  if( pc > (u32)__mutex_swap_begin && pc < (u32)__mutex_swap_end ){
+    b8OsUsrContext[ REG_15PC ] = (u32)__mutex_swap_begin;
+  }
+}
+
 void  b8OsIrqDispatchEntry(void){
   const u32 irq = B8_PIC_IAR;
   B8_SYS_ASSERT( irq != 0 , "irq == 0" );
@@ -1299,6 +2239,8 @@ void  b8OsIrqDispatchEntry(void){
     b8SysHalt();
     return;
   }
+  _b8OsRestartMutexSwap();
+  _b8OsTrace( B8_OS_TRACE_IRQ , _CurrentPid , irq );
   b8IrqHandler isr = _IrqInfo[ irq ].handler;
   isr( irq , _IrqInfo[ irq ].arg );
 }
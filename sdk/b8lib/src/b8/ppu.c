@@ -1,6 +1,5 @@
 #include <beep8.h>
-
-#define CHKOVL() _ASSERT( cmd_->sp < cmd_->tail , "ppu cmd overflow" )
+#include <string.h>
 
 union	fc32 {
   u32 	aU32;
@@ -8,20 +7,81 @@ union	fc32 {
   b8PpuJmp* pJmp;
 };
 
+/*
+  Commands are allocated from the buffer, then from the overflow segment given
+  to b8PpuCmdSetOverflow(). The last word of a segment is kept for the JMP into
+  the next one or for a HALT, so a segment can end between any two commands.
+  Once every segment is full, allocations return a scratch area that is never
+  linked anywhere, and are counted in `dropped`.
+*/
+#define DROP_AREA_WORDS (16)
+static  u32   _drop_area[ DROP_AREA_WORDS ];
+
+static  int   _b8PpuIsDropped( const void* pp ){
+  return  pp == (const void*)_drop_area;
+}
+
+static  u32*  _b8PpuCmdDrop( b8PpuCmd* cmd_ , u32 words_ ){
+  _ASSERT( words_ <= DROP_AREA_WORDS , "invalid command size" );
+  ++cmd_->dropped;
+  return  _drop_area;
+}
+
+static  u32*  _b8PpuCmdAlloc( b8PpuCmd* cmd_ , u32 bytesize_ , int use_reserve_ ){
+  const u32 words = bytesize_ / sizeof(u32);
+  const u32 reserve = use_reserve_ ? 0 : 1;
+
+  if( cmd_->sp + words + reserve > cmd_->tail ){
+    if( NULL == cmd_->ovl_buff || cmd_->sp >= cmd_->tail ) return _b8PpuCmdDrop( cmd_ , words );
+
+    b8PpuJmp* jmp = (b8PpuJmp*)cmd_->sp;
+    jmp->code = B8_PPU_CMD_JMP;
+    union fc32 fc;
+    fc.pU32 = cmd_->ovl_buff;
+    jmp->cpuaddr4 = fc.aU32>>2;
+
+    cmd_->words_prev += (u32)(cmd_->sp + 1 - cmd_->seg);
+    cmd_->seg = cmd_->sp = cmd_->ovl_buff;
+    cmd_->tail = cmd_->ovl_buff + cmd_->ovl_bytesize / sizeof(u32);
+    cmd_->ovl_buff = NULL;
+    if( cmd_->sp + words + reserve > cmd_->tail ) return _b8PpuCmdDrop( cmd_ , words );
+  }
+
+  u32* pp = cmd_->sp;
+  cmd_->sp += words;
+  return  pp;
+}
+
+
 void  b8PpuCmdSetBuff( b8PpuCmd* cmd_ , u32* buff_ , u32 bytesize_ ){
-  cmd_->sp = cmd_->buff = buff_;
+  cmd_->seg = cmd_->sp = cmd_->buff = buff_;
   cmd_->bytesize = bytesize_;
   cmd_->tail = cmd_->sp + bytesize_ / sizeof(u32);
+  cmd_->ovl_buff = NULL;
+  cmd_->ovl_bytesize = 0;
+  cmd_->words_prev = 0;
+  cmd_->dropped = 0;
 }
+
+void  b8PpuCmdSetOverflow( b8PpuCmd* cmd_ , u32* buff_ , u32 bytesize_ ){
+  cmd_->ovl_buff = buff_;
+  cmd_->ovl_bytesize = buff_ ? bytesize_ : 0;
+}
+
+u32   b8PpuCmdUsedWords( const b8PpuCmd* cmd_ ){
+  return  cmd_->words_prev + (u32)(cmd_->sp - cmd_->seg);
+}
+
+u32*  b8PpuCmdAlloc( b8PpuCmd* cmd_ , u32 words_ ){
+  return  _b8PpuCmdAlloc( cmd_ , words_ * sizeof(u32) , 0 );
+}
+
 void  b8PpuCmdPush( b8PpuCmd* cmd_ , u32 word_ ){
-  CHKOVL();
-  *( cmd_->sp++ ) = word_;
+  *b8PpuCmdAlloc( cmd_ , 1 ) = word_;
 }
 
 b8PpuRect* b8PpuRectAlloc( b8PpuCmd* cmd_ ){
-  b8PpuRect* pp = (b8PpuRect*)cmd_->sp;
-  cmd_->sp = (u32*)(pp+1);
-  CHKOVL();
+  b8PpuRect* pp = (b8PpuRect*)_b8PpuCmdAlloc( cmd_ , sizeof( b8PpuRect ) , 0 );
   pp->code = B8_PPU_CMD_RECT;
   return pp;
 }
@@ -39,9 +99,7 @@ b8PpuRect* b8PpuRectAllocZPB( b8PpuCmd* cmd_ , u32 otz_ ){
 }
 
 b8PpuSprite* b8PpuSpriteAlloc( b8PpuCmd* cmd_ ){
-  b8PpuSprite* pp = (b8PpuSprite*)cmd_->sp;
-  cmd_->sp = (u32*)(pp+1);
-  CHKOVL();
+  b8PpuSprite* pp = (b8PpuSprite*)_b8PpuCmdAlloc( cmd_ , sizeof( b8PpuSprite ) , 0 );
   pp->code = B8_PPU_CMD_SPRITE;
   pp->vfp = pp->hfp = 0;
   return pp;
@@ -60,9 +118,7 @@ b8PpuSprite* b8PpuSpriteAllocZPB( b8PpuCmd* cmd_ , u32 otz_ ){
 }
 
 b8PpuSetpal* b8PpuSetpalAlloc( b8PpuCmd* cmd_ ){
-  b8PpuSetpal* pp = (b8PpuSetpal*)cmd_->sp;
-  cmd_->sp = (u32*)(pp+1);
-  CHKOVL();
+  b8PpuSetpal* pp = (b8PpuSetpal*)_b8PpuCmdAlloc( cmd_ , sizeof( b8PpuSetpal ) , 0 );
   pp->code = B8_PPU_CMD_SETPAL;
   pp->palsel = 0;
   pp->wmask = 0xffff;
@@ -98,21 +154,191 @@ b8PpuSetpal* b8PpuSetpalAllocZPB( b8PpuCmd* cmd_ , u32 otz_ , u8 flush ){
   return setpal;
 }
 
+void  b8PpuPalCacheReset( b8PpuPalCache* pc_ , b8PpuCmd* cmd_ ){
+  memset( pc_ , 0 , sizeof( *pc_ ) );
+  pc_->cmd = cmd_;
+}
+
+void  b8PpuPalCacheSet( b8PpuPalCache* pc_ , u32 otz_ , u32 palsel , u16 wmask , const u8* pidx ){
+  _ASSERT( palsel < 16 , "invalid palsel" );
+  if( pc_->pending && pc_->otz != otz_ ) b8PpuPalCacheCommit( pc_ );
+
+  const u16 known = (pc_->zknown[ palsel ] == otz_) ? pc_->known[ palsel ] : 0;
+  u8* dst = pc_->pidx[ palsel ];
+  for( u32 ii=0 ; ii < 16 ; ++ii ){
+    const u16 bit = 1<<ii;
+    if( 0 == (wmask & bit) ) continue;
+
+    const u8 value = pidx[ ii ] & 15;
+    if( (known & bit) && !(pc_->wmask[ palsel ] & bit) && dst[ ii ] == value ) continue;
+    dst[ ii ] = value;
+    pc_->wmask[ palsel ] |= bit;
+  }
+
+  if( pc_->wmask[ palsel ] ){
+    pc_->pending |= 1<<palsel;
+    pc_->otz = otz_;
+  }
+}
+
+void  b8PpuPalCacheCommit( b8PpuPalCache* pc_ ){
+  if( 0 == pc_->pending ) return;
+
+  for( u32 palsel=0 ; palsel < 16 ; ++palsel ){
+    if( 0 == (pc_->pending & (1<<palsel)) ) continue;
+
+    const u8* src = pc_->pidx[ palsel ];
+    b8PpuSetpal* pp = b8PpuSetpalAllocZPB( pc_->cmd , pc_->otz , 0 );
+    pp->palsel = palsel;
+    pp->wmask = pc_->wmask[ palsel ];
+    pp->pidx0 = src[0];   pp->pidx1 = src[1];   pp->pidx2 = src[2];   pp->pidx3 = src[3];
+    pp->pidx4 = src[4];   pp->pidx5 = src[5];   pp->pidx6 = src[6];   pp->pidx7 = src[7];
+    pp->pidx8 = src[8];   pp->pidx9 = src[9];   pp->pidx10= src[10];  pp->pidx11= src[11];
+    pp->pidx12= src[12];  pp->pidx13= src[13];  pp->pidx14= src[14];  pp->pidx15= src[15];
+
+    if( pc_->zknown[ palsel ] != pc_->otz ){
+      pc_->zknown[ palsel ] = pc_->otz;
+      pc_->known[ palsel ] = 0;
+    }
+    pc_->known[ palsel ] |= pc_->wmask[ palsel ];
+    pc_->wmask[ palsel ] = 0;
+  }
+  pc_->pending = 0;
+
+  b8PpuFlush* pf = b8PpuFlushAlloc( pc_->cmd );
+  pf->pal = 1;
+  b8PpuPushBackOT( pc_->cmd , pc_->otz , pf );
+}
+
+/*
+  The dump walks a list the way the PPU does, printing each command with its
+  address, and the image and tile data that LOADIMG and BG read. tool/b8ppuref
+  replays it on the host.
+*/
+static  int   _dump_enable;
+
+static  u32   _b8PpuCmdWords( u32 code_ ){
+  switch( code_ ){
+    case B8_PPU_CMD_NOP:        return  sizeof( b8PpuNop ) / sizeof(u32);
+    case B8_PPU_CMD_FLUSH:      return  sizeof( b8PpuFlush ) / sizeof(u32);
+    case B8_PPU_CMD_ENABLE:     return  sizeof( b8PpuEnable ) / sizeof(u32);
+    case B8_PPU_CMD_RECT:       return  sizeof( b8PpuRect ) / sizeof(u32);
+    case B8_PPU_CMD_POLY:       return  sizeof( b8PpuPoly ) / sizeof(u32);
+    case B8_PPU_CMD_SPRITE:     return  sizeof( b8PpuSprite ) / sizeof(u32);
+    case B8_PPU_CMD_SETPAL:     return  sizeof( b8PpuSetpal ) / sizeof(u32);
+    case B8_PPU_CMD_BG:         return  sizeof( b8PpuBg ) / sizeof(u32);
+    case B8_PPU_CMD_SCISSOR:    return  sizeof( b8PpuScissor ) / sizeof(u32);
+    case B8_PPU_CMD_VIEWOFFSET: return  sizeof( b8PpuViewoffset ) / sizeof(u32);
+    case B8_PPU_CMD_LOADIMG:    return  sizeof( b8PpuLoadimg ) / sizeof(u32);
+    case B8_PPU_CMD_LINE:       return  sizeof( b8PpuLine ) / sizeof(u32);
+    case B8_PPU_CMD_JMP:        return  sizeof( b8PpuJmp ) / sizeof(u32);
+    case B8_PPU_CMD_HALT:       return  sizeof( b8PpuHalt ) / sizeof(u32);
+  }
+  return  0;
+}
+
+static  void  _b8PpuDumpWords( const char* tag_ , const u32* pp_ , u32 words_ ){
+  while( words_ ){
+    const u32 num = words_ < 8 ? words_ : 8;
+    b8SysPuts( tag_ );
+    b8SysPutHex( (u32)pp_ );
+    for( u32 nn=0 ; nn < num ; ++nn ){
+      b8SysPuts( " " );
+      b8SysPutHex( pp_[ nn ] );
+    }
+    b8SysPutCR();
+    pp_ += num;
+    words_ -= num;
+  }
+}
+
+static  void  _b8PpuDumpBytes( const void* addr_ , u32 bytesize_ ){
+  const u32 head = (u32)addr_ & ~3u;
+  const u32 tail = ((u32)addr_ + bytesize_ + 3) & ~3u;
+  _b8PpuDumpWords( "B8M " , (const u32*)head , (tail - head) / sizeof(u32) );
+}
+
+void  b8PpuDumpEnable( int enable_ ){
+  _dump_enable = enable_;
+}
+
+void  b8PpuDump( const b8PpuCmd* cmd_ ){
+  const u32* pc = cmd_->buff;
+
+  b8SysPuts( "B8PPU BEGIN " );
+  b8SysPutHex( (u32)pc );
+  b8SysPutCR();
+
+  // The bound stops a list that loops.
+  for( u32 cnt=0 ; cnt < 0x100000 ; ++cnt ){
+    const u32 code = *pc >> 24;
+    const u32 words = _b8PpuCmdWords( code );
+    if( 0 == words ) break;
+    _b8PpuDumpWords( "B8P " , pc , words );
+
+    if( B8_PPU_CMD_HALT == code ) break;
+    if( B8_PPU_CMD_JMP == code ){
+      pc = (const u32*)( ((const b8PpuJmp*)pc)->cpuaddr4 << 2 );
+      continue;
+    }
+    if( B8_PPU_CMD_LOADIMG == code ){
+      const b8PpuLoadimg* pp = (const b8PpuLoadimg*)pc;
+      const u32 stride = pp->srcwtile * 4;
+      _b8PpuDumpBytes( pp->cpuaddr + pp->srcytile * 8 * stride , pp->trnhtile * 8 * stride );
+    }
+    if( B8_PPU_CMD_BG == code ){
+      const b8PpuBg* pp = (const b8PpuBg*)pc;
+      _b8PpuDumpBytes( pp->cpuaddr , (sizeof( b8PpuBgTile ) << pp->wtile) << pp->htile );
+    }
+    pc += words;
+  }
+  b8SysPuts( "B8PPU END\n" );
+}
+
 void  b8PpuExec( b8PpuCmd* cmd_ ){
-  CHKOVL();
+  _ASSERT( cmd_->sp <= cmd_->tail , "ppu cmd overflow" );
+  if( _dump_enable ) b8PpuDump( cmd_ );
   __asm("nop");
   B8_PPU_EXEC = (B8_PPU_EXEC_START<<24) | (u32) cmd_->buff;
   __asm("nop");
 }
 
+/*
+  A command list is done once a V-blank has passed since it was kicked.
+  Fences count the V-blanks consumed by b8PpuVsyncWait(), so a fence is
+  the count the list is done at.
+*/
+static  u32   _vblank_seq;
+static  u32   _fence_issued;
+
+u32   b8PpuExecFence( b8PpuCmd* cmd_ ){
+  // The PPU runs one list at a time.
+  b8PpuFenceWait( _fence_issued );
+  b8PpuExec( cmd_ );
+
+  // V-blanks still pending were raised before the kick, or so soon after
+  // that they can't count for this list.
+  const int pending = b8SysIrqPending( B8_IRQ_VBLK );
+  _fence_issued = _vblank_seq + (pending > 0 ? (u32)pending : 0) + 1;
+  return  _fence_issued;
+}
+
+int   b8PpuFenceDone( u32 fence_ ){
+  return  (s32)(_vblank_seq - fence_) >= 0;
+}
+
+void  b8PpuFenceWait( u32 fence_ ){
+  while( !b8PpuFenceDone( fence_ ) ){
+    b8PpuVsyncWait();
+  }
+}
+
 void  b8PpuEnableVblankInterrupt( void ){
   B8_PPU_INTCTRL = 1;
 }
 
 b8PpuScissor* b8PpuScissorAlloc( b8PpuCmd* cmd_ ){
-  b8PpuScissor* pp = (b8PpuScissor*)cmd_->sp;
-  cmd_->sp = (u32*)(pp+1);
-  CHKOVL();
+  b8PpuScissor* pp = (b8PpuScissor*)_b8PpuCmdAlloc( cmd_ , sizeof( b8PpuScissor ) , 0 );
   pp->code = B8_PPU_CMD_SCISSOR;
   return pp;
 }
@@ -130,8 +356,7 @@ b8PpuScissor* b8PpuScissorAllocZPB( b8PpuCmd* cmd_ , u32 otz_ ){
 }
 
 b8PpuBg* b8PpuBgAlloc( b8PpuCmd* cmd_ ){
-  b8PpuBg* pp = (b8PpuBg*)cmd_->sp;
-  cmd_->sp = (u32*)(pp+1);
+  b8PpuBg* pp = (b8PpuBg*)_b8PpuCmdAlloc( cmd_ , sizeof( b8PpuBg ) , 0 );
   pp->code = B8_PPU_CMD_BG;
   pp->vwrap = pp->uwrap = B8_PPU_BG_WRAP_CLAMP;
   return pp;
@@ -150,9 +375,7 @@ b8PpuBg* b8PpuBgAllocZPB( b8PpuCmd* cmd_ , u32 otz_ ){
 }
 
 b8PpuPoly* b8PpuPolyAlloc( b8PpuCmd* cmd_ ){
-  b8PpuPoly* pp = (b8PpuPoly*)cmd_->sp;
-  cmd_->sp = (u32*)(pp+1);
-  CHKOVL();
+  b8PpuPoly* pp = (b8PpuPoly*)_b8PpuCmdAlloc( cmd_ , sizeof( b8PpuPoly ) , 0 );
   pp->code = B8_PPU_CMD_POLY;
   return pp;
 }
@@ -170,9 +393,7 @@ b8PpuPoly* b8PpuPolyAllocZPB( b8PpuCmd* cmd_ , u32 otz_ ){
 }
 
 b8PpuLine* b8PpuLineAlloc( b8PpuCmd* cmd_ ){
-  b8PpuLine* pp = (b8PpuLine*)cmd_->sp;
-  cmd_->sp = (u32*)(pp+1);
-  CHKOVL();
+  b8PpuLine* pp = (b8PpuLine*)_b8PpuCmdAlloc( cmd_ , sizeof( b8PpuLine ) , 0 );
   pp->code = B8_PPU_CMD_LINE;
   return pp;
 }
@@ -190,9 +411,7 @@ b8PpuLine* b8PpuLineAllocZPB( b8PpuCmd* cmd_ , u32 otz_ ){
 }
 
 b8PpuViewoffset* b8PpuViewoffsetAlloc( b8PpuCmd* cmd_ ){
-  b8PpuViewoffset* pp = (b8PpuViewoffset*)cmd_->sp;
-  cmd_->sp = (u32*)(pp+1);
-  CHKOVL();
+  b8PpuViewoffset* pp = (b8PpuViewoffset*)_b8PpuCmdAlloc( cmd_ , sizeof( b8PpuViewoffset ) , 0 );
   pp->code = B8_PPU_CMD_VIEWOFFSET;
   return pp;
 }
@@ -210,9 +429,7 @@ b8PpuViewoffset* b8PpuViewoffsetAllocZPB( b8PpuCmd* cmd_ , u32 otz_ ){
 }
 
 b8PpuNop* b8PpuNopAlloc( b8PpuCmd* cmd_ ){
-  b8PpuNop* pp = (b8PpuNop*)cmd_->sp;
-  cmd_->sp = (u32*)(pp+1);
-  CHKOVL();
+  b8PpuNop* pp = (b8PpuNop*)_b8PpuCmdAlloc( cmd_ , sizeof( b8PpuNop ) , 0 );
   pp->code = B8_PPU_CMD_NOP;
   return pp;
 }
@@ -230,9 +447,7 @@ b8PpuNop* b8PpuNopAllocZPB( b8PpuCmd* cmd_ , u32 otz_ ){
 }
 
 b8PpuFlush* b8PpuFlushAlloc( b8PpuCmd* cmd_ ){
-  b8PpuFlush* pp = (b8PpuFlush*)cmd_->sp;
-  cmd_->sp = (u32*)(pp+1);
-  CHKOVL();
+  b8PpuFlush* pp = (b8PpuFlush*)_b8PpuCmdAlloc( cmd_ , sizeof( b8PpuFlush ) , 0 );
   pp->code = B8_PPU_CMD_FLUSH;
   pp->img = pp->pal = 0;
   return pp;
@@ -251,9 +466,7 @@ b8PpuFlush* b8PpuFlushAllocZPB( b8PpuCmd* cmd_ , u32 otz_ ){
 }
 
 b8PpuHalt* b8PpuHaltAlloc( b8PpuCmd* cmd_ ){
-  b8PpuHalt* pp = (b8PpuHalt*)cmd_->sp;
-  cmd_->sp = (u32*)(pp+1);
-  CHKOVL();
+  b8PpuHalt* pp = (b8PpuHalt*)_b8PpuCmdAlloc( cmd_ , sizeof( b8PpuHalt ) , 1 );
   pp->code = B8_PPU_CMD_HALT;
   return pp;
 }
@@ -271,9 +484,7 @@ b8PpuHalt* b8PpuHaltAllocZPB( b8PpuCmd* cmd_ , u32 otz_ ){
 }
 
 b8PpuEnable* b8PpuEnableAlloc( b8PpuCmd* cmd_ ){
-  b8PpuEnable* pp = (b8PpuEnable*)cmd_->sp;
-  cmd_->sp = (u32*)(pp+1);
-  CHKOVL();
+  b8PpuEnable* pp = (b8PpuEnable*)_b8PpuCmdAlloc( cmd_ , sizeof( b8PpuEnable ) , 0 );
   pp->code = B8_PPU_CMD_ENABLE;
   pp->cul = 0;
   return pp;
@@ -292,9 +503,7 @@ b8PpuEnable* b8PpuEnableAllocZPB( b8PpuCmd* cmd_ , u32 otz_ ){
 }
 
 b8PpuLoadimg* b8PpuLoadimgAlloc( b8PpuCmd* cmd_ ){
-  b8PpuLoadimg* pp = (b8PpuLoadimg*)cmd_->sp;
-  cmd_->sp = (u32*)(pp+1);
-  CHKOVL();
+  b8PpuLoadimg* pp = (b8PpuLoadimg*)_b8PpuCmdAlloc( cmd_ , sizeof( b8PpuLoadimg ) , 0 );
   pp->code = B8_PPU_CMD_LOADIMG;
   return pp;
 }
@@ -312,9 +521,7 @@ b8PpuLoadimg* b8PpuLoadimgAllocZPB( b8PpuCmd* cmd_ , u32 otz_ ){
 }
 
 b8PpuJmp* b8PpuJmpAlloc( b8PpuCmd* cmd_ , u32* cpuaddr_ ){
-  b8PpuJmp* pp = (b8PpuJmp*)cmd_->sp;
-  cmd_->sp = (u32*)(pp+1);
-  CHKOVL();
+  b8PpuJmp* pp = (b8PpuJmp*)_b8PpuCmdAlloc( cmd_ , sizeof( b8PpuJmp ) , 0 );
   pp->code = B8_PPU_CMD_JMP;
 
   union fc32 fc;
@@ -324,37 +531,108 @@ b8PpuJmp* b8PpuJmpAlloc( b8PpuCmd* cmd_ , u32* cpuaddr_ ){
   return pp;
 }
 
+// Links an OT entry to the one below it, as an empty bucket.
+static  void  _b8PpuResetOTEntry( b8PpuCmd* cmd_ , u32 otz_ ){
+  b8PpuJmp* jmp = (b8PpuJmp*) &cmd_->ot[ otz_ ];
+  jmp->code = B8_PPU_CMD_JMP;
+
+  union fc32 fc_prev;
+  if( 0 == otz_ ){
+    fc_prev.pU32 = cmd_->addr_halt;
+  } else {
+    fc_prev.pU32 = &cmd_->ot[ otz_ - 1];
+  }
+  jmp->cpuaddr4 = fc_prev.aU32>>2;
+
+  union fc32 fc;
+  fc.pU32 = cmd_->ot + otz_;
+  cmd_->ot_prev[ otz_ ] = fc.aU32;
+}
+
+static  void  _b8PpuMarkOT( b8PpuCmd* cmd_ , u32 otz_ ){
+  if( cmd_->ot_used ) cmd_->ot_used[ otz_ >> 5 ] |= 1u << (otz_ & 31);
+}
+
+static  void  _b8PpuRedirectOT( b8PpuCmd* cmd_ , u32 otz_ , u32* dst_ ){
+  union fc32 fc;
+  fc.pU32 = dst_;
+  ((b8PpuJmp*)(cmd_->ot + otz_))->cpuaddr4 = fc.aU32>>2;
+}
+
 void  b8PpuClearOT( b8PpuCmd* cmd_ , u32* ot_ , u32* ot_prev_ , u32 num_ ){
   cmd_->ot = ot_;
   cmd_->ot_prev = ot_prev_;
   cmd_->otnum = num_;
+  cmd_->ot_used = NULL;
   b8PpuJmpAlloc( cmd_ , &ot_[ num_ - 1 ] );
 
   cmd_->addr_halt = (u32*)b8PpuHaltAlloc( cmd_ );
 
   for( u32 otz=0 ; otz < num_ ; ++otz ){
-    b8PpuJmp* jmp = (b8PpuJmp*) &ot_[ otz ];
-    jmp->code = B8_PPU_CMD_JMP;
+    _b8PpuResetOTEntry( cmd_ , otz );
+  }
+}
+
+void  b8PpuClearOTSparse( b8PpuCmd* cmd_ , u32* ot_ , u32* ot_prev_ , u32* used_ , u32 num_ ){
+  const u32 words = B8_PPU_OT_USED_WORDS( num_ ) - 1;
+
+  // The last word tells whether the OT has been linked once already.
+  if( 0 == used_[ words ] ){
+    b8PpuClearOT( cmd_ , ot_ , ot_prev_ , num_ );
+    cmd_->ot_used = used_;
+    used_[ words ] = 1;
+    return;
+  }
+
+  cmd_->ot = ot_;
+  cmd_->ot_prev = ot_prev_;
+  cmd_->otnum = num_;
+  cmd_->ot_used = used_;
+  b8PpuJmpAlloc( cmd_ , &ot_[ num_ - 1 ] );
 
-    union fc32 fc_prev;
-    if( 0 == otz ){
-      fc_prev.pU32 = cmd_->addr_halt;
-    } else {
-      fc_prev.pU32 = &ot_[ otz - 1];
+  cmd_->addr_halt = (u32*)b8PpuHaltAlloc( cmd_ );
+
+  // Only the used buckets, and the entries b8PpuLinkOT() redirected, changed.
+  _b8PpuResetOTEntry( cmd_ , 0 );
+  _b8PpuResetOTEntry( cmd_ , num_ - 1 );
+  for( u32 ww=0 ; ww < words ; ++ww ){
+    u32 bits = used_[ ww ];
+    used_[ ww ] = 0;
+    while( bits ){
+      const u32 otz = (ww << 5) + (u32)__builtin_ctz( bits );
+      bits &= bits - 1;
+      _b8PpuResetOTEntry( cmd_ , otz );
+      if( otz > 0 ) _b8PpuResetOTEntry( cmd_ , otz - 1 );
     }
-    jmp->cpuaddr4 = fc_prev.aU32>>2;
+  }
+}
 
-    union fc32 fc;
-    fc.pU32 = ot_ + otz;
-    cmd_->ot_prev[ otz ] = fc.aU32;
+void  b8PpuLinkOT( b8PpuCmd* cmd_ ){
+  if( NULL == cmd_->ot_used ) return;
+
+  // `gap` is the empty entry the PPU reaches after the last used bucket.
+  s32 gap = (s32)cmd_->otnum - 1;
+  for( s32 ww = (s32)B8_PPU_OT_USED_WORDS( cmd_->otnum ) - 2 ; ww >= 0 ; --ww ){
+    u32 bits = cmd_->ot_used[ ww ];
+    while( bits ){
+      const u32 bit = 31 - (u32)__builtin_clz( bits );
+      bits &= ~(1u << bit);
+
+      const s32 otz = (ww << 5) + (s32)bit;
+      if( gap > otz ) _b8PpuRedirectOT( cmd_ , (u32)gap , cmd_->ot + otz );
+      gap = otz - 1;
+    }
   }
+  if( gap >= 0 ) _b8PpuRedirectOT( cmd_ , (u32)gap , cmd_->addr_halt );
 }
 
 void  b8PpuPushFrontOT( b8PpuCmd* cmd_ , u32 otz_ , void* prim_ ){
   _ASSERT( otz_ < cmd_->otnum , "invalid otz_" );
+  if( _b8PpuIsDropped( prim_ ) ) return;
 
-  *( cmd_->sp++ ) = *(cmd_->ot + otz_);
-  CHKOVL();
+  u32* link = _b8PpuCmdAlloc( cmd_ , sizeof(u32) , 0 );
+  if( _b8PpuIsDropped( link ) ) return;
+  *link = *(cmd_->ot + otz_);
 
   union fc32 fc_prim;
   fc_prim.pU32 = prim_;
@@ -362,24 +640,81 @@ void  b8PpuPushFrontOT( b8PpuCmd* cmd_ , u32 otz_ , void* prim_ ){
   union fc32 fc_ot;
   fc_ot.pJmp = (b8PpuJmp*)(cmd_->ot + otz_);
   fc_ot.pJmp->cpuaddr4 = fc_prim.aU32>>2;
+  _b8PpuMarkOT( cmd_ , otz_ );
 }
 
 void  b8PpuPushBackOT( b8PpuCmd* cmd_ , u32 otz_ , void* prim_ ){
   _ASSERT( otz_ < cmd_->otnum , "invalid otz_" );
+  if( _b8PpuIsDropped( prim_ ) ) return;
+
+  u32* link = _b8PpuCmdAlloc( cmd_ , sizeof(u32) , 0 );
+  if( _b8PpuIsDropped( link ) ) return;
 
   union fc32 fc_jmp;
   fc_jmp.aU32 = cmd_->ot_prev[ otz_ ];
 
   union fc32 fc_jmp_back;
-  fc_jmp_back.pU32 = cmd_->sp;
-  *( cmd_->sp++ ) = *fc_jmp.pU32;
-  CHKOVL();
+  fc_jmp_back.pU32 = link;
+  *link = *fc_jmp.pU32;
 
   union fc32 fc_prim;
   fc_prim.pU32 = prim_;
   fc_jmp.pJmp->cpuaddr4 = fc_prim.aU32>>2;
 
   cmd_->ot_prev[ otz_ ] = fc_jmp_back.aU32;
+  _b8PpuMarkOT( cmd_ , otz_ );
+}
+
+void  b8PpuDlBegin( b8PpuDl* dl_ , u32* buff_ , u32 bytesize_ ){
+  b8PpuCmdSetBuff( &dl_->cmd , buff_ , bytesize_ );
+  dl_->head = buff_;
+  dl_->exit = NULL;
+}
+
+void  b8PpuDlEnd( b8PpuDl* dl_ ){
+  dl_->exit = (u32*)b8PpuHaltAlloc( &dl_->cmd );
+}
+
+void  b8PpuDlPushFrontOT( b8PpuCmd* cmd_ , u32 otz_ , b8PpuDl* dl_ ){
+  _ASSERT( otz_ < cmd_->otnum , "invalid otz_" );
+  _ASSERT( dl_->exit , "b8PpuDlEnd() is missing" );
+
+  // The display list takes the place of the primitive and its jump.
+  *dl_->exit = *(cmd_->ot + otz_);
+
+  union fc32 fc_head;
+  fc_head.pU32 = dl_->head;
+  ((b8PpuJmp*)(cmd_->ot + otz_))->cpuaddr4 = fc_head.aU32>>2;
+  _b8PpuMarkOT( cmd_ , otz_ );
+}
+
+void  b8PpuDlPushBackOT( b8PpuCmd* cmd_ , u32 otz_ , b8PpuDl* dl_ ){
+  _ASSERT( otz_ < cmd_->otnum , "invalid otz_" );
+  _ASSERT( dl_->exit , "b8PpuDlEnd() is missing" );
+
+  union fc32 fc_jmp;
+  fc_jmp.aU32 = cmd_->ot_prev[ otz_ ];
+  *dl_->exit = *fc_jmp.pU32;
+
+  union fc32 fc_head;
+  fc_head.pU32 = dl_->head;
+  fc_jmp.pJmp->cpuaddr4 = fc_head.aU32>>2;
+
+  union fc32 fc_exit;
+  fc_exit.pU32 = dl_->exit;
+  cmd_->ot_prev[ otz_ ] = fc_exit.aU32;
+  _b8PpuMarkOT( cmd_ , otz_ );
+}
+
+void  b8PpuDlLink( b8PpuCmd* cmd_ , b8PpuDl* dl_ ){
+  _ASSERT( dl_->exit , "b8PpuDlEnd() is missing" );
+  if( _b8PpuIsDropped( b8PpuJmpAlloc( cmd_ , dl_->head ) ) ) return;
+  b8PpuJmp* back = (b8PpuJmp*)dl_->exit;
+  back->code = B8_PPU_CMD_JMP;
+
+  union fc32 fc_back;
+  fc_back.pU32 = cmd_->sp;
+  back->cpuaddr4 = fc_back.aU32>>2;
 }
 
 void  b8PpuReset( void ){
@@ -389,6 +724,7 @@ void  b8PpuReset( void ){
 
 void  b8PpuVsyncWait( void ){
   b8SysIrqWait( B8_IRQ_VBLK );
+  ++_vblank_seq;
 }
 
 void  b8PpuGetResolution( u32* ww, u32* hh ){
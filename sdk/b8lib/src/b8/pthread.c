@@ -46,13 +46,17 @@ int pthread_create(
       break;
   }
 
+  if( attr->priority < 0 || attr->priority > B8_OS_PRIORITY_MAX ){
+    return  EINVAL;
+  }
+
   b8OsBridgeUsr2Svc* bridge = b8OsSysCall(
     B8_OS_SYSCALL_THREAD_CREATE,
     _CastPtr( attr->stackaddr ),
     attr->stacksize,
     _CastPtr( startroutine),
     _CastPtr( arg ),
-    policy,
+    policy | ((u32)attr->priority << 8) | ((u32)(attr->detachstate == PTHREAD_CREATE_DETACHED) << 16),
     attr->irq_no
   );
   *thread = bridge->ret_pid;
@@ -67,7 +71,7 @@ int pthread_attr_init(pthread_attr_t* attr){
   attr->stacksize = 0x400;
   attr->policy = 0;
   attr->detachstate = 0;
-  attr->priority = SCHED_RR;
+  attr->priority = 0;
   attr->irq_no = B8_OS_NOT_USING_IRQ;
   return  0;
 }
@@ -123,22 +127,35 @@ int pthread_attr_getstack(const pthread_attr_t *attr, void **stackaddr, long *st
 }
 
 int pthread_getschedparam(pthread_t thread, int* policy, struct sched_param* param){
-  (void)thread;  // Mark thread as unused
-  (void)policy;  // Mark policy as unused
-  (void)param;   // Mark param as unused
-  return  ENOSYS;
+  if( !policy || !param ){
+    return  EINVAL;
+  }
+  b8OsBridgeUsr2Svc* bridge = b8OsSysCall( B8_OS_SYSCALL_SCHED_GETPARAM,thread,0,0,0,0,0);
+  if( bridge->errcode < 0 ){
+    return  - bridge->errcode;
+  }
+  *policy = bridge->ret_policy;
+  param->sched_priority = bridge->ret_priority;
+  return  0;
 }
 
 int pthread_setschedparam(pthread_t thread, int policy, const struct sched_param* param){
-  (void)thread;  // Mark thread as unused
-  (void)policy;  // Mark policy as unused
-  (void)param;   // Mark param as unused
-  return  ENOSYS;  
+  if( !param ){
+    return  EINVAL;
+  }
+  b8OsBridgeUsr2Svc* bridge = b8OsSysCall(
+    B8_OS_SYSCALL_SCHED_SETPARAM,
+    thread,
+    policy,
+    param->sched_priority,
+    0,0,0
+  );
+  return  - bridge->errcode;
 }
 
 int  pthread_detach(pthread_t thread){
-  (void)thread;
-  return  ENOSYS;
+  b8OsBridgeUsr2Svc* bridge = b8OsSysCall( B8_OS_SYSCALL_THREAD_DETACH,thread,0,0,0,0,0);
+  return  - bridge->errcode;
 }
 
 int pthread_attr_setschedpolicy(pthread_attr_t *attr, int policy){
@@ -167,6 +184,9 @@ int pthread_attr_setschedparam(
   if (!attr || !param) {
     return  EINVAL;
   }
+  if( param->sched_priority < 0 || param->sched_priority > B8_OS_PRIORITY_MAX ){
+    return  EINVAL;
+  }
   attr->priority = (short)param->sched_priority;
   return  0;
 }
@@ -206,8 +226,8 @@ int pthread_attr_getdetachstate(
 }
 
 void pthread_exit(pthread_addr_t value){
-  (void)value;
-  while(1) b8OsSysCall( B8_OS_SYSCALL_SCHED_SLEEP,0,0xffffffff,0,0,0,0 );
+  b8OsSysCall( B8_OS_SYSCALL_EXIT,_CastPtr( value ),0,0,0,0,0);
+  // It won't get here
 }
 
 int  pthread_cancel(pthread_t thread){
@@ -216,9 +236,14 @@ int  pthread_cancel(pthread_t thread){
 }
 
 int  pthread_join(pthread_t thread, pthread_addr_t *value){
-  (void)thread;
-  (void)value;
-  return  ENOSYS;
+  b8OsBridgeUsr2Svc* bridge = b8OsSysCall( B8_OS_SYSCALL_THREAD_JOIN,thread,0,0,0,0,0);
+  if( bridge->errcode < 0 ){
+    return  - bridge->errcode;
+  }
+  if( value ){
+    *value = bridge->ret_value;
+  }
+  return  0;
 }
 
 int pthread_yield(void){
@@ -227,6 +252,297 @@ int pthread_yield(void){
 }
 
 pthread_t pthread_self(void){
-  b8OsBridgeUsr2Svc* bridge = b8OsSysCall( B8_OS_SYSCALL_GET_BRIDGE,0,0,0,0,0,0);
-  return bridge->pid;
+  return b8OsCurrentPid;
+}
+
+// ARMv4 has no ldrex/strex; SWP is the only atomic read-modify-write.
+static  u32   _AtomicSwap( volatile u32* addr, u32 value ){
+  u32 old;
+  __asm__ __volatile__(
+    "swp %0, %2, [%1]"
+    : "=&r" (old)
+    : "r" (addr), "r" (value)
+    : "memory"
+  );
+  return old;
+}
+
+int pthread_mutexattr_init(pthread_mutexattr_t* attr){
+  if( !attr ){
+    return  EINVAL;
+  }
+  attr->type = PTHREAD_MUTEX_DEFAULT;
+  attr->protocol = PTHREAD_PRIO_INHERIT;
+  return  0;
+}
+
+int pthread_mutexattr_destroy(pthread_mutexattr_t* attr){
+  if( !attr ){
+    return  EINVAL;
+  }
+  memset(attr, 0, sizeof(pthread_mutexattr_t));
+  return  0;
+}
+
+int pthread_mutexattr_settype(pthread_mutexattr_t* attr, int type){
+  if( !attr ){
+    return  EINVAL;
+  }
+  switch( type ){
+    case  PTHREAD_MUTEX_NORMAL:
+    case  PTHREAD_MUTEX_RECURSIVE:
+    case  PTHREAD_MUTEX_ERRORCHECK:
+    case  PTHREAD_MUTEX_DEFAULT:
+      attr->type = (u8)type;
+      return  0;
+  }
+  return  EINVAL;
+}
+
+int pthread_mutexattr_gettype(const pthread_mutexattr_t* attr, int* type){
+  if( !attr || !type ){
+    return  EINVAL;
+  }
+  *type = attr->type;
+  return  0;
+}
+
+int pthread_mutexattr_setprotocol(pthread_mutexattr_t* attr, int protocol){
+  if( !attr ){
+    return  EINVAL;
+  }
+  if( protocol != PTHREAD_PRIO_NONE && protocol != PTHREAD_PRIO_INHERIT ){
+    return  ENOTSUP;
+  }
+  attr->protocol = (u8)protocol;
+  return  0;
+}
+
+int pthread_mutexattr_getprotocol(const pthread_mutexattr_t* attr, int* protocol){
+  if( !attr || !protocol ){
+    return  EINVAL;
+  }
+  *protocol = attr->protocol;
+  return  0;
+}
+
+int pthread_mutex_init(pthread_mutex_t* mutex, const pthread_mutexattr_t* attr){
+  if( !mutex ){
+    return  EINVAL;
+  }
+  mutex->lock.state = B8_OS_MUTEX_UNLOCKED;
+  mutex->lock.owner = B8_OS_INVALID_PID;
+  mutex->count = 0;
+  mutex->type = attr ? attr->type : PTHREAD_MUTEX_DEFAULT;
+  return  0;
+}
+
+int pthread_mutex_destroy(pthread_mutex_t* mutex){
+  if( !mutex ){
+    return  EINVAL;
+  }
+  if( mutex->lock.state != B8_OS_MUTEX_UNLOCKED ){
+    return  EBUSY;
+  }
+  return  0;
+}
+
+// owner is left behind by pthread_mutex_unlock(), so it only counts while the mutex is locked.
+static  int   _MutexHeldBy( const pthread_mutex_t* mutex, b8OsPid self ){
+  return  mutex->lock.state != B8_OS_MUTEX_UNLOCKED && mutex->lock.owner == self;
+}
+
+// Returns 0 when the caller has to take the lock, otherwise the result.
+static  int   _MutexRelock( pthread_mutex_t* mutex, b8OsPid self ){
+  if( !_MutexHeldBy( mutex, self ) ){
+    return  0;
+  }
+  if( mutex->type != PTHREAD_MUTEX_RECURSIVE ){
+    return  EDEADLK;
+  }
+  if( mutex->count == 0xffff ){
+    return  EAGAIN;
+  }
+  mutex->count++;
+  return  -1;
+}
+
+// b8OsMutexSwap() has already published the owner.
+static  void  _MutexTaken( pthread_mutex_t* mutex ){
+  mutex->count = 1;
+}
+
+/*
+  Lock word protocol with an atomic swap only:
+    UNLOCKED -> LOCKED      uncontended lock, no syscall
+    *        -> CONTENDED   a thread is about to sleep in MUTEX_WAIT
+  A waiter that swapped CONTENDED into the word keeps retrying after every
+  wake up, so the hint can never be lost, only left over. A left-over
+  CONTENDED costs one MUTEX_WAKE that finds nobody to wake.
+  Whichever swap takes the lock also stores the owner, in the same atomic
+  step, so a waiter entering MUTEX_WAIT always finds whom to boost.
+*/
+int pthread_mutex_lock(pthread_mutex_t* mutex){
+  if( !mutex ){
+    return  EINVAL;
+  }
+  const b8OsPid self = b8OsCurrentPid;
+  const int relock = _MutexRelock( mutex, self );
+  if( relock ){
+    return  relock < 0 ? 0 : relock;
+  }
+
+  if( b8OsMutexSwap( &mutex->lock, B8_OS_MUTEX_LOCKED, self ) != B8_OS_MUTEX_UNLOCKED ){
+    while( b8OsMutexSwap( &mutex->lock, B8_OS_MUTEX_CONTENDED, self ) != B8_OS_MUTEX_UNLOCKED ){
+      b8OsBridgeUsr2Svc* bridge = b8OsSysCall( B8_OS_SYSCALL_MUTEX_WAIT,_CastPtr( &mutex->lock ),0,0,0,0,0);
+      if( bridge->errcode < 0 ){
+        return  - bridge->errcode;
+      }
+    }
+  }
+  _MutexTaken( mutex );
+  return  0;
+}
+
+int pthread_mutex_trylock(pthread_mutex_t* mutex){
+  if( !mutex ){
+    return  EINVAL;
+  }
+  const b8OsPid self = b8OsCurrentPid;
+  const int relock = _MutexRelock( mutex, self );
+  if( relock ){
+    return  relock < 0 ? 0 : relock;
+  }
+
+  const u32 prev = b8OsMutexSwap( &mutex->lock, B8_OS_MUTEX_LOCKED, self );
+  if( prev == B8_OS_MUTEX_CONTENDED ){
+    // Put the hint back. If the owner released in between, the lock is ours.
+    if( b8OsMutexSwap( &mutex->lock, B8_OS_MUTEX_CONTENDED, self ) != B8_OS_MUTEX_UNLOCKED ){
+      return  EBUSY;
+    }
+  } else if( prev == B8_OS_MUTEX_LOCKED ){
+    return  EBUSY;
+  }
+  _MutexTaken( mutex );
+  return  0;
+}
+
+int pthread_mutex_unlock(pthread_mutex_t* mutex){
+  if( !mutex ){
+    return  EINVAL;
+  }
+  if( !_MutexHeldBy( mutex, b8OsCurrentPid ) ){
+    return  EPERM;
+  }
+  if( --mutex->count > 0 ){
+    return  0;
+  }
+
+  // owner is not cleared first: a waiter arriving now must still find it.
+  if( _AtomicSwap( &mutex->lock.state, B8_OS_MUTEX_UNLOCKED ) == B8_OS_MUTEX_CONTENDED ){
+    b8OsBridgeUsr2Svc* bridge = b8OsSysCall( B8_OS_SYSCALL_MUTEX_WAKE,_CastPtr( &mutex->lock ),0,0,0,0,0);
+    return  - bridge->errcode;
+  }
+  return  0;
+}
+
+int pthread_condattr_init(pthread_condattr_t* attr){
+  if( !attr ){
+    return  EINVAL;
+  }
+  attr->reserved = 0;
+  return  0;
+}
+
+int pthread_condattr_destroy(pthread_condattr_t* attr){
+  if( !attr ){
+    return  EINVAL;
+  }
+  memset(attr, 0, sizeof(pthread_condattr_t));
+  return  0;
+}
+
+int pthread_cond_init(pthread_cond_t* cond, const pthread_condattr_t* attr){
+  (void)attr;
+  if( !cond ){
+    return  EINVAL;
+  }
+  cond->cond.seq = 0;
+  cond->cond.waiters = 0;
+  return  0;
+}
+
+int pthread_cond_destroy(pthread_cond_t* cond){
+  if( !cond ){
+    return  EINVAL;
+  }
+  if( cond->cond.waiters ){
+    return  EBUSY;
+  }
+  return  0;
+}
+
+/*
+  The sequence word is read while the mutex is still held. COND_WAIT only
+  sleeps if no signal bumped it since, so a signal sent between unlocking
+  and entering the kernel is not lost.
+*/
+static  int   _CondWait( pthread_cond_t* cond, pthread_mutex_t* mutex, const struct timespec* abstime ){
+  if( !cond || !mutex ){
+    return  EINVAL;
+  }
+  if( !_MutexHeldBy( mutex, b8OsCurrentPid ) ){
+    return  EPERM;
+  }
+
+  const u32 seq = cond->cond.seq;
+  const u16 count = mutex->count;
+  mutex->count = 1;
+  pthread_mutex_unlock( mutex );
+
+  b8OsBridgeUsr2Svc* bridge = b8OsSysCall(
+    B8_OS_SYSCALL_COND_WAIT,
+    _CastPtr( &cond->cond ),
+    seq,
+    abstime ? 1 : 0,
+    abstime ? (u32)abstime->tv_sec : 0,
+    abstime ? (u32)abstime->tv_nsec : 0,
+    0
+  );
+  const int ret = - bridge->errcode;
+
+  pthread_mutex_lock( mutex );
+  mutex->count = count;
+  return  ret;
+}
+
+int pthread_cond_wait(pthread_cond_t* cond, pthread_mutex_t* mutex){
+  return  _CondWait( cond, mutex, NULL );
+}
+
+int pthread_cond_timedwait(pthread_cond_t* cond, pthread_mutex_t* mutex, const struct timespec* abstime){
+  if( !abstime ){
+    return  EINVAL;
+  }
+  return  _CondWait( cond, mutex, abstime );
+}
+
+static  int   _CondSignal( pthread_cond_t* cond, u32 broadcast ){
+  if( !cond ){
+    return  EINVAL;
+  }
+  cond->cond.seq++;
+  if( cond->cond.waiters == 0 ){
+    return  0;
+  }
+  b8OsBridgeUsr2Svc* bridge = b8OsSysCall( B8_OS_SYSCALL_COND_SIGNAL,_CastPtr( &cond->cond ),broadcast,0,0,0,0);
+  return  - bridge->errcode;
+}
+
+int pthread_cond_signal(pthread_cond_t* cond){
+  return  _CondSignal( cond, 0 );
+}
+
+int pthread_cond_broadcast(pthread_cond_t* cond){
+  return  _CondSignal( cond, 1 );
 }
@@ -3,5 +3,10 @@
 
 int sched_get_priority_max(int policy ){
   (void)policy;
-  return 255;
+  return B8_OS_PRIORITY_MAX;
+}
+
+int sched_get_priority_min(int policy ){
+  (void)policy;
+  return B8_OS_PRIORITY_MIN;
 }
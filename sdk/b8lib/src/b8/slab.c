@@ -0,0 +1,263 @@
+#include <beep8.h>
+#include <b8/slab.h>
+#include <b8/os.h>
+#include <b8/pthread.h>
+#include <sys/errno.h>
+#include <string.h>
+#include <reent.h>
+
+#define WRAM_ADDR     (0x00100000)
+#define WRAM_SIZE     (0x00100000)
+#define PAGE_SHIFT    (12)
+#define N_PAGES       (WRAM_SIZE >> PAGE_SHIFT)
+
+#define N_CACHE       (32)    // one per thread, indexed like the TCBs in os.c
+#define CACHE_MAX     (32)    // blocks a thread keeps per class
+#define CACHE_BATCH   (8)     // blocks moved between a cache and the shared list
+
+#if B8_SLAB_PAGE_SIZE != (1 << PAGE_SHIFT)
+#error "B8_SLAB_PAGE_SIZE must match PAGE_SHIFT"
+#endif
+
+extern  void*   __real__malloc_r( struct _reent* r, size_t size );
+extern  void    __real__free_r( struct _reent* r, void* ptr );
+extern  void*   __real__realloc_r( struct _reent* r, void* ptr, size_t size );
+extern  void*   __real__calloc_r( struct _reent* r, size_t num, size_t size );
+extern  void*   __real__memalign_r( struct _reent* r, size_t align, size_t size );
+extern  size_t  __real__malloc_usable_size_r( struct _reent* r, void* ptr );
+
+// heap.c
+extern  volatile u8 _b8HeapTracking;
+extern  void    _b8HeapOnAlloc( const void* ptr, u32 size, const void* site );
+extern  void    _b8HeapOnFree( const void* ptr );
+
+typedef struct _Block {
+  struct _Block* next;
+} Block;
+
+typedef struct {
+  Block*  head;
+  u32     count;
+} FreeList;
+
+static  const u16 _class_size[ B8_SLAB_NUM_CLASSES ] = {
+  8, 16, 24, 32, 48, 64, 96, 128, 192, 256
+};
+
+// Size class by (size+7)/8
+static  const u8  _class_of[ (B8_SLAB_MAX_SIZE >> 3) + 1 ] = {
+  0, 0, 1, 2, 3, 4, 4, 5, 5,
+  6, 6, 6, 6, 7, 7, 7, 7,
+  8, 8, 8, 8, 8, 8, 8, 8,
+  9, 9, 9, 9, 9, 9, 9, 9
+};
+
+static  u8        _page_class[ N_PAGES ];      // class+1 of each WRAM page, 0 if not a slab page
+static  u32       _class_pages[ B8_SLAB_NUM_CLASSES ];
+static  FreeList  _shared[ B8_SLAB_NUM_CLASSES ];
+static  FreeList  _cache[ N_CACHE ][ B8_SLAB_NUM_CLASSES ];
+static  pthread_mutex_t _mutex_slab = PTHREAD_MUTEX_INITIALIZER;
+static  volatile u8      _growing;      // a thread is taking a page from newlib
+static  volatile b8OsPid _grow_pid;     // and this is the thread
+
+static  int   _b8SlabClassOf( size_t size ){
+  return  _class_of[ (size + 7) >> 3 ];
+}
+
+// Class of the page `ptr` is in, or -1 if newlib owns it.
+static  int   _b8SlabClassOfPtr( const void* ptr ){
+  const u32 offset = (u32)ptr - WRAM_ADDR;
+  if( offset >= WRAM_SIZE ) return -1;
+  return  (int)_page_class[ offset >> PAGE_SHIFT ] - 1;
+}
+
+// The pages themselves are not allocations the program made.
+static  int   _b8SlabTracked(void){
+  return  _b8HeapTracking && !(_growing && _grow_pid == b8OsCurrentPid);
+}
+
+static  FreeList* _b8SlabCache( int cls ){
+  return  &_cache[ (b8OsCurrentPid & 0xffff) & (N_CACHE-1) ][ cls ];
+}
+
+// Called with _mutex_slab held.
+static  int   _b8SlabGrow( struct _reent* r, int cls ){
+  _grow_pid = b8OsCurrentPid;
+  _growing = 1;
+  u8* page = (u8*)__real__memalign_r( r, B8_SLAB_PAGE_SIZE, B8_SLAB_PAGE_SIZE );
+  _growing = 0;
+  if( !page ) return -1;
+
+  if( (u32)page - WRAM_ADDR >= WRAM_SIZE ){
+    __real__free_r( r, page );
+    return -1;
+  }
+  _ASSERT( _b8SlabClassOfPtr( page ) < 0, "page already in use" );
+  _page_class[ ((u32)page - WRAM_ADDR) >> PAGE_SHIFT ] = (u8)(cls + 1);
+  ++_class_pages[ cls ];
+
+  const u32 size = _class_size[ cls ];
+  FreeList* fl = &_shared[ cls ];
+  for( u32 pos = 0 ; pos + size <= B8_SLAB_PAGE_SIZE ; pos += size ){
+    Block* blk = (Block*)(page + pos);
+    blk->next = fl->head;
+    fl->head = blk;
+    ++fl->count;
+  }
+  return  0;
+}
+
+static  void* _b8SlabAlloc( struct _reent* r, int cls ){
+  FreeList* cache = _b8SlabCache( cls );
+  if( !cache->head ){
+    pthread_mutex_lock( &_mutex_slab );
+    FreeList* fl = &_shared[ cls ];
+    if( !fl->head && _b8SlabGrow( r, cls ) < 0 ){
+      pthread_mutex_unlock( &_mutex_slab );
+      return  NULL;
+    }
+    for( u32 nn=0 ; nn<CACHE_BATCH && fl->head ; ++nn ){
+      Block* blk = fl->head;
+      fl->head = blk->next;
+      --fl->count;
+      blk->next = cache->head;
+      cache->head = blk;
+      ++cache->count;
+    }
+    pthread_mutex_unlock( &_mutex_slab );
+  }
+
+  Block* blk = cache->head;
+  cache->head = blk->next;
+  --cache->count;
+  return  blk;
+}
+
+static  void  _b8SlabFree( void* ptr, int cls ){
+  FreeList* cache = _b8SlabCache( cls );
+  Block* blk = (Block*)ptr;
+  blk->next = cache->head;
+  cache->head = blk;
+  ++cache->count;
+
+  if( cache->count < CACHE_MAX ) return;
+
+  pthread_mutex_lock( &_mutex_slab );
+  FreeList* fl = &_shared[ cls ];
+  for( u32 nn=0 ; nn<CACHE_MAX/2 ; ++nn ){
+    blk = cache->head;
+    cache->head = blk->next;
+    --cache->count;
+    blk->next = fl->head;
+    fl->head = blk;
+    ++fl->count;
+  }
+  pthread_mutex_unlock( &_mutex_slab );
+}
+
+static  void* _b8SlabMalloc( struct _reent* r, size_t size, const void* site ){
+  void* ptr;
+  if( size > B8_SLAB_MAX_SIZE ){
+    ptr = __real__malloc_r( r, size );
+  } else {
+    ptr = _b8SlabAlloc( r, _b8SlabClassOf( size ) );
+    if( !ptr ) r->_errno = ENOMEM;
+  }
+  if( ptr && _b8SlabTracked() ) _b8HeapOnAlloc( ptr, size, site );
+  return  ptr;
+}
+
+void* __wrap__malloc_r( struct _reent* r, size_t size ){
+  return  _b8SlabMalloc( r, size, __builtin_return_address( 0 ) );
+}
+
+void  __wrap__free_r( struct _reent* r, void* ptr ){
+  if( !ptr ) return;
+  if( _b8SlabTracked() ) _b8HeapOnFree( ptr );
+  const int cls = _b8SlabClassOfPtr( ptr );
+  if( cls < 0 ){
+    __real__free_r( r, ptr );
+    return;
+  }
+  _b8SlabFree( ptr, cls );
+}
+
+size_t  __wrap__malloc_usable_size_r( struct _reent* r, void* ptr ){
+  const int cls = _b8SlabClassOfPtr( ptr );
+  if( cls < 0 ) return  __real__malloc_usable_size_r( r, ptr );
+  return  _class_size[ cls ];
+}
+
+// newlib's realloc reads the chunk header of what _malloc_r gives it, so it is
+// only used when the old and the new block both belong to newlib.
+void* __wrap__realloc_r( struct _reent* r, void* ptr, size_t size ){
+  const void* site = __builtin_return_address( 0 );
+  if( !ptr ) return  _b8SlabMalloc( r, size, site );
+  if( 0 == size ){
+    __wrap__free_r( r, ptr );
+    return  NULL;
+  }
+
+  const int cls = _b8SlabClassOfPtr( ptr );
+  if( cls < 0 && size > B8_SLAB_MAX_SIZE ){
+    void* newp = __real__realloc_r( r, ptr, size );
+    if( newp && _b8SlabTracked() ) _b8HeapOnAlloc( newp, size, site );
+    return  newp;
+  }
+  if( cls >= 0 && size <= _class_size[ cls ] ){
+    if( _b8SlabTracked() ) _b8HeapOnAlloc( ptr, size, site );
+    return  ptr;
+  }
+
+  const size_t old_size = __wrap__malloc_usable_size_r( r, ptr );
+  void* newp = _b8SlabMalloc( r, size, site );
+  if( !newp ) return  NULL;
+  memcpy( newp, ptr, old_size < size ? old_size : size );
+  __wrap__free_r( r, ptr );
+  return  newp;
+}
+
+// newlib's calloc clears as much as the chunk header says, so small blocks are cleared here.
+void* __wrap__calloc_r( struct _reent* r, size_t num, size_t size ){
+  const void* site = __builtin_return_address( 0 );
+  const size_t total = num * size;
+  if( size && total / size != num ){
+    r->_errno = ENOMEM;
+    return  NULL;
+  }
+  if( total > B8_SLAB_MAX_SIZE ){
+    void* ptr = __real__calloc_r( r, num, size );
+    if( ptr && _b8SlabTracked() ) _b8HeapOnAlloc( ptr, total, site );
+    return  ptr;
+  }
+
+  void* ptr = _b8SlabMalloc( r, total, site );
+  if( ptr ) memset( ptr, 0, total );
+  return  ptr;
+}
+
+// newlib's memalign pads the request and then splits the chunk it gets, which
+// must not be a slab block. Blocks are 8-byte aligned, like newlib's.
+void* __wrap__memalign_r( struct _reent* r, size_t align, size_t size ){
+  const void* site = __builtin_return_address( 0 );
+  if( align <= 8 ) return  _b8SlabMalloc( r, size, site );
+
+  const size_t request = size <= B8_SLAB_MAX_SIZE ? B8_SLAB_MAX_SIZE + 1 : size;
+  void* ptr = __real__memalign_r( r, align, request );
+  if( ptr && _b8SlabTracked() ) _b8HeapOnAlloc( ptr, size, site );
+  return  ptr;
+}
+
+int   b8SlabGetStat( b8SlabStat* st, int max ){
+  if( !st || max < 0 ) return  set_errno( EINVAL );
+
+  int num = 0;
+  pthread_mutex_lock( &_mutex_slab );
+  for( ; num < max && num < B8_SLAB_NUM_CLASSES ; ++num ){
+    st[ num ].block_size  = _class_size[ num ];
+    st[ num ].pages       = _class_pages[ num ];
+    st[ num ].free_blocks = _shared[ num ].count;
+  }
+  pthread_mutex_unlock( &_mutex_slab );
+  return  num;
+}
@@ -3,8 +3,10 @@
 #include <b8/irq.h>
 #include <b8/errno.h>
 #include <sys/errno.h>
+#include <string.h>
 
 void  b8SysHalt(void){
+  b8ConPanic();
   b8SysPuts( "b8SysHalt() has been called and the system will halt.\n");
   void* return_address = __builtin_return_address(0);
   b8SysPuts("Caller return address: 0x");
@@ -21,17 +23,15 @@ void  b8SysReset(void){
 }
 
 void  b8SysPuts(const char* str ){
-  const char* pp = str;
-  while( *pp ){
-    B8_FIFO_SCI_TX(0) = (u32)*pp;
-    ++pp;
-  }
+  b8ConWrite( str , strlen( str ) );
 }
 
 void  b8SysPutHex( u32 data ){
-  for( s16 sft=28 ; sft>=0 ; sft-=4 ){
-    B8_FIFO_SCI_TX(0) = "0123456789abcdef"[ (data >> sft) & 0xf ];
+  char buff[8];
+  for( s16 sft=28, up=0 ; sft>=0 ; sft-=4, ++up ){
+    buff[ up ] = "0123456789abcdef"[ (data >> sft) & 0xf ];
   }
+  b8ConWrite( buff , sizeof(buff) );
 }
 
 void  b8SysPutNum( s32 data ){
@@ -65,26 +65,6 @@ u32   b8SysGetCpuClock(void){
 
 static  u32       _irq_use_map = 0x00000000;
 static  sem_t     _sem_irq_sync[ B8_IRQ_NUM_OF_INTERRUPTS ] = {0};
-static  pthread_t _irq_thread  [ B8_IRQ_NUM_OF_INTERRUPTS ] = {0};
-
-static  void* _b8SysIrqThread( void* arg ){
-  sem_t* sem_irq = (sem_t*)arg;
-  while(1){
-    pthread_yield();
-    sem_post( sem_irq );
-  }
-  return NULL;
-}
-
-static  void* _b8SysIrqThreadUndefinedInstruction( void* arg ){
-  (void)arg;
-  while(1){
-    pthread_yield();
-    b8SysPuts( "Caught undefined instruction\n" ); 
-    b8SysHalt();
-  }
-  return NULL;
-}
 
 int b8SysIrqWait( u32 irq ){
   if(!( _irq_use_map & (1<<irq)) ){
@@ -96,6 +76,22 @@ int b8SysIrqWait( u32 irq ){
   return sem_wait( sem );
 }
 
+int b8SysIrqPending( u32 irq ){
+  if( irq >= B8_IRQ_NUM_OF_INTERRUPTS || !( _irq_use_map & (1<<irq)) ){
+    set_errno( EINVAL );
+    return -1;
+  }
+
+  int value = 0;
+  const int ret = sem_getvalue( &_sem_irq_sync[ irq ] , &value );
+  if( ret < 0 ){
+    set_errno( -ret );
+    return -1;
+  }
+  // Negative while threads are waiting.
+  return  value > 0 ? value : 0;
+}
+
 int   b8SysSetupIrqWait( u32 irq ){
   if( irq >= B8_IRQ_NUM_OF_INTERRUPTS ){
     set_errno( EINVAL );
@@ -106,25 +102,27 @@ int   b8SysSetupIrqWait( u32 irq ){
     return  B8_OS_OK;
   }
 
+  // The kernel halts on an undefined instruction by itself.
+  if( irq == B8_IRQ_UNDF ){
+    _irq_use_map |= 1<<irq;
+    return  0;
+  }
+
   int ret = sem_init( &_sem_irq_sync[ irq ] , 0, 0);
   if( ret < 0 ){
     set_errno( -ret );
     return -1;
   }
 
-  pthread_attr_t attr;
-  pthread_attr_init(&attr);
-  pthread_attr_setschedpolicy(&attr,SCHED_IRQ);
-  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
-  pthread_attr_setstacksize(&attr, 0x800);
-  attr.irq_no = irq;
-  if( irq == B8_IRQ_UNDF ){
-    ret = pthread_create( &_irq_thread[irq] , &attr, _b8SysIrqThreadUndefinedInstruction, &_sem_irq_sync[ irq ] );
-  } else { 
-    ret = pthread_create( &_irq_thread[irq] , &attr, _b8SysIrqThread, &_sem_irq_sync[ irq ] );
-  }
-  if( ret > 0 ){
-    set_errno( ret );
+  // The kernel posts the semaphore from the interrupt itself.
+  b8OsBridgeUsr2Svc* bridge = b8OsSysCall(
+    B8_OS_SYSCALL_IRQ_SEM_BIND,
+    irq,
+    _sem_irq_sync[ irq ].sid,
+    0,0,0,0
+  );
+  if( bridge->errcode < 0 ){
+    set_errno( -bridge->errcode );
     return -1;
   }
 
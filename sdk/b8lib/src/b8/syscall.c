@@ -16,8 +16,7 @@ int usleep(useconds_t useconds) {
 }
 
 int getpid(void) {
-  b8OsBridgeUsr2Svc* bridge = b8OsSysCall( B8_OS_SYSCALL_GET_BRIDGE,0,0,0,0,0,0);
-  return bridge->pid;
+  return b8OsCurrentPid;
 }
 
 static  int _clock_id_conv( clockid_t clk_id , u32* os_clk_id ){
@@ -64,14 +63,13 @@ int clock_gettime(clockid_t clk_id, struct timespec* tp){
   int ret = _clock_id_conv( clk_id , &os_clk_id );
   if( ret < 0 ) return ret;
 
-  b8OsBridgeUsr2Svc* bridge = b8OsSysCall(
-    B8_OS_SYSCALL_CLOCK_GETTIME,
-    os_clk_id,
-    0,0,0,0,0
-  );
-  tp->tv_sec  = bridge->tv_sec;
-  tp->tv_nsec = bridge->tv_nsec;
-  return  bridge->errcode;
+  u64 sec;
+  u32 nsec;
+  ret = b8OsClockGetTime( os_clk_id , &sec , &nsec );
+  if( ret < 0 ) return set_errno( -ret );
+  tp->tv_sec  = sec;
+  tp->tv_nsec = nsec;
+  return  0;
 }
 
 int clock_settime(clockid_t clk_id, const struct timespec *tp){
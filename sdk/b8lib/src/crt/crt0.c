@@ -14,6 +14,7 @@
 #include <b8/ppu.h>
 #include <b8/hif.h>
 #include <b8/pthread.h>
+#include <b8/con.h>
 #include <crt/crt.h>
 #include <sys/time.h>
 
@@ -24,7 +25,7 @@ union	fc32 {
 
 extern  int set_errno(int errcode);
 extern  int get_errno(void);
-static sem_t    sem_heap;
+static pthread_mutex_t _mutex_heap = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
 
 static  void  fs_register_driver_init(void);
 static  FsDriver* fs_get_driver( int fd );
@@ -204,6 +205,17 @@ static  int ArchDriverOnStartTimer(u32 hz){
   return 0;
 }
 
+static  int ArchDriverSetTimerOneShot(u32 usec){
+  u32 per = (u32)(((u64)b8SysGetCpuClock() * usec / 1000000) >> 8);
+  if( per == 0 ) per = 1;
+  B8_TMR_CTRL( OS_TMR_CH )   = B8_DISABLE;
+  B8_TMR_MODE( OS_TMR_CH )   = B8_TMR_MODE_ONESHOT;
+  B8_TMR_CNT(  OS_TMR_CH )   = 0;
+  B8_TMR_PER(  OS_TMR_CH )   = per;
+  B8_TMR_CTRL( OS_TMR_CH )   = B8_ENABLE;
+  return 0;
+}
+
 static  int ArchDriverOnStartCycleCnt(void){
   B8_DWT_CYCCNT = 0;
   B8_DWT_CTRL = 1;
@@ -245,6 +257,7 @@ void _crt0_stop(void){
 }
 
 void crt0_data_abort(uint32_t fault_instruction, uint32_t fault_address, uint32_t fault_status , uint32_t sp_usr, uint32_t cpsr ){
+  b8ConPanic();
   _crt0_hr();
   if (fault_address == 0x00000000) {
     _crt0_puts("NULL pointer access detected. " );
@@ -270,6 +283,7 @@ void crt0_data_abort(uint32_t fault_instruction, uint32_t fault_address, uint32_
 }
 
 void crt0_undef(uint32_t pc, uint32_t cpsr) {
+  b8ConPanic();
   _crt0_hr();
   _crt0_puts("Undefined Instruction Exception. ");
   _crt0_stop();
@@ -332,7 +346,6 @@ unsigned int crt0_entry(void){
   cfg.StackSize = sizeof(OsStack);
   cfg.CpuCyclesPerSec = b8SysGetCpuClock();
   cfg.UsecPerTick  = 1000;
-  cfg.sem_heap = &sem_heap;
   cfg.ArchDriverGetTimerIrq       = ArchDriverGetTimerIrq;
   cfg.ArchDriverOnStartTimer      = ArchDriverOnStartTimer;
   cfg.ArchDriverOnStartCycleCnt   = ArchDriverOnStartCycleCnt;
@@ -340,6 +353,7 @@ unsigned int crt0_entry(void){
   cfg.ArchDriverGetCycleAndClear  = ArchDriverGetCycleAndClear;
   cfg.ArchDriverPicDistributor    = ArchDriverPicDistributor;
   cfg.ArchDriverGetClockTime      = ArchDriverGetClockTime;
+  cfg.ArchDriverSetTimerOneShot   = ArchDriverSetTimerOneShot;
   int ret = b8OsReset( &cfg );
   trace(ret);
   B8_SYS_ASSERT( ret >= 0 , "failed b8OsReset();" );
@@ -363,30 +377,85 @@ size_t strlen(const char *s){
 /*
   File system driver for Beep8
 */
-#define N_MAX_FS_DRIVER (32)
+#define N_MAX_FS_DRIVER (64)
 int _id_driver;
 
-#define N_MAX_FILES     (N_MAX_FS_DRIVER)
+#define N_MAX_FILES     (32)
 File  _files[ N_MAX_FILES ];
 
+// Open addressing, indexed by path hash. Holds driver index + 1, 0 when empty.
+#define N_DRIVER_HASH   (N_MAX_FS_DRIVER*2)
+
 #define	STDIN   (0)
 #define	STDOUT  (1)
 #define	STDERR  (2)
 
 static  FsDriver _fs_driver[ N_MAX_FS_DRIVER ];
-static  FsDriver* fs_get_driver( int fd ){
-  if( fd < 0 )  return 0;
-  if( fd >= N_MAX_FS_DRIVER ) return 0;
-  if( 0 == strlen( _fs_driver[fd]._path ) ) return 0;
-  return  &_fs_driver[ fd ];
+static  u32       _fs_driver_hash[ N_MAX_FS_DRIVER ];
+static  u8        _driver_index[ N_DRIVER_HASH ];
+static  FsDriver* _file_driver[ N_MAX_FILES ];
+static pthread_mutex_t _mutex_fd = PTHREAD_MUTEX_INITIALIZER;
+
+static  u32 _path_hash( const char* path ){
+  u32 hash = 2166136261u;   // FNV-1a
+  while( *path ){
+    hash ^= (u8)*path++;
+    hash *= 16777619u;
+  }
+  return  hash;
+}
+
+// Returns the slot of `path` in _driver_index, or the empty slot it would go to.
+static  u32 _driver_slot( const char* path, u32 hash ){
+  u32 slot = hash & (N_DRIVER_HASH-1);
+  for( ;; slot = (slot+1) & (N_DRIVER_HASH-1) ){
+    const u32 idx = _driver_index[ slot ];
+    if( 0 == idx ) break;
+    if( _fs_driver_hash[ idx-1 ] != hash ) continue;
+    if( 0 == strcmp( _fs_driver[ idx-1 ]._path , path ) ) break;
+  }
+  return  slot;
+}
+
+static  FsDriver* fs_find_driver( const char* path ){
+  const u32 idx = _driver_index[ _driver_slot( path, _path_hash( path ) ) ];
+  if( 0 == idx ) return 0;
+  return  &_fs_driver[ idx-1 ];
 }
 
 static  File* file_get( int fd ){
   if( fd < 0 )  return 0;
   if( fd >= N_MAX_FILES ) return 0;
+  if( 0 == _files[ fd ].used ) return 0;
   return  &_files[ fd ];
 }
 
+static  FsDriver* fs_get_driver( int fd ){
+  if( 0 == file_get( fd ) ) return 0;
+  return  _file_driver[ fd ];
+}
+
+static  void  file_bind( int fd, FsDriver* driver, int mode ){
+  File* pfile = &_files[ fd ];
+  pfile->f_priv = 0;
+  pfile->d_priv = driver->_priv;
+  pfile->used   = 1;
+  pfile->mode   = mode;
+  pfile->offset = 0;
+  _file_driver[ fd ] = driver;
+}
+
+// Clears the binding before the fd is handed back, or an _open_r() that takes
+// it in between would have its driver wiped.
+static  void  file_release( int fd ){
+  File* pfile = &_files[ fd ];
+  pthread_mutex_lock( &_mutex_fd );
+  pfile->f_priv = 0;
+  _file_driver[ fd ] = 0;
+  pfile->used   = 0;
+  pthread_mutex_unlock( &_mutex_fd );
+}
+
 static  void  fs_register_driver_init(void){
   _id_driver = STDERR+1;
 
@@ -394,10 +463,12 @@ static  void  fs_register_driver_init(void){
   for( size_t nn=0 ; nn<N_MAX_FS_DRIVER ; ++nn,++pfd ){
     MEMCLR( pfd , sizeof( *pfd ) );
   }
+  MEMCLR( _driver_index , sizeof( _driver_index ) );
 
   File* pfile = &_files[ 0 ];
   for( size_t nn=0 ; nn<N_MAX_FILES ; ++nn,++pfile ){
     MEMCLR( pfile , sizeof( *pfile ) );
+    _file_driver[ nn ] = 0;
   }
 }
 
@@ -419,11 +490,20 @@ static  int _fs_set_driver(
     return -1;
   }
 
+  const u32 hash = _path_hash( path );
+  const u32 slot = _driver_slot( path, hash );
+  if( _driver_index[ slot ] ){
+    set_errno( EEXIST );
+    return -1;
+  }
+
   FsDriver* fdrv = &_fs_driver[ id_driver_ ];
   strcpy( fdrv->_path , path );
   fdrv->_fops = fops;
   fdrv->_mode = mode;
   fdrv->_priv = priv;
+  _fs_driver_hash[ id_driver_ ] = hash;
+  _driver_index[ slot ] = (u8)(id_driver_ + 1);
   return 0;
 }
 
@@ -433,20 +513,17 @@ int fs_register_driver(
   mode_t mode,
   void* priv
 ){
-  int id_driver = _id_driver++;
-  _fs_set_driver( id_driver, path, fops, mode, priv );
-  return 0;
+  // A rejected registration must not use up a slot.
+  const int ret = _fs_set_driver( _id_driver, path, fops, mode, priv );
+  if( ret == 0 ) ++_id_driver;
+  return  ret;
 }
 
 // stdout driver
 static ssize_t stdout_write(File* filep,const char *buffer, size_t len) {
   (void)filep;
-  const char* pp = buffer;
-
-  for( size_t nn=0 ; nn<len ; ++nn ){
-    const uint32_t code = (uint32_t) *pp++;
-    B8_FIFO_SCI_TX(0) = code;
-  }
+  // Dropped output counts as written, or stdio would keep it and try again.
+  b8ConWrite( buffer, len );
   return len;
 }
 
@@ -469,6 +546,7 @@ static  int _stdout_register( void ){
     NULL
   );
   if( ret < 0 ) return ret;
+  file_bind( STDOUT, &_fs_driver[ STDOUT ], 0666 );
   return 0;
 }
 
@@ -481,6 +559,7 @@ static  int _stderr_register( void ){
     NULL
   );
   if( ret < 0 ) return ret;
+  file_bind( STDERR, &_fs_driver[ STDERR ], 0666 );
   return 0;
 }
 
@@ -526,6 +605,7 @@ static  int _stdin_register( void ){
     NULL
   );
   if( ret < 0 ) return ret;
+  file_bind( STDIN, &_fs_driver[ STDIN ], 0666 );
   return 0;
 }
 
@@ -576,33 +656,14 @@ void* _sbrk_r(struct _reent *reent_ptr, ptrdiff_t incr) {
   return result;
 }
 
-extern  pthread_t pthread_self(void);
-
-pthread_t last_thread_id = 0;
-int lock_count = 0;
-
 void  __malloc_lock(struct _reent* _r){
   (void)_r;
-  pthread_t current_thread_id = pthread_self();
-
-  if (last_thread_id != current_thread_id) {
-      sem_wait(&sem_heap);
-      last_thread_id = current_thread_id;
-  }
-
-  lock_count++;
+  pthread_mutex_lock( &_mutex_heap );
 }
 
 void  __malloc_unlock(struct _reent* _r) {
   (void)_r;
-  if (last_thread_id == pthread_self()) {
-    lock_count--;
-
-    if (lock_count == 0) {
-        last_thread_id = 0;
-        sem_post(&sem_heap);
-    }
-  }
+  pthread_mutex_unlock( &_mutex_heap );
 }
 
 int _kill(int pid, int sig){
@@ -637,39 +698,35 @@ int _fork(void){
 }
 
 int _open_r(struct _reent *r, const char *buf, int flags, int mode) {
-  (void)r;(void)flags;(void)mode;
-  for( int fd=0 ; fd < N_MAX_FS_DRIVER ; ++fd ){
-    if( fd >= N_MAX_FILES ){
-      set_errno( ENFILE );
-      return -1;
-    }
+  (void)r;(void)flags;
+  FsDriver* driver = fs_find_driver( buf );
+  if( 0 == driver ){
+    set_errno( ENOENT );
+    return -1;
+  }
 
-    FsDriver* driver = fs_get_driver( fd );
-    if( 0 == driver ) continue;
+  int fd;
+  pthread_mutex_lock( &_mutex_fd );
+  for( fd=STDERR+1 ; fd < N_MAX_FILES ; ++fd ){
+    if( 0 == _files[ fd ].used ) break;
+  }
+  if( fd < N_MAX_FILES ) file_bind( fd, driver, mode );
+  pthread_mutex_unlock( &_mutex_fd );
 
-    if( 0 != strcmp( driver->_path , buf ) ) continue;
+  if( fd >= N_MAX_FILES ){
+    set_errno( ENFILE );
+    return -1;
+  }
 
-    File* pfile = file_get( fd );
-    if( !pfile ){
-      set_errno( EBADF );
+  if( driver->_fops->open ){
+    int ret = (*driver->_fops->open)( &_files[ fd ] );
+    if( ret < 0 ){
+      file_release( fd );
+      set_errno( -ret );
       return -1;
     }
-
-    pfile->f_priv = 0;
-    pfile->d_priv = driver->_priv;
-    pfile->used   = 1;
-    pfile->mode   = mode;
-
-    if( driver->_fops->open ){
-      int ret = (*driver->_fops->open)(pfile);
-      if( ret < 0 ){
-        set_errno( -ret );
-        return -1;
-      }
-    }
-    return fd;
   }
-  return -1;
+  return fd;
 }
 
 int _open(const char* buf, int flags, int mode) {
@@ -686,23 +743,12 @@ int _close( int file) {
   }
 
   File* pfile = file_get( file );
-  if( !pfile ){
-    set_errno(EINVAL);
-    return -1;
-  }
-
-  if( 0 == pfile->used ){
-    set_errno(EINVAL);
-    return -1;
-  }
-
   if( fs->_fops->close ){
     int ret = (*fs->_fops->close)( pfile );
     if( ret < 0 ) return -1;
   }
 
-  pfile->used = 0;
-  pfile->f_priv = 0;
+  file_release( file );
   return 0;
 }
 
@@ -718,12 +764,7 @@ int _lseek( int file,int ptr,int dir) {
     return -1;
   }
 
-  File* pfile =  file_get( file );
-  if( 0 == pfile ){
-    set_errno(EBADF);
-    return -1;
-  }
-  return  (*fs->_fops->seek)(pfile,ptr,dir);
+  return  (*fs->_fops->seek)(file_get( file ),ptr,dir);
 }
 
 _ssize_t _write_r(struct _reent *r, int fd, const void *buf, size_t nbytes) {
@@ -735,16 +776,6 @@ _ssize_t _write_r(struct _reent *r, int fd, const void *buf, size_t nbytes) {
   }
 
   File* pfile = file_get( fd );
-  if( 0 == pfile ){
-    set_errno(EBADF);
-    return -1;
-  }
-
-  if( pfile->used == 0 ){
-    set_errno(EBADF);
-    return -1;
-  }
-
   if( 0 == fs->_fops->write)  return 0;
 
   return  (*fs->_fops->write)(pfile,buf,nbytes);
@@ -752,13 +783,17 @@ _ssize_t _write_r(struct _reent *r, int fd, const void *buf, size_t nbytes) {
 
 
 int _fstat(int file, struct stat* st) {
-  if( (STDOUT == file) || (STDERR == file) ){
-    st->st_mode = S_IFCHR;
-    return  0;
-  } else {
+  FsDriver* fs = fs_get_driver( file );
+  if( 0 == fs ){
     set_errno(EBADF);
     return  -1;
   }
+
+  // Drivers that can seek are regular files, the others character devices.
+  MEMCLR( st, sizeof(*st) );
+  st->st_mode = fs->_fops->seek ? S_IFREG : S_IFCHR;
+  st->st_blksize = BUFSIZ;
+  return  0;
 }
 
 int _isatty(int file) {
@@ -780,16 +815,11 @@ _ssize_t _read_r(struct _reent *r, int fd, void *buf, size_t nbytes) {
   (void)r;
   FsDriver* fs = fs_get_driver( fd );
   if( 0 == fs ){
-    set_errno(EINVAL);
-    return -1;
-  }
-
-  File* pfile = file_get( fd );
-  if( 0 == pfile ){
     set_errno(EBADF);
     return -1;
   }
 
+  File* pfile = file_get( fd );
   if( 0 == fs->_fops->read )  return 0;
 
   return  (*fs->_fops->read)(pfile,buf,nbytes);
@@ -825,10 +855,6 @@ int _ioctl(int fd, unsigned int cmd, void* arg){
     return -1;
   }
   File* pfile = file_get( fd );
-  if( 0 == pfile ){
-    set_errno(EBADF);
-    return -1;
-  }
 
   if( 0 == fs->_fops->ioctl )  return 0;
 
@@ -842,6 +868,7 @@ extern int  b8HifReset(void);
 int _crt_main(void){
   ioctl(STDOUT,0);
   set_errno(0);
+  b8ConReset();
 
   b8SysSetupIrqWait( B8_IRQ_UNDF );
 
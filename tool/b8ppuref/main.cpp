@@ -0,0 +1,179 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include "softppu.h"
+
+using namespace std;
+
+// Same colors as tool/png2c
+static const uint32_t rgb_pal[16] = {
+    0x000000, 0x1D2B53, 0x7E2553, 0x008751,
+    0xAB5236, 0x5F574F, 0xC2C3C7, 0xFFF1E8,
+    0xFF004D, 0xFFA300, 0xFFEC27, 0x00E436,
+    0x29ADFF, 0x83769C, 0xFF77A8, 0xFFCCAA
+};
+
+static uint32_t crc32(const uint8_t* p, size_t len, uint32_t crc = 0) {
+    static uint32_t table[256];
+    if (table[1] == 0) {
+        for (uint32_t n = 0; n < 256; ++n) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; ++k) c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            table[n] = c;
+        }
+    }
+    crc = ~crc;
+    for (size_t i = 0; i < len; ++i) crc = table[(crc ^ p[i]) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+static void put32(vector<uint8_t>& v, uint32_t x) {
+    v.push_back(x >> 24); v.push_back(x >> 16); v.push_back(x >> 8); v.push_back(x);
+}
+
+static void chunk(ofstream& out, const char* type, const vector<uint8_t>& data) {
+    vector<uint8_t> buf;
+    put32(buf, (uint32_t)data.size());
+    buf.insert(buf.end(), type, type + 4);
+    buf.insert(buf.end(), data.begin(), data.end());
+    put32(buf, crc32(buf.data() + 4, buf.size() - 4));
+    out.write((const char*)buf.data(), buf.size());
+}
+
+// Indexed PNG, stored without compression so the same frame always gives the same file.
+static bool write_png(const string& path, const SoftPpu& ppu) {
+    ofstream out(path, ios::binary);
+    if (!out) return false;
+    const int w = ppu.width(), h = ppu.height();
+    const vector<uint8_t>& fb = ppu.framebuffer();
+
+    out.write("\x89PNG\r\n\x1a\n", 8);
+
+    vector<uint8_t> ihdr;
+    put32(ihdr, w);
+    put32(ihdr, h);
+    ihdr.insert(ihdr.end(), {8, 3, 0, 0, 0});  // 8 bit, palette
+    chunk(out, "IHDR", ihdr);
+
+    vector<uint8_t> plte;
+    for (uint32_t c : rgb_pal) {
+        plte.push_back(c >> 16); plte.push_back(c >> 8); plte.push_back(c);
+    }
+    chunk(out, "PLTE", plte);
+
+    vector<uint8_t> raw;
+    for (int y = 0; y < h; ++y) {
+        raw.push_back(0);  // no filter
+        raw.insert(raw.end(), fb.begin() + y * w, fb.begin() + (y + 1) * w);
+    }
+
+    vector<uint8_t> z = {0x78, 0x01};
+    uint32_t a = 1, b = 0;
+    for (uint8_t x : raw) { a = (a + x) % 65521; b = (b + a) % 65521; }
+    for (size_t pos = 0; pos < raw.size() || pos == 0; pos += 65535) {
+        const size_t len = min<size_t>(65535, raw.size() - pos);
+        z.push_back(pos + len >= raw.size() ? 1 : 0);
+        z.push_back(len & 0xff); z.push_back(len >> 8);
+        z.push_back(~len & 0xff); z.push_back((~len >> 8) & 0xff);
+        z.insert(z.end(), raw.begin() + pos, raw.begin() + pos + len);
+    }
+    put32(z, (b << 16) | a);
+    chunk(out, "IDAT", z);
+    chunk(out, "IEND", {});
+    return (bool)out;
+}
+
+static void print_costs(int index, const SoftPpu& ppu) {
+    printf("list %d\n", index);
+    uint32_t total = 0;
+    uint64_t pixels = 0;
+    for (const auto& it : ppu.costs()) {
+        printf("  %-10s %8u cmds %10llu px\n", SoftPpu::cmd_name(it.first),
+               it.second.count, (unsigned long long)it.second.pixels);
+        total += it.second.count;
+        if (it.first != CMD_LOADIMG) pixels += it.second.pixels;
+    }
+    printf("  %-10s %8u cmds %10llu px\n", "total", total, (unsigned long long)pixels);
+}
+
+int main(int argc, char* argv[]) {
+    int width = 128, height = 240;
+    int argi = 1;
+    while (argi + 1 < argc && argv[argi][0] == '-') {
+        if (!strcmp(argv[argi], "-w")) width = atoi(argv[argi + 1]);
+        else if (!strcmp(argv[argi], "-h")) height = atoi(argv[argi + 1]);
+        else break;
+        argi += 2;
+    }
+    if (argc - argi != 2 || width <= 0 || height <= 0) {
+        cout << "usage: " << argv[0] << " [-w width] [-h height] console.log out_prefix" << endl;
+        cout << "  Renders each list printed by b8PpuDump() to out_prefix_NNN.png." << endl;
+        return -1;
+    }
+
+    ifstream in(argv[argi]);
+    if (!in) {
+        cerr << "Failed to open input file: " << argv[argi] << endl;
+        return -1;
+    }
+    const string prefix = argv[argi + 1];
+
+    // Lists run in the order they were dumped; VRAM and palettes carry over.
+    SoftPpu ppu(width, height);
+    Memory mem;
+    uint32_t start = 0;
+    bool begun = false;
+    int lists = 0;
+    int failed = 0;
+    string line;
+    while (getline(in, line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        size_t pos;
+        if ((pos = line.find("B8PPU BEGIN ")) != string::npos) {
+            start = (uint32_t)stoul(line.substr(pos + 12), nullptr, 16);
+            mem.clear();
+            begun = true;
+            continue;
+        }
+        if (line.find("B8PPU END") != string::npos) {
+            if (!begun) continue;
+            begun = false;
+            if (!ppu.exec(mem, start)) {
+                cerr << "list " << lists << ": " << ppu.error() << endl;
+                ++failed;
+            }
+            char name[32];
+            snprintf(name, sizeof(name), "_%03d.png", lists);
+            if (!write_png(prefix + name, ppu)) {
+                cerr << "Failed to write " << prefix + name << endl;
+                return -1;
+            }
+            print_costs(lists, ppu);
+            ++lists;
+            continue;
+        }
+        if (!begun) continue;
+        if ((pos = line.find("B8P ")) == string::npos && (pos = line.find("B8M ")) == string::npos) continue;
+
+        istringstream fields(line.substr(pos + 4));
+        string addr, word;
+        if (!(fields >> addr) || addr.size() != 8) continue;
+        uint32_t a = (uint32_t)stoul(addr, nullptr, 16);
+        while (fields >> word) {
+            if (word.size() != 8) break;
+            mem.write(a, (uint32_t)stoul(word, nullptr, 16));
+            a += 4;
+        }
+    }
+
+    if (lists == 0) {
+        cerr << "No B8PPU dump found in " << argv[argi] << endl;
+        return -1;
+    }
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,350 @@
+#include "softppu.h"
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+
+// B8_PPU_BG_WRAP_*
+enum {
+    WRAP_CLAMP = 0,
+    WRAP_CLAMP_TO_EDGE = 1,
+    WRAP_REPEAT = 2,
+};
+
+static int lo16s(uint32_t v) { return (int16_t)(v & 0xffff); }
+static int hi16s(uint32_t v) { return (int16_t)(v >> 16); }
+static int lo16u(uint32_t v) { return (int)(v & 0xffff); }
+static int hi16u(uint32_t v) { return (int)(v >> 16); }
+
+uint32_t Memory::word(uint32_t addr) const {
+    auto it = words.find(addr & ~3u);
+    return it == words.end() ? 0 : it->second;
+}
+
+uint8_t Memory::byte(uint32_t addr) const {
+    return (uint8_t)(word(addr) >> ((addr & 3) * 8));
+}
+
+uint16_t Memory::half(uint32_t addr) const {
+    return (uint16_t)(byte(addr) | (byte(addr + 1) << 8));
+}
+
+SoftPpu::SoftPpu(int width, int height) : w(width), h(height) {
+    reset();
+}
+
+void SoftPpu::reset() {
+    fb.assign(w * h, 0);
+    vram.assign(VRAM_W * VRAM_H, 0);
+    vram_staged = vram;
+    for (int pp = 0; pp < 16; ++pp) {
+        for (int ii = 0; ii < 16; ++ii) pal[pp][ii] = (uint8_t)ii;
+    }
+    memcpy(pal_staged, pal, sizeof(pal));
+    clip = {0, 0, w, h};
+    view_x = view_y = 0;
+    cull = false;
+}
+
+const char* SoftPpu::cmd_name(uint8_t code) {
+    switch (code) {
+    case CMD_NOP:        return "NOP";
+    case CMD_FLUSH:      return "FLUSH";
+    case CMD_ENABLE:     return "ENABLE";
+    case CMD_RECT:       return "RECT";
+    case CMD_POLY:       return "POLY";
+    case CMD_SPRITE:     return "SPRITE";
+    case CMD_SETPAL:     return "SETPAL";
+    case CMD_SETPHYPAL:  return "SETPHYPAL";
+    case CMD_BG:         return "BG";
+    case CMD_SCISSOR:    return "SCISSOR";
+    case CMD_VIEWOFFSET: return "VIEWOFFSET";
+    case CMD_LOADIMG:    return "LOADIMG";
+    case CMD_LINE:       return "LINE";
+    case CMD_JMP:        return "JMP";
+    case CMD_HALT:       return "HALT";
+    }
+    return "?";
+}
+
+// Size in words, 0 for commands this model does not know.
+static uint32_t cmd_words(uint8_t code) {
+    switch (code) {
+    case CMD_NOP: case CMD_FLUSH: case CMD_ENABLE: case CMD_JMP: case CMD_HALT:
+        return 1;
+    case CMD_VIEWOFFSET:
+        return 2;
+    case CMD_RECT: case CMD_SPRITE: case CMD_SETPAL: case CMD_SCISSOR: case CMD_LINE:
+        return 3;
+    case CMD_POLY: case CMD_BG: case CMD_LOADIMG:
+        return 4;
+    }
+    return 0;
+}
+
+bool SoftPpu::fetch(const Memory& mem, uint32_t addr, uint32_t words) {
+    for (uint32_t nn = 0; nn < words; ++nn) {
+        if (!mem.has(addr + nn * 4)) {
+            char buf[64];
+            snprintf(buf, sizeof(buf), "no command at %08x", addr + nn * 4);
+            err = buf;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool SoftPpu::exec(const Memory& mem, uint32_t addr) {
+    cost.clear();
+    err.clear();
+    fb.assign(w * h, 0);
+
+    uint32_t pc = addr;
+    for (uint32_t cnt = 0; cnt < 0x400000; ++cnt) {
+        if (!fetch(mem, pc, 1)) return false;
+        const uint32_t w0 = mem.word(pc);
+        const uint8_t code = (uint8_t)(w0 >> 24);
+        const uint32_t words = cmd_words(code);
+        if (words == 0) {
+            char buf[64];
+            snprintf(buf, sizeof(buf), "unsupported command %02x at %08x", code, pc);
+            err = buf;
+            return false;
+        }
+        if (!fetch(mem, pc, words)) return false;
+
+        CmdCost& c = cost[code];
+        ++c.count;
+        switch (code) {
+        case CMD_HALT:
+            return true;
+        case CMD_JMP:
+            pc = (w0 & 0xffffff) << 2;
+            continue;
+        case CMD_FLUSH:
+            flush(w0);
+            break;
+        case CMD_ENABLE:
+            cull = (w0 & 1) != 0;
+            break;
+        case CMD_RECT:
+            rect(mem, pc, c);
+            break;
+        case CMD_POLY:
+            poly(mem, pc, c);
+            break;
+        case CMD_LINE:
+            line(mem, pc, c);
+            break;
+        case CMD_SPRITE:
+            sprite(mem, pc, c);
+            break;
+        case CMD_BG:
+            bg(mem, pc, c);
+            break;
+        case CMD_SETPAL:
+            setpal(mem, pc);
+            break;
+        case CMD_LOADIMG:
+            loadimg(mem, pc, c);
+            break;
+        case CMD_SCISSOR: {
+            const uint32_t w1 = mem.word(pc + 4), w2 = mem.word(pc + 8);
+            const int x = hi16s(w1), y = lo16s(w1);
+            clip.x0 = max(0, x);
+            clip.y0 = max(0, y);
+            clip.x1 = min(w, x + hi16s(w2));
+            clip.y1 = min(h, y + lo16s(w2));
+        } break;
+        case CMD_VIEWOFFSET: {
+            const uint32_t w1 = mem.word(pc + 4);
+            view_x = hi16s(w1);
+            view_y = lo16s(w1);
+        } break;
+        default:
+            break;
+        }
+        pc += words * 4;
+    }
+    err = "list does not halt";
+    return false;
+}
+
+void SoftPpu::flush(uint32_t w0) {
+    if (w0 & 1) memcpy(pal, pal_staged, sizeof(pal));
+    if (w0 & 2) vram = vram_staged;
+}
+
+void SoftPpu::plot(int x, int y, uint8_t col, CmdCost& c) {
+    if (x < clip.x0 || x >= clip.x1 || y < clip.y0 || y >= clip.y1) return;
+    fb[y * w + x] = col;
+    ++c.pixels;
+}
+
+// RECT, POLY and LINE write their color as is; palettes apply to VRAM pixels only.
+void SoftPpu::rect(const Memory& mem, uint32_t pc, CmdCost& c) {
+    const uint32_t w0 = mem.word(pc), w1 = mem.word(pc + 4), w2 = mem.word(pc + 8);
+    const uint8_t col = w0 & 0xf;
+    const int x0 = hi16s(w1) + view_x, y0 = lo16s(w1) + view_y;
+    const int x1 = min(x0 + hi16u(w2), clip.x1), y1 = min(y0 + lo16u(w2), clip.y1);
+    for (int y = max(y0, clip.y0); y < y1; ++y) {
+        for (int x = max(x0, clip.x0); x < x1; ++x) plot(x, y, col, c);
+    }
+}
+
+// Pixels whose center is inside the triangle. A center exactly on an edge
+// belongs to a top or left edge only, so triangles sharing an edge do not overlap.
+void SoftPpu::poly(const Memory& mem, uint32_t pc, CmdCost& c) {
+    const uint8_t col = mem.word(pc) & 0xf;
+    int vx[3], vy[3];
+    for (int ii = 0; ii < 3; ++ii) {
+        const uint32_t ww = mem.word(pc + 4 + ii * 4);
+        vx[ii] = (hi16s(ww) + view_x) * 2;  // doubled, so pixel centers are integers
+        vy[ii] = (lo16s(ww) + view_y) * 2;
+    }
+
+    const auto edge = [&](int a, int b, int px, int py) {
+        return (int64_t)(vx[b] - vx[a]) * (py - vy[a]) - (int64_t)(vy[b] - vy[a]) * (px - vx[a]);
+    };
+    int64_t area = edge(0, 1, vx[2], vy[2]);
+    if (area == 0) return;
+    // Clockwise on screen is the front face.
+    if (area < 0) {
+        if (cull) return;
+        swap(vx[1], vx[2]);
+        swap(vy[1], vy[2]);
+    }
+
+    const int xmin = max(clip.x0, *min_element(vx, vx + 3) / 2 - 1);
+    const int xmax = min(clip.x1 - 1, *max_element(vx, vx + 3) / 2 + 1);
+    const int ymin = max(clip.y0, *min_element(vy, vy + 3) / 2 - 1);
+    const int ymax = min(clip.y1 - 1, *max_element(vy, vy + 3) / 2 + 1);
+
+    bool top_left[3];
+    for (int ii = 0; ii < 3; ++ii) {
+        const int jj = (ii + 1) % 3;
+        const int dx = vx[jj] - vx[ii], dy = vy[jj] - vy[ii];
+        top_left[ii] = (dy == 0 && dx > 0) || dy < 0;
+    }
+
+    for (int y = ymin; y <= ymax; ++y) {
+        for (int x = xmin; x <= xmax; ++x) {
+            const int px = x * 2 + 1, py = y * 2 + 1;
+            bool inside = true;
+            for (int ii = 0; ii < 3 && inside; ++ii) {
+                const int64_t e = edge(ii, (ii + 1) % 3, px, py);
+                inside = e > 0 || (e == 0 && top_left[ii]);
+            }
+            if (inside) plot(x, y, col, c);
+        }
+    }
+}
+
+// Bresenham, both ends included, with a square pen `width` half-pixels wide.
+void SoftPpu::line(const Memory& mem, uint32_t pc, CmdCost& c) {
+    const uint32_t w0 = mem.word(pc), w1 = mem.word(pc + 4), w2 = mem.word(pc + 8);
+    const uint8_t col = w0 & 0xf;
+    const int pen = max(1, (int)(((w0 >> 4) & 0xf) + 1) / 2);
+    const int back = (pen - 1) / 2;
+
+    int x0 = hi16s(w1) + view_x, y0 = lo16s(w1) + view_y;
+    const int x1 = hi16s(w2) + view_x, y1 = lo16s(w2) + view_y;
+    const int dx = abs(x1 - x0), sx = x0 < x1 ? 1 : -1;
+    const int dy = -abs(y1 - y0), sy = y0 < y1 ? 1 : -1;
+    int e = dx + dy;
+    for (;;) {
+        for (int yy = 0; yy < pen; ++yy) {
+            for (int xx = 0; xx < pen; ++xx) plot(x0 - back + xx, y0 - back + yy, col, c);
+        }
+        if (x0 == x1 && y0 == y1) break;
+        const int e2 = 2 * e;
+        if (e2 >= dy) { e += dy; x0 += sx; }
+        if (e2 <= dx) { e += dx; y0 += sy; }
+    }
+}
+
+// VRAM pixels go through the palette; an entry mapped to color 0 is transparent.
+void SoftPpu::sprite(const Memory& mem, uint32_t pc, CmdCost& c) {
+    const uint32_t w0 = mem.word(pc), w1 = mem.word(pc + 4), w2 = mem.word(pc + 8);
+    const uint8_t* lut = pal[w0 & 0xf];
+    const int hpix = (w1 & 0x1f) * 8;
+    const bool vfp = (w1 >> 5) & 1;
+    const int wpix = ((w1 >> 8) & 0x1f) * 8;
+    const bool hfp = (w1 >> 13) & 1;
+    const int v0 = ((w1 >> 16) & 0x3f) * 8;
+    const int u0 = ((w1 >> 24) & 0x3f) * 8;
+    const int x0 = hi16s(w2) + view_x, y0 = lo16s(w2) + view_y;
+
+    for (int yy = 0; yy < hpix; ++yy) {
+        const int v = (v0 + (vfp ? hpix - 1 - yy : yy)) & (VRAM_H - 1);
+        for (int xx = 0; xx < wpix; ++xx) {
+            const int u = (u0 + (hfp ? wpix - 1 - xx : xx)) & (VRAM_W - 1);
+            const uint8_t col = lut[vram[v * VRAM_W + u]];
+            if (col) plot(x0 + xx, y0 + yy, col, c);
+        }
+    }
+}
+
+// Fills the clip rectangle; the view offset does not apply.
+void SoftPpu::bg(const Memory& mem, uint32_t pc, CmdCost& c) {
+    const uint32_t w0 = mem.word(pc), w2 = mem.word(pc + 8), w3 = mem.word(pc + 12);
+    const int hlog2 = w0 & 0xf, wlog2 = (w0 >> 12) & 0xf;
+    const uint32_t tiles = mem.word(pc + 4);
+    const int vpix = lo16s(w2), upix = hi16s(w2);
+    const int vwrap = w3 & 3, uwrap = (w3 >> 2) & 3;
+    const int mw = 8 << wlog2, mh = 8 << hlog2;
+
+    const auto wrap = [](int t, int size, int mode, bool& out) {
+        if (mode == WRAP_REPEAT) return ((t % size) + size) % size;
+        if (t >= 0 && t < size) return t;
+        if (mode == WRAP_CLAMP_TO_EDGE) return t < 0 ? 0 : size - 1;
+        out = true;
+        return 0;
+    };
+
+    for (int y = clip.y0; y < clip.y1; ++y) {
+        for (int x = clip.x0; x < clip.x1; ++x) {
+            bool out = false;
+            const int u = wrap(x + upix, mw, uwrap, out);
+            const int v = wrap(y + vpix, mh, vwrap, out);
+            if (out) continue;
+
+            const uint16_t t = mem.half(tiles + 2 * (((v >> 3) << wlog2) + (u >> 3)));
+            const int ytile = t & 0x3f, xtile = (t >> 6) & 0x3f;
+            const bool vfp = (t >> 12) & 1, hfp = (t >> 13) & 1;
+            const int px = hfp ? 7 - (u & 7) : (u & 7);
+            const int py = vfp ? 7 - (v & 7) : (v & 7);
+            const uint8_t col = pal[t >> 14][vram[(ytile * 8 + py) * VRAM_W + xtile * 8 + px]];
+            if (col) plot(x, y, col, c);
+        }
+    }
+}
+
+void SoftPpu::setpal(const Memory& mem, uint32_t pc) {
+    const uint32_t w0 = mem.word(pc);
+    const uint64_t pidx = mem.word(pc + 4) | ((uint64_t)mem.word(pc + 8) << 32);
+    const int palsel = w0 & 0xf;
+    const uint32_t wmask = (w0 >> 4) & 0xffff;
+    for (int ii = 0; ii < 16; ++ii) {
+        if (wmask & (1u << ii)) pal_staged[palsel][ii] = (pidx >> (ii * 4)) & 0xf;
+    }
+}
+
+// Source images are 4bpp, two pixels per byte, left pixel in the high nibble.
+void SoftPpu::loadimg(const Memory& mem, uint32_t pc, CmdCost& c) {
+    const uint32_t src = mem.word(pc + 4), w2 = mem.word(pc + 8), w3 = mem.word(pc + 12);
+    const int stride = ((w2 >> 8) & 0x3f) * 4;
+    const int sy = ((w2 >> 16) & 0x3f) * 8, sx = ((w2 >> 24) & 0x3f) * 8;
+    const int th = (w3 & 0x3f) * 8, tw = ((w3 >> 8) & 0x3f) * 8;
+    const int dy = ((w3 >> 16) & 0x3f) * 8, dx = ((w3 >> 24) & 0x3f) * 8;
+
+    for (int yy = 0; yy < th; ++yy) {
+        for (int xx = 0; xx < tw; ++xx) {
+            const int u = sx + xx;
+            const uint8_t b = mem.byte(src + (sy + yy) * stride + u / 2);
+            const uint8_t pix = (u & 1) ? (b & 0xf) : (b >> 4);
+            vram_staged[((dy + yy) & (VRAM_H - 1)) * VRAM_W + ((dx + xx) & (VRAM_W - 1))] = pix;
+        }
+    }
+    c.pixels += (uint64_t)tw * th;
+}
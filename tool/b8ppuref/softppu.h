@@ -0,0 +1,107 @@
+#pragma once
+
+// Software model of the BEEP-8 PPU, for rendering command lists on the host.
+// Command layouts follow sdk/b8lib/include/b8/ppu.h, decoded word by word so
+// the host's pointer size does not matter.
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+// Command codes, see B8_PPU_CMD_* in ppu.h
+enum {
+    CMD_NOP        = 0x00,
+    CMD_FLUSH      = 0x01,
+    CMD_ENABLE     = 0x02,
+    CMD_RECT       = 0x10,
+    CMD_POLY       = 0x11,
+    CMD_SPRITE     = 0x12,
+    CMD_SETPAL     = 0x13,
+    CMD_SETPHYPAL  = 0x14,
+    CMD_BG         = 0x15,
+    CMD_SCISSOR    = 0x16,
+    CMD_VIEWOFFSET = 0x17,
+    CMD_LOADIMG    = 0x20,
+    CMD_LINE       = 0x21,
+    CMD_JMP        = 0xf0,
+    CMD_HALT       = 0xff,
+};
+
+// Target memory, sparse, addressed like the CPU sees it.
+class Memory {
+public:
+    void clear() { words.clear(); }
+    void write(uint32_t addr, uint32_t word) { words[addr & ~3u] = word; }
+    bool has(uint32_t addr) const { return words.count(addr & ~3u) != 0; }
+    uint32_t word(uint32_t addr) const;
+    uint8_t byte(uint32_t addr) const;
+    uint16_t half(uint32_t addr) const;
+
+private:
+    std::map<uint32_t, uint32_t> words;
+};
+
+// What one command type cost in a list.
+struct CmdCost {
+    uint32_t count = 0;
+    uint64_t pixels = 0;  // pixels written, or transferred for LOADIMG
+};
+
+class SoftPpu {
+public:
+    static const int VRAM_W = 512;
+    static const int VRAM_H = 512;
+
+    SoftPpu(int width = 128, int height = 240);
+
+    // Forgets VRAM and palettes, like a reset.
+    void reset();
+
+    // Runs the list at `addr` until HALT. Returns false, with error() set, when
+    // the list reads memory that is not there or has an unknown command.
+    bool exec(const Memory& mem, uint32_t addr);
+
+    int width() const { return w; }
+    int height() const { return h; }
+
+    // Physical color (0-15) of each pixel, row by row.
+    const std::vector<uint8_t>& framebuffer() const { return fb; }
+
+    // Costs of the last exec(), by command code.
+    const std::map<uint8_t, CmdCost>& costs() const { return cost; }
+
+    const std::string& error() const { return err; }
+
+    static const char* cmd_name(uint8_t code);
+
+private:
+    struct Clip {
+        int x0, y0, x1, y1;  // x1, y1 exclusive
+    };
+
+    void plot(int x, int y, uint8_t col, CmdCost& c);
+    void rect(const Memory& mem, uint32_t pc, CmdCost& c);
+    void poly(const Memory& mem, uint32_t pc, CmdCost& c);
+    void line(const Memory& mem, uint32_t pc, CmdCost& c);
+    void sprite(const Memory& mem, uint32_t pc, CmdCost& c);
+    void bg(const Memory& mem, uint32_t pc, CmdCost& c);
+    void setpal(const Memory& mem, uint32_t pc);
+    void loadimg(const Memory& mem, uint32_t pc, CmdCost& c);
+    void flush(uint32_t w0);
+    bool fetch(const Memory& mem, uint32_t addr, uint32_t words);
+
+    int w, h;
+    std::vector<uint8_t> fb;
+
+    // LOADIMG and SETPAL write the staging copies; FLUSH makes them visible.
+    std::vector<uint8_t> vram, vram_staged;
+    uint8_t pal[16][16], pal_staged[16][16];
+
+    Clip clip;
+    int view_x = 0, view_y = 0;
+    bool cull = false;
+
+    std::map<uint8_t, CmdCost> cost;
+    std::string err;
+};
@@ -0,0 +1,269 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <map>
+#include <cstdint>
+#include <cstdio>
+
+using namespace std;
+
+// b8OsTraceEvent::type, see sdk/b8lib/include/b8/os.h
+enum {
+    TRACE_SWITCH = 1,
+    TRACE_SYSCALL,
+    TRACE_IRQ,
+    TRACE_RETURN,
+    TRACE_BLOCK,
+    TRACE_WAKE,
+};
+
+// Same order as b8OsSysCallNum in sdk/b8lib/include/b8/os.h
+static const char* syscall_names[] = {
+    "NULL",
+    "GET_BRIDGE",
+    "SCHED_YIELD",
+    "SCHED_SLEEP",
+    "THREAD_CREATE",
+    "EXIT",
+    "SET_ERRNO",
+    "GET_ERRNO",
+    "SEM_INIT",
+    "SEM_POST",
+    "SEM_WAIT",
+    "SEM_GETVALUE",
+    "CLOCK_GETRES",
+    "CLOCK_GETTIME",
+    "CLOCK_SETTIME",
+    "SCHED_SETPARAM",
+    "SCHED_GETPARAM",
+    "MUTEX_WAIT",
+    "MUTEX_WAKE",
+    "THREAD_JOIN",
+    "THREAD_DETACH",
+    "COND_WAIT",
+    "COND_SIGNAL",
+    "STACK_INFO",
+    "THREAD_STAT",
+    "IRQ_SEM_BIND",
+};
+
+// B8_OS_TRACE_WAIT_*
+static const char* wait_names[] = {
+    "nothing",
+    "semaphore",
+    "timer",
+    "irq",
+    "mutex",
+    "join",
+    "cond",
+};
+
+struct Event {
+    uint64_t cycle;     // unwrapped
+    uint32_t pid;
+    uint8_t  type;
+    uint16_t arg;
+};
+
+// The pseudo thread that shows interrupt handling.
+static const uint32_t irq_tid = 0xffffffff;
+
+static string syscall_name(uint16_t num) {
+    if (num < sizeof(syscall_names) / sizeof(syscall_names[0])) return syscall_names[num];
+    return "SYSCALL_" + to_string(num);
+}
+
+static string wait_name(uint16_t reason) {
+    if (reason < sizeof(wait_names) / sizeof(wait_names[0])) return wait_names[reason];
+    return to_string(reason);
+}
+
+static string hex(uint32_t value) {
+    char buf[16];
+    snprintf(buf, sizeof(buf), "%08x", value);
+    return buf;
+}
+
+class ChromeTrace {
+public:
+    ChromeTrace(ostream& out, uint32_t hz) : out(out), hz(hz) {
+        out << "{\"traceEvents\":[\n";
+    }
+
+    ~ChromeTrace() {
+        out << "\n],\"displayTimeUnit\":\"ns\"}\n";
+    }
+
+    void complete(const string& name, uint32_t tid, uint64_t begin, uint64_t end) {
+        emit("{\"name\":\"" + name + "\",\"ph\":\"X\",\"pid\":1,\"tid\":" + to_string(tid) +
+             ",\"ts\":" + usec(begin) + ",\"dur\":" + usec(end - begin) + "}");
+    }
+
+    void instant(const string& name, uint32_t tid, uint64_t at) {
+        emit("{\"name\":\"" + name + "\",\"ph\":\"i\",\"s\":\"t\",\"pid\":1,\"tid\":" + to_string(tid) +
+             ",\"ts\":" + usec(at) + "}");
+    }
+
+    void thread_name(uint32_t tid, const string& name) {
+        emit("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" + to_string(tid) +
+             ",\"args\":{\"name\":\"" + name + "\"}}");
+    }
+
+private:
+    string usec(uint64_t cycle) const {
+        char buf[32];
+        snprintf(buf, sizeof(buf), "%.3f", (double)cycle * 1000000.0 / hz);
+        return buf;
+    }
+
+    void emit(const string& line) {
+        if (!first) out << ",\n";
+        out << line;
+        first = false;
+    }
+
+    ostream& out;
+    uint32_t hz;
+    bool first = true;
+};
+
+// Reads the text printed by b8OsTraceDump(). Other console output is ignored.
+static bool parse_dump(istream& in, uint32_t& hz, vector<Event>& events) {
+    string line;
+    bool begun = false;
+    uint64_t high = 0;
+    uint32_t last = 0;
+    while (getline(in, line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        size_t pos;
+        if ((pos = line.find("B8TRACE BEGIN ")) != string::npos) {
+            hz = (uint32_t)stoul(line.substr(pos + 14), nullptr, 16);
+            events.clear();
+            high = 0;
+            last = 0;
+            begun = true;
+            continue;
+        }
+        if (line.find("B8TRACE END") != string::npos) {
+            if (begun) return true;
+            continue;
+        }
+        if (!begun || (pos = line.find("B8T ")) == string::npos) continue;
+
+        istringstream fields(line.substr(pos + 4));
+        string cycle, pid, type_arg;
+        if (!(fields >> cycle >> pid >> type_arg)) continue;
+        if (cycle.size() != 8 || pid.size() != 8 || type_arg.size() != 8) continue;
+
+        Event ev;
+        const uint32_t low = (uint32_t)stoul(cycle, nullptr, 16);
+        if (!events.empty() && low < last) high += 1ull << 32;
+        last = low;
+        ev.cycle = high | low;
+        ev.pid = (uint32_t)stoul(pid, nullptr, 16);
+        const uint32_t ta = (uint32_t)stoul(type_arg, nullptr, 16);
+        ev.type = (uint8_t)(ta >> 16);
+        ev.arg = (uint16_t)ta;
+        events.push_back(ev);
+    }
+    return begun;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc != 3) {
+        cout << "usage: " << argv[0] << " console.log trace.json" << endl;
+        cout << "  Converts the output of b8OsTraceDump() to Chrome trace JSON." << endl;
+        return -1;
+    }
+
+    ifstream in(argv[1]);
+    if (!in) {
+        cerr << "Failed to open input file: " << argv[1] << endl;
+        return -1;
+    }
+
+    uint32_t hz = 0;
+    vector<Event> events;
+    if (!parse_dump(in, hz, events) || hz == 0) {
+        cerr << "No B8TRACE dump found in " << argv[1] << endl;
+        return -1;
+    }
+
+    ofstream out(argv[2]);
+    if (!out) {
+        cerr << "Failed to open output file: " << argv[2] << endl;
+        return -1;
+    }
+
+    {
+        ChromeTrace trace(out, hz);
+        map<uint32_t, bool> threads;
+        map<uint32_t, pair<uint16_t, uint64_t>> syscall_open;  // pid -> (syscall, since)
+        bool irq_open = false;
+        uint16_t irq_num = 0;
+        uint64_t irq_since = 0;
+        uint32_t running = 0;
+        uint64_t running_since = 0;
+
+        for (const Event& ev : events) {
+            threads[ev.pid] = true;
+            switch (ev.type) {
+            case TRACE_SWITCH:
+                if (running) trace.complete("running", running, running_since, ev.cycle);
+                running = ev.pid;
+                running_since = ev.cycle;
+                break;
+
+            case TRACE_SYSCALL:
+                syscall_open[ev.pid] = make_pair(ev.arg, ev.cycle);
+                break;
+
+            case TRACE_IRQ:
+                irq_open = true;
+                irq_num = ev.arg;
+                irq_since = ev.cycle;
+                break;
+
+            case TRACE_RETURN: {
+                if (irq_open) {
+                    trace.complete("irq " + to_string(irq_num), irq_tid, irq_since, ev.cycle);
+                    irq_open = false;
+                }
+                auto it = syscall_open.find(ev.pid);
+                if (it != syscall_open.end()) {
+                    trace.complete(syscall_name(it->second.first), ev.pid, it->second.second, ev.cycle);
+                    syscall_open.erase(it);
+                }
+                if (!running) {
+                    running = ev.pid;
+                    running_since = ev.cycle;
+                }
+            } break;
+
+            case TRACE_BLOCK:
+                trace.instant("block " + wait_name(ev.arg), ev.pid, ev.cycle);
+                break;
+
+            case TRACE_WAKE:
+                trace.instant("wake " + wait_name(ev.arg), ev.pid, ev.cycle);
+                break;
+
+            default:
+                break;
+            }
+        }
+        if (running && !events.empty()) {
+            trace.complete("running", running, running_since, events.back().cycle);
+        }
+
+        for (const auto& [pid, _] : threads) {
+            trace.thread_name(pid, "pid " + hex(pid));
+        }
+        trace.thread_name(irq_tid, "irq");
+    }
+
+    cout << events.size() << " events written to " << argv[2] << endl;
+    return 0;
+}